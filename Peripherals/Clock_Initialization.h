@@ -24,7 +24,7 @@ Clock_Struct clk0Struct;
 Clock_Handle clk0Handle;
 
 
-/* Some stuff for simulating nav indicator */
+/* Every 500 ms: wake TX, which sends the latest packed attitude */
 Void clk0Fxn(UArg arg0)
 {
 	if(goodToGo){
@@ -0,0 +1,42 @@
+/*
+ * Cycle_Counter.h
+ *
+ *  Cortex-M3 DWT cycle counter, for timing short code paths in CPU
+ *  cycles. The counter runs off the CPU clock and wraps every ~89 s at
+ *  48 MHz, so differences of cycleCount() are valid across one wrap.
+ *
+ *  The host harnesses (tools/host) define CYCLE_COUNTER_HOST and supply
+ *  the two functions from the host's own counter.
+ */
+
+#ifndef PERIPHERALS_CYCLE_COUNTER_H_
+#define PERIPHERALS_CYCLE_COUNTER_H_
+
+#include <stdint.h>
+
+#ifdef CYCLE_COUNTER_HOST
+void cycleCounterInit(void);
+uint32_t cycleCount(void);
+#else
+
+#define DWT_CTRL			(*(volatile uint32_t *)0xE0001000)
+#define DWT_CYCCNT			(*(volatile uint32_t *)0xE0001004)
+#define CoreDebug_DEMCR		(*(volatile uint32_t *)0xE000EDFC)
+
+#define DEMCR_TRCENA		(1UL << 24)
+#define DWT_CTRL_CYCCNTENA	(1UL << 0)
+
+/* Start the counter. Safe to call again, a running count is kept. */
+void cycleCounterInit(void)
+{
+	CoreDebug_DEMCR |= DEMCR_TRCENA;
+	DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+}
+
+uint32_t cycleCount(void)
+{
+	return DWT_CYCCNT;
+}
+#endif
+
+#endif /* PERIPHERALS_CYCLE_COUNTER_H_ */
@@ -12,6 +12,8 @@
 #include <ti/drivers/pin/PINCC26XX.h>
 #include "Watchdog_Initialization.h"
 #include "Clock_Initialization.h"
+#include "../Tasks/IMU/LSM9DS1.h"
+#include "../Tasks/IMU/IMU_Motion.h"
 
 /* Example/Board Header files */
 #include "Board.h"
@@ -20,6 +22,9 @@
 static PIN_Handle pinHandle;
 static PIN_State pinState;
 
+/* Clock tick of the last XG INT2 (data-ready or FIFO threshold) edge */
+volatile uint32_t xgIntTick;
+
 /*
  * Application button pin configuration table:
  *   - Interrupts are configured to trigger on rising edge.
@@ -39,28 +44,38 @@ void pinCallback(PIN_Handle handle, PIN_Id pinId) {
     uint32_t currVal = 0;
 	switch (pinId) {
 		case CC1310_LAUNCHXL_DIO12:
+			xgIntTick = Clock_getTicks();
 			currVal =  PIN_getOutputValue(Board_PIN_LED0);
 			PIN_setOutputValue(pinHandle, Board_PIN_LED0, !currVal);
-//			Semaphore_post(gyroSemaphoreHandle);
-			Semaphore_post(accelSemaphoreHandle);
+#if IMU_FIFO_THRESHOLD
+			Event_post(imuEventHandle, IMU_EVENT_XG);
+#else
+			/* Queue the read here, imuTask wakes once it completes */
+			if (goodToGo) readGyroAccelAllAsync(imuEventHandle, IMU_EVENT_XG);
+#endif
 			break;
 
 		case IOID_14:
 			currVal =  PIN_getOutputValue(Board_PIN_LED1);
 			PIN_setOutputValue(pinHandle, Board_PIN_LED1, !currVal);
-			Semaphore_post(magSemaphoreHandle);
+			Event_post(imuEventHandle, IMU_EVENT_MAG);
 			break;
 
 		case IOID_13:
 //			currVal =  PIN_getOutputValue(Board_PIN_LED0);
 //			PIN_setOutputValue(pinHandle, Board_PIN_LED0, !currVal);
-//			Semaphore_post(accelSemaphoreHandle);
-			Semaphore_post(gyroSemaphoreHandle);
+//			Event_post(imuEventHandle, IMU_EVENT_XG);
+			/* Gyro data is read with the accel on DIO12 */
 			break;
 
 		case IOID_1:
 //			currVal =  PIN_getOutputValue(CC1310_LAUNCHXL_PIN_RLED);
 //			PIN_setOutputValue(pinHandle, CC1310_LAUNCHXL_PIN_RLED, !currVal);
+			/* XG INT1: motion threshold while the gyro sleeps */
+			if (imuAsleep) {
+				imuWakePending = true;
+				Event_post(imuEventHandle, IMU_EVENT_WAKE);
+			}
 			break;
 
 
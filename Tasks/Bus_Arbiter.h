@@ -0,0 +1,108 @@
+/*
+ * Bus_Arbiter.h
+ *
+ *  One priority-inheriting lock per physical resource, replacing the
+ *  single baton semaphore that serialised the IMU against the radio. The
+ *  IMU task takes only the I2C lock and the radio tasks only the radio
+ *  lock, so a sample is never held up by packet airtime. A low-priority
+ *  holder of a lock is boosted to the priority of the highest waiter
+ *  (GateMutexPri).
+ *
+ *  Every acquisition records how long it waited and how long the lock was
+ *  held. Both go into a histogram per resource, with log2 bins in
+ *  Timestamp counts. Bin 0 counts zero, bin b counts [2^(b-1), 2^b), and
+ *  the last bin also takes everything longer. Task context only.
+ */
+
+#ifndef TASKS_BUS_ARBITER_H_
+#define TASKS_BUS_ARBITER_H_
+
+#include <ti/sysbios/gates/GateMutexPri.h>
+#include <xdc/runtime/Timestamp.h>
+
+typedef enum
+{
+	RESOURCE_I2C = 0,
+	RESOURCE_RADIO = 1,
+	RESOURCE_COUNT = 2
+} arbiterResource_type;
+
+#define ARBITER_HIST_BINS	24
+
+typedef struct ArbiterLock
+{
+	GateMutexPri_Struct gate;
+	GateMutexPri_Handle handle;
+	IArg key;
+	uint32_t acquiredAt;			// Timestamp when the current holder got it
+
+	/* Statistics */
+	uint32_t acquisitions;
+	uint32_t waitMax;
+	uint32_t holdMax;
+	uint32_t waitHist[ARBITER_HIST_BINS];
+	uint32_t holdHist[ARBITER_HIST_BINS];
+} ArbiterLock;
+
+ArbiterLock arbiterLocks[RESOURCE_COUNT];
+
+static uint8_t arbiterBin(uint32_t counts)
+{
+	uint8_t bin = 0;
+
+	while ((counts != 0) && (bin < ARBITER_HIST_BINS - 1))
+	{
+		counts >>= 1;
+		bin++;
+	}
+	return bin;
+}
+
+void arbiterSetup(void)
+{
+	GateMutexPri_Params params;
+	int i, j;
+
+	for (i = 0; i < RESOURCE_COUNT; i++)
+	{
+		GateMutexPri_Params_init(&params);
+		GateMutexPri_construct(&arbiterLocks[i].gate, &params);
+		arbiterLocks[i].handle = GateMutexPri_handle(&arbiterLocks[i].gate);
+		arbiterLocks[i].acquisitions = 0;
+		arbiterLocks[i].waitMax = 0;
+		arbiterLocks[i].holdMax = 0;
+		for (j = 0; j < ARBITER_HIST_BINS; j++)
+		{
+			arbiterLocks[i].waitHist[j] = 0;
+			arbiterLocks[i].holdHist[j] = 0;
+		}
+	}
+}
+
+/* Block until resource is free, then own it */
+void arbiterEnter(arbiterResource_type resource)
+{
+	ArbiterLock *lock = &arbiterLocks[resource];
+	uint32_t start = Timestamp_get32();
+	IArg key = GateMutexPri_enter(lock->handle);
+	uint32_t now = Timestamp_get32();
+	uint32_t wait = now - start;
+
+	lock->key = key;
+	lock->acquiredAt = now;
+	lock->acquisitions++;
+	if (wait > lock->waitMax) lock->waitMax = wait;
+	lock->waitHist[arbiterBin(wait)]++;
+}
+
+void arbiterLeave(arbiterResource_type resource)
+{
+	ArbiterLock *lock = &arbiterLocks[resource];
+	uint32_t hold = Timestamp_get32() - lock->acquiredAt;
+
+	if (hold > lock->holdMax) lock->holdMax = hold;
+	lock->holdHist[arbiterBin(hold)]++;
+	GateMutexPri_leave(lock->handle, lock->key);
+}
+
+#endif /* TASKS_BUS_ARBITER_H_ */
@@ -0,0 +1,459 @@
+/*
+ * Attitude_Filter.h
+ *
+ *  Complementary (Mahony) attitude filter on the fused IMU stream.
+ *
+ *  Every gyro frame in imuRing advances the quaternion by the measured
+ *  rate less the estimated bias. Whenever a new mag sample shows up in the
+ *  frames, the filter compares the measured field, and the mean accel
+ *  since the last correction, against the reference vectors seen through
+ *  the current attitude. The sum of the cross products is the attitude
+ *  error e. The attitude is turned by IMU_ATT_KP * e over the time since
+ *  the last correction, and the gyro bias moves by IMU_ATT_KI * e.
+ *
+ *  Accel is only used while it is a gravity reference: imuBiasGravity is
+ *  non-zero (it is 0 in free fall, i.e. in orbit) and |a| is within the
+ *  same tolerance IMU_Bias uses. Otherwise the mag alone corrects, and the
+ *  gyro carries the attitude between mag samples and about the field.
+ *  With the mag alone that angle drifts with the part of the gyro bias
+ *  along the field, tens of degrees over an orbit in tools/host/mekf_mc
+ *  and worse from a mag-only start, so the output is only valid while a
+ *  gravity pair was used within IMU_ATT_GRAVITY_STALE. In orbit it never
+ *  is, and the radio has only the MEKF (MEKF.h).
+ *  The first usable mag sample sets the attitude outright (attAlign()).
+ *  After that a mag sample only counts as a correction if one of the pairs
+ *  was usable, and the output is only valid after a correction.
+ *
+ *  The quaternion is Q30 and everything runs in integer math. The gains
+ *  are worked out in single precision only when the gyro scale or rate
+ *  changes. The output, attitudeQuat, has the same convention as
+ *  Quaternion.h: it is the rotation from the reference frame to the body.
+ *  As in MEKF.h the reference frame is local North-East-Down at the
+ *  magModel position: the mag is compared with the modelled field
+ *  (Mag_Model.h) and the accel with straight down.
+ */
+
+#ifndef TASKS_IMU_ATTITUDE_FILTER_H_
+#define TASKS_IMU_ATTITUDE_FILTER_H_
+
+#include <math.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include "LSM9DS1.h"
+#include "IMU_Ring.h"
+#include "IMU_Bias.h"
+#include "Fixed_Math.h"
+#include "Quaternion.h"
+#include "Mag_Model.h"
+
+/* Proportional gain, rad/s per unit error */
+#define IMU_ATT_KP				1.0f
+/* Integral (bias) gain, rad/s^2 per unit error */
+#define IMU_ATT_KI				0.1f
+/* Longest gap one correction may cover, longer gaps count as this */
+#define IMU_ATT_MAX_GAP			(500000 / Clock_tickPeriod)
+/* Output goes invalid this long after the last correction */
+#define IMU_ATT_STALE			(5000000 / Clock_tickPeriod)
+/* ... or this long after the last one with gravity. Long enough to ride
+ * out a manoeuvre on the gyro with the bias already estimated. */
+#define IMU_ATT_GRAVITY_STALE	(30000000 / Clock_tickPeriod)
+/* Largest bias estimate, raw gyro LSB (~5 dps at 245 dps) */
+#define IMU_ATT_BIAS_LIMIT		571
+/* Sign of each mag axis in the accel/gyro frame. The LSM9DS1 mag X axis
+ * points the opposite way to the accel/gyro X axis. */
+#define IMU_ATT_MAG_SIGN_X		(-1)
+#define IMU_ATT_MAG_SIGN_Y		1
+#define IMU_ATT_MAG_SIGN_Z		1
+
+#define Q30_ONE					(1L << 30)
+
+typedef struct AttitudeFilter
+{
+	int32_t q[4];				// Reference to body, Q30
+	int32_t biasQ16[3];			// Gyro bias, raw LSB << 16
+
+	/* Gains for the current gyro scale and rate */
+	float gRes;
+	uint32_t period;			// Gyro frame period, Clock ticks
+	int32_t halfAngleQ40;		// Half rotation per raw LSB per frame, Q40
+	int32_t kpTickQ32;			// IMU_ATT_KP per Clock tick, Q32
+	int32_t kiQ32;				// Bias step per unit error per tick, raw LSB, Q32
+
+	/* Accel seen since the last correction */
+	int32_t accelSum[3];
+	uint16_t accelFrames;
+
+	int16_t lastMag[3];
+	uint32_t lastCorrection;	// Stamp of the last usable mag sample
+	uint32_t lastGravity;		// Stamp of the last one with gravity
+	bool started;				// Aligned, lastCorrection is set
+	bool corrected;				// At least one correction done
+	bool gravitySeen;			// lastGravity is set
+
+	IMU_RingReader reader;
+	bool ready;
+
+	/* Telemetry */
+	int32_t errorQ28[3];		// Last correction's e
+	uint32_t corrections;
+	uint32_t accelRejected;		// Frames not used as a gravity reference
+} AttitudeFilter;
+
+AttitudeFilter attFilter;
+
+/* Latest attitude, Q14, w >= 0, and packed with quatPack() */
+int16_t attitudeQuat[4];
+uint16_t attitudePacked[3];
+bool attitudeValid;
+
+/* Reference directions, Q14, NED */
+static const int16_t attRefDown[3] = {0, 0, Q14_ONE};
+static int16_t attRefMag[3];
+static bool attRefMagOk;
+static uint32_t attRefUpdates;		// magModel.updates attRefMag is from
+
+/* Redo the gains if the gyro scale or rate changed */
+static void attUpdateGains(void)
+{
+	const float tickSeconds = Clock_tickPeriod * 1e-6f;
+	float radPerLsb;
+	uint32_t period = gyroPeriodTicks();
+
+	if ((imu->gRes == attFilter.gRes) && (period == attFilter.period))
+		return;
+	attFilter.gRes = imu->gRes;
+	attFilter.period = period;
+
+	radPerLsb = imu->gRes * 0.017453293f;
+	attFilter.halfAngleQ40 = (int32_t)lrintf(0.5f * radPerLsb * period * tickSeconds * 1099511627776.0f);
+	attFilter.kpTickQ32 = (int32_t)lrintf(IMU_ATT_KP * tickSeconds * 4294967296.0f);
+	attFilter.kiQ32 = (int32_t)lrintf(IMU_ATT_KI * tickSeconds / radPerLsb * 4294967296.0f);
+}
+
+/* Redo the field direction if the model moved */
+static void attUpdateReference(void)
+{
+	int32_t v[3];
+	int i;
+
+	if (magModel.updates == 0)
+		magModelInit();
+	if (attRefMagOk && (attRefUpdates == magModel.updates))
+		return;
+	attRefUpdates = magModel.updates;
+	for (i = 0; i < 3; i++) v[i] = (int32_t)lrintf(magModel.unit[i] * Q14_ONE);
+	attRefMagOk = normalizeQ14(v, attRefMag);
+}
+
+/*
+ * Turn the attitude by the body rotation whose half angle is h (Q30 rad),
+ * then pull |q| back to one. The reference to body quaternion moves as
+ * dq/dt = -1/2 (0, w) q.
+ */
+static void attRotate(const int32_t h[3])
+{
+	int32_t *q = attFilter.q;
+	int32_t w = q[0], x = q[1], y = q[2], z = q[3];
+	int64_t n2;
+	int32_t k;
+	int i;
+
+	q[0] = w + (int32_t)(((int64_t)h[0] * x + (int64_t)h[1] * y + (int64_t)h[2] * z) >> 30);
+	q[1] = x - (int32_t)(((int64_t)w * h[0] + (int64_t)h[1] * z - (int64_t)h[2] * y) >> 30);
+	q[2] = y - (int32_t)(((int64_t)w * h[1] + (int64_t)h[2] * x - (int64_t)h[0] * z) >> 30);
+	q[3] = z - (int32_t)(((int64_t)w * h[2] + (int64_t)h[0] * y - (int64_t)h[1] * x) >> 30);
+
+	/* One Newton step for 1/|q|, enough since |q| stays close to one */
+	n2 = 0;
+	for (i = 0; i < 4; i++) n2 += (int64_t)q[i] * q[i];
+	k = (int32_t)(((3LL << 60) - n2) >> 31);
+	for (i = 0; i < 4; i++) q[i] = (int32_t)(((int64_t)q[i] * k) >> 30);
+}
+
+/* Gyro step for one frame */
+static void attPropagate(const IMU_Frame *frame)
+{
+	int32_t h[3];
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		int32_t rateQ8 = ((int32_t)frame->xg[i] << 8) - (attFilter.biasQ16[i] >> 8);
+		h[i] = (int32_t)(((int64_t)rateQ8 * attFilter.halfAngleQ40) >> 18);
+	}
+	attRotate(h);
+}
+
+/* Add measured x predicted for one vector pair, Q28. False if unusable. */
+static bool attAddError(const int32_t measured[3], const int16_t reference[3],
+		const int16_t dcm[9], int32_t error[3])
+{
+	int16_t m[3], p[3];
+	int32_t c[3];
+	int i;
+
+	if (!normalizeQ14(measured, m))
+		return false;
+	for (i = 0; i < 3; i++)
+	{
+		int32_t e = (int32_t)dcm[3*i] * reference[0] + (int32_t)dcm[3*i + 1] * reference[1] +
+				(int32_t)dcm[3*i + 2] * reference[2];
+		p[i] = (int16_t)((e + (1L << 13)) >> 14);
+	}
+	crossQ14(m, p, c);
+	for (i = 0; i < 3; i++) error[i] += c[i];
+	return true;
+}
+
+/* Unit triad (t1, t1 x u, t1 x (t1 x u)), Q14 */
+static bool attTriad(const int16_t t1[3], const int16_t u[3], int16_t t2[3], int16_t t3[3])
+{
+	int32_t c[3];
+
+	crossQ14(t1, u, c);
+	if (!normalizeQ14(c, t2))
+		return false;
+	crossQ14(t1, t2, c);
+	return normalizeQ14(c, t3);
+}
+
+/*
+ * Start from the measured directions, Q14 units: TRIAD if down is known,
+ * else the shortest turn taking the modelled field onto the measured one,
+ * A = c I + [v x] + v v' / (1 + c) with v = r x m and c = r . m. The
+ * angle about the field is then left to the gyro and later samples.
+ */
+static bool attAlign(const int16_t mag[3], const int16_t *down)
+{
+	int16_t dcm[9], q14[4];
+	int i, j;
+
+	if (down != NULL)
+	{
+		int16_t b2[3], b3[3], r2[3], r3[3];
+
+		if (!attTriad(down, mag, b2, b3) || !attTriad(attRefDown, attRefMag, r2, r3))
+			return false;
+		for (i = 0; i < 3; i++)
+		{
+			for (j = 0; j < 3; j++)
+			{
+				int32_t e = (int32_t)down[i] * attRefDown[j] + (int32_t)b2[i] * r2[j] +
+						(int32_t)b3[i] * r3[j];
+				dcm[3*i + j] = (int16_t)((e + (1L << 13)) >> 14);
+			}
+		}
+	}
+	else
+	{
+		int32_t v[3], c = 0;
+		int16_t vq[3];
+
+		crossQ14(attRefMag, mag, v);
+		for (i = 0; i < 3; i++)
+		{
+			vq[i] = (int16_t)((v[i] + (1L << 13)) >> 14);
+			c += (int32_t)attRefMag[i] * mag[i];
+		}
+		c = (c + (1L << 13)) >> 14;
+		/* Too close to opposite for the turn axis to mean anything */
+		if (c < -(Q14_ONE * 9) / 10)
+			return false;
+		for (i = 0; i < 3; i++)
+		{
+			for (j = 0; j < 3; j++)
+				dcm[3*i + j] = (int16_t)(((int32_t)vq[i] * vq[j]) / (Q14_ONE + c));
+			dcm[3*i + i] += (int16_t)c;
+		}
+		dcm[1] -= vq[2]; dcm[2] += vq[1];
+		dcm[3] += vq[2]; dcm[5] -= vq[0];
+		dcm[6] -= vq[1]; dcm[7] += vq[0];
+	}
+	if (!dcmToQuatQ14(dcm, q14))
+		return false;
+	for (i = 0; i < 4; i++) attFilter.q[i] = (int32_t)q14[i] << 16;
+	return true;
+}
+
+/* Vector correction when a new mag sample arrives */
+static void attCorrect(const IMU_Frame *frame)
+{
+	int32_t error[3] = {0, 0, 0};
+	int32_t v[3], h[3];
+	int16_t q14[4], dcm[9];
+	uint32_t ticks;
+	bool used = false;
+	int i;
+
+	attUpdateReference();
+	if (!attFilter.started)
+	{
+		int16_t mag[3], down[3];
+		bool haveDown;
+
+		v[0] = IMU_ATT_MAG_SIGN_X * frame->mag[0];
+		v[1] = IMU_ATT_MAG_SIGN_Y * frame->mag[1];
+		v[2] = IMU_ATT_MAG_SIGN_Z * frame->mag[2];
+		used = attRefMagOk && normalizeQ14(v, mag);
+		for (i = 0; i < 3; i++) v[i] = -attFilter.accelSum[i];
+		haveDown = (attFilter.accelFrames != 0) && normalizeQ14(v, down);
+		for (i = 0; i < 3; i++) attFilter.accelSum[i] = 0;
+		attFilter.accelFrames = 0;
+		if (used && attAlign(mag, haveDown ? down : NULL))
+		{
+			attFilter.started = true;
+			attFilter.lastCorrection = frame->stamp;
+			if (haveDown)
+			{
+				attFilter.gravitySeen = true;
+				attFilter.lastGravity = frame->stamp;
+			}
+		}
+		return;
+	}
+
+	for (i = 0; i < 4; i++) q14[i] = (int16_t)((attFilter.q[i] + (1L << 15)) >> 16);
+	quatToDcmQ14(q14, dcm);
+
+	if (attRefMagOk)
+	{
+		v[0] = IMU_ATT_MAG_SIGN_X * frame->mag[0];
+		v[1] = IMU_ATT_MAG_SIGN_Y * frame->mag[1];
+		v[2] = IMU_ATT_MAG_SIGN_Z * frame->mag[2];
+		used = attAddError(v, attRefMag, dcm, error);
+	}
+	if (attFilter.accelFrames != 0)
+	{
+		/* The accel reads minus gravity, as in calcAccel() */
+		for (i = 0; i < 3; i++) v[i] = -attFilter.accelSum[i];
+		if (attAddError(v, attRefDown, dcm, error))
+		{
+			used = true;
+			attFilter.gravitySeen = true;
+			attFilter.lastGravity = frame->stamp;
+		}
+	}
+	for (i = 0; i < 3; i++)
+	{
+		attFilter.accelSum[i] = 0;
+		attFilter.errorQ28[i] = error[i];
+	}
+	attFilter.accelFrames = 0;
+	if (!used)
+		return;
+
+	ticks = frame->stamp - attFilter.lastCorrection;
+	attFilter.lastCorrection = frame->stamp;
+	if (ticks > IMU_ATT_MAX_GAP)
+		ticks = IMU_ATT_MAX_GAP;
+
+	/* Half angle KP e T / 2, with e Q28 and KP T Q16 */
+	{
+		int32_t gainQ16 = (int32_t)(((int64_t)attFilter.kpTickQ32 * ticks) >> 16);
+		for (i = 0; i < 3; i++)
+			h[i] = (int32_t)(((int64_t)error[i] * gainQ16) >> 15);
+	}
+	attRotate(h);
+
+	/* Bias moves by -KI e T */
+	for (i = 0; i < 3; i++)
+	{
+		int64_t step = (((int64_t)error[i] * attFilter.kiQ32) >> 20) * ticks;
+		int32_t b = attFilter.biasQ16[i] - (int32_t)(step >> 24);
+
+		if (b > ((int32_t)IMU_ATT_BIAS_LIMIT << 16)) b = (int32_t)IMU_ATT_BIAS_LIMIT << 16;
+		if (b < -((int32_t)IMU_ATT_BIAS_LIMIT << 16)) b = -((int32_t)IMU_ATT_BIAS_LIMIT << 16);
+		attFilter.biasQ16[i] = b;
+	}
+	attFilter.corrected = true;
+	attFilter.corrections++;
+}
+
+/* Sum the frame's accel if it looks like gravity alone */
+static void attAccumulateAccel(const IMU_Frame *frame)
+{
+	int i;
+
+	if (!imuAccelIsGravity(&frame->xg[3]) || (attFilter.accelFrames == UINT16_MAX))
+	{
+		attFilter.accelRejected++;
+		return;
+	}
+	/* At most 2^16 frames of 2^15, kept in range by dropping two bits */
+	for (i = 0; i < 3; i++) attFilter.accelSum[i] += frame->xg[3 + i] >> 2;
+	attFilter.accelFrames++;
+}
+
+/* No attitude until the first mag sample, no bias */
+void attFilterInit(void)
+{
+	int i;
+
+	attFilter.q[0] = Q30_ONE;
+	for (i = 0; i < 3; i++)
+	{
+		attFilter.q[i + 1] = 0;
+		attFilter.biasQ16[i] = 0;
+		attFilter.accelSum[i] = 0;
+		attFilter.lastMag[i] = 0;
+	}
+	attFilter.accelFrames = 0;
+	attFilter.started = false;
+	attFilter.corrected = false;
+	attFilter.gravitySeen = false;
+	attFilter.corrections = 0;
+	attFilter.accelRejected = 0;
+	attFilter.gRes = 0;
+	attFilter.period = 0;
+	attitudeValid = false;
+	imuRingReaderInit(&imuRing, &attFilter.reader);
+	attFilter.ready = true;
+}
+
+/*
+ * Run the filter over the frames published since the last call. Run from
+ * the task that consumes the sensor data, after imuVoteRun().
+ */
+void attFilterRun(void)
+{
+	IMU_Frame frame;
+	bool fresh = false;
+	int16_t q14[4];
+	UInt key;
+	int i;
+
+	if (!attFilter.ready)
+		attFilterInit();
+	attUpdateGains();
+
+	while (imuRingRead(&imuRing, &attFilter.reader, &frame))
+	{
+		fresh = true;
+		attPropagate(&frame);
+		attAccumulateAccel(&frame);
+		if ((frame.mag[0] | frame.mag[1] | frame.mag[2]) != 0 &&
+			((frame.mag[0] != attFilter.lastMag[0]) || (frame.mag[1] != attFilter.lastMag[1]) ||
+			 (frame.mag[2] != attFilter.lastMag[2])))
+		{
+			for (i = 0; i < 3; i++) attFilter.lastMag[i] = frame.mag[i];
+			attCorrect(&frame);
+		}
+	}
+	if (!fresh)
+		return;
+
+	for (i = 0; i < 4; i++) q14[i] = (int16_t)((attFilter.q[i] + (1L << 15)) >> 16);
+	if (q14[0] < 0)
+	{
+		for (i = 0; i < 4; i++) q14[i] = -q14[i];
+	}
+	key = Hwi_disable();
+	for (i = 0; i < 4; i++) attitudeQuat[i] = q14[i];
+	attitudeValid = attFilter.corrected && attFilter.gravitySeen &&
+			(frame.stamp - attFilter.lastCorrection < IMU_ATT_STALE) &&
+			(frame.stamp - attFilter.lastGravity < IMU_ATT_GRAVITY_STALE);
+	quatPack(attitudeQuat, attitudeValid, attitudePacked);
+	Hwi_restore(key);
+}
+
+#endif /* TASKS_IMU_ATTITUDE_FILTER_H_ */
@@ -0,0 +1,137 @@
+/*
+ * Fixed_Math.h
+ *
+ *  Integer helpers for the attitude code, which runs on a Cortex-M3
+ *  without an FPU. Unit vectors and direction cosines are Q14, so
+ *  1.0 = 16384 and a full rotation matrix fits in int16_t.
+ */
+
+#ifndef TASKS_IMU_FIXED_MATH_H_
+#define TASKS_IMU_FIXED_MATH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define Q14_ONE		16384
+
+/* 1/sqrt(f) for f = (i + 0.5) / 16, i = 4..15, in Q30 */
+static const uint32_t rsqrtSeed[12] = {
+	2024667000, 1831380208, 1684624773, 1568300315, 1473161629, 1393471397,
+	1325455684, 1266516759, 1214800200, 1168942037, 1127913670, 1090922784
+};
+
+/*
+ * Reciprocal square root. x (non-zero) is shifted left by an even amount
+ * into [2^30, 2^32), read as f in [0.25, 1). Returns y = 1/sqrt(f) in Q30
+ * and the half shift h, so that 1/sqrt(x) = y * 2^(h - 46). A table seed
+ * and three Newton steps give a relative error below 1e-8.
+ */
+uint32_t rsqrtQ30(uint32_t x, uint8_t *halfShift)
+{
+	uint32_t y, t;
+	uint64_t y2;
+	uint8_t h = 0;
+	int i;
+
+	while (x < (1UL << 30))
+	{
+		x <<= 2;
+		h++;
+	}
+	y = rsqrtSeed[(x >> 28) - 4];
+	for (i = 0; i < 3; i++)
+	{
+		y2 = ((uint64_t)y * y) >> 30;						// y^2, Q30
+		t = (3UL << 30) - (uint32_t)((x * y2) >> 32);		// 3 - f y^2, Q30
+		y = (uint32_t)(((uint64_t)y * t) >> 31);			// y (3 - f y^2) / 2
+	}
+	*halfShift = h;
+	return y;
+}
+
+/* Scale n components to unit length in Q14, see normalizeQ14() */
+static bool normalizeQ14n(const int32_t *v, int16_t *out, int n)
+{
+	int32_t s[4];
+	uint32_t peak = 0, n2, y;
+	uint8_t shift = 0, h;
+	int i;
+
+	/* Bring the largest component into [2^14, 2^15), so the sum of
+	 * squares (at most four) fits in 32 bits and keeps 15 significant
+	 * bits */
+	for (i = 0; i < n; i++)
+	{
+		uint32_t a = (v[i] < 0) ? -(uint32_t)v[i] : (uint32_t)v[i];
+		if (a > peak) peak = a;
+	}
+	if (peak == 0)
+		return false;
+	while ((peak >> shift) >= (1UL << 15)) shift++;
+	for (i = 0; i < n; i++) s[i] = v[i] >> shift;
+	while (peak < (1UL << 14))
+	{
+		peak <<= 1;
+		for (i = 0; i < n; i++) s[i] <<= 1;
+	}
+
+	n2 = 0;
+	for (i = 0; i < n; i++) n2 += (uint32_t)(s[i] * s[i]);
+	y = rsqrtQ30(n2, &h);
+
+	/* s * 2^14 / sqrt(n2) = s * y * 2^(h - 32) */
+	for (i = 0; i < n; i++)
+	{
+		int64_t p = (int64_t)s[i] * y;
+		out[i] = (int16_t)((p + (1LL << (31 - h))) >> (32 - h));
+	}
+	return true;
+}
+
+/*
+ * Scale v to unit length in Q14, within 2 LSB per component. v may have
+ * any magnitude that fits in int32_t. Returns false for the zero vector.
+ */
+bool normalizeQ14(const int32_t v[3], int16_t out[3])
+{
+	return normalizeQ14n(v, out, 3);
+}
+
+/* Same for a quaternion */
+bool normalizeQuatQ14(const int32_t v[4], int16_t out[4])
+{
+	return normalizeQ14n(v, out, 4);
+}
+
+/* Integer square root, floor(sqrt(x)) */
+uint32_t isqrt32(uint32_t x)
+{
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;
+
+	while (bit > x) bit >>= 2;
+	while (bit != 0)
+	{
+		if (x >= root + bit)
+		{
+			x -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return root;
+}
+
+/* Cross product of two Q14 vectors, Q28 */
+void crossQ14(const int16_t u[3], const int16_t v[3], int32_t out[3])
+{
+	out[0] = (int32_t)u[1] * v[2] - (int32_t)u[2] * v[1];
+	out[1] = (int32_t)u[2] * v[0] - (int32_t)u[0] * v[2];
+	out[2] = (int32_t)u[0] * v[1] - (int32_t)u[1] * v[0];
+}
+
+#endif /* TASKS_IMU_FIXED_MATH_H_ */
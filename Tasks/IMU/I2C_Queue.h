@@ -0,0 +1,242 @@
+/*
+ * I2C_Queue.h
+ *
+ *  Queued, callback-mode I2C engine. Transactions are described by
+ *  fixed-size queue entries and started back to back from the driver's
+ *  completion callback, so reads can be posted from interrupt context
+ *  without any task blocking on the bus. i2cQueueTransfer() wraps a post
+ *  and a semaphore pend for code that wants the old blocking behaviour,
+ *  and waits for a free entry when the queue is full.
+ *
+ *  Every LSM9DS1 access goes through I2C_transfer() in i2cQueueStartNext(),
+ *  so that call is the one place a bus model is attached. tools/host runs
+ *  this file against a simulated 400 kHz bus, see i2c_queue_bench.c there.
+ *  The queue also accounts bytes and bus time, for comparing read schedules.
+ */
+
+#ifndef TASKS_IMU_I2C_QUEUE_H_
+#define TASKS_IMU_I2C_QUEUE_H_
+
+#include <string.h>
+#include <ti/drivers/I2C.h>
+#include <ti/sysbios/BIOS.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include <ti/sysbios/knl/Semaphore.h>
+#include <xdc/runtime/Timestamp.h>
+
+#include "Board.h"
+
+/* Number of outstanding transactions (power of two) */
+#define I2C_QUEUE_SIZE		8
+/* Largest write phase (subaddress + data) copied into an entry */
+#define I2C_QUEUE_TX_MAX	8
+
+typedef void (*I2CQueue_DoneFxn)(bool status, UArg arg);
+
+typedef struct I2CQueue_Entry
+{
+	I2C_Transaction transaction;
+	uint8_t txBuffer[I2C_QUEUE_TX_MAX];
+	I2CQueue_DoneFxn doneFxn;
+	UArg arg;
+} I2CQueue_Entry;
+
+/* Used by i2cQueueTransfer to hand the result back to the waiting task */
+typedef struct I2CQueue_Sync
+{
+	Semaphore_Handle done;
+	bool status;
+} I2CQueue_Sync;
+
+I2C_Handle      i2c;
+I2C_Params      i2cParams;
+
+static I2CQueue_Entry i2cQueue[I2C_QUEUE_SIZE];
+static volatile uint8_t i2cQueueHead;	// Entry on the bus (or next to start)
+static volatile uint8_t i2cQueueTail;	// Next free entry
+static volatile bool i2cQueueBusy;
+
+/* Posted each time an entry retires, for tasks waiting on a full queue */
+static Semaphore_Struct i2cQueueSpaceStruct;
+static Semaphore_Handle i2cQueueSpace;
+
+/* Statistics */
+uint32_t i2cQueueCompleted;
+uint32_t i2cQueueFailed;
+uint32_t i2cQueueOverflows;
+uint8_t i2cQueueMaxDepth;
+
+/* Bus utilisation, i2cQueueStatsReset() starts a measurement window */
+uint32_t i2cQueueBytes;			// Payload bytes moved, both directions
+uint32_t i2cQueueBusyTime;		// Timestamp counts with a transfer in flight
+uint32_t i2cQueueStatsStart;	// Timestamp at the start of the window
+static uint32_t i2cQueueTransferStart;
+
+/* Utilisation in the current window, parts per 1024 */
+uint16_t i2cQueueLoad(void)
+{
+	uint32_t window = Timestamp_get32() - i2cQueueStatsStart;
+	if (window == 0) return 0;
+	return (uint16_t)(((uint64_t)i2cQueueBusyTime << 10) / window);
+}
+
+void i2cQueueStatsReset(void)
+{
+	UInt key = Hwi_disable();
+	i2cQueueBytes = 0;
+	i2cQueueBusyTime = 0;
+	i2cQueueStatsStart = Timestamp_get32();
+	Hwi_restore(key);
+}
+
+/* Start queued entries until one is accepted by the driver */
+static void i2cQueueStartNext(void)
+{
+	while (i2cQueueHead != i2cQueueTail)
+	{
+		I2CQueue_Entry *entry = &i2cQueue[i2cQueueHead & (I2C_QUEUE_SIZE - 1)];
+
+		i2cQueueBusy = true;
+		i2cQueueTransferStart = Timestamp_get32();
+		if (I2C_transfer(i2c, &entry->transaction))
+			return;
+
+		/* Rejected outright, so no callback will come for it */
+		i2cQueueHead++;
+		i2cQueueFailed++;
+		Semaphore_post(i2cQueueSpace);
+		if (entry->doneFxn) entry->doneFxn(false, entry->arg);
+	}
+	i2cQueueBusy = false;
+}
+
+/* Driver completion callback (Swi context) */
+void i2cQueueCallback(I2C_Handle handle, I2C_Transaction *transaction, bool transferStatus)
+{
+	UInt key = Hwi_disable();
+	I2CQueue_Entry *entry = &i2cQueue[i2cQueueHead & (I2C_QUEUE_SIZE - 1)];
+	I2CQueue_DoneFxn doneFxn = entry->doneFxn;
+	UArg arg = entry->arg;
+
+	i2cQueueHead++;
+	if (transferStatus) i2cQueueCompleted++;
+	else i2cQueueFailed++;
+	i2cQueueBusyTime += Timestamp_get32() - i2cQueueTransferStart;
+	i2cQueueBytes += transaction->writeCount + transaction->readCount;
+
+	/* Get the next transaction on the bus before running the callback */
+	i2cQueueStartNext();
+	Hwi_restore(key);
+	Semaphore_post(i2cQueueSpace);
+
+	if (doneFxn) doneFxn(transferStatus, arg);
+}
+
+/* Open the bus in callback mode, spins on failure like the other setups */
+void i2cQueueOpen(void)
+{
+	Semaphore_Params semparams;
+
+	Semaphore_Params_init(&semparams);
+	semparams.mode = Semaphore_Mode_BINARY;
+	Semaphore_construct(&i2cQueueSpaceStruct, 0, &semparams);
+	i2cQueueSpace = Semaphore_handle(&i2cQueueSpaceStruct);
+
+	I2C_Params_init(&i2cParams);
+	i2cParams.bitRate = I2C_400kHz;
+	i2cParams.transferMode = I2C_MODE_CALLBACK;
+	i2cParams.transferCallbackFxn = i2cQueueCallback;
+	i2c = I2C_open(Board_I2C0, &i2cParams);
+	if (i2c == NULL) {
+		while (1);
+	}
+	i2cQueueHead = 0;
+	i2cQueueTail = 0;
+	i2cQueueBusy = false;
+	i2cQueueStatsReset();
+}
+
+/*
+ * Queue a write-then-read transaction. The write bytes are copied, the
+ * read buffer must stay valid until doneFxn runs. Safe from Hwi, Swi and
+ * Task context. Returns false if the queue is full.
+ */
+bool i2cQueuePost(uint8_t address, const uint8_t *tx, size_t txCount,
+		uint8_t *rx, size_t rxCount, I2CQueue_DoneFxn doneFxn, UArg arg)
+{
+	UInt key;
+	uint8_t depth;
+	I2CQueue_Entry *entry;
+
+	if (txCount > I2C_QUEUE_TX_MAX)
+		return false;
+
+	key = Hwi_disable();
+	depth = (uint8_t)(i2cQueueTail - i2cQueueHead);
+	if (depth >= I2C_QUEUE_SIZE)
+	{
+		i2cQueueOverflows++;
+		Hwi_restore(key);
+		return false;
+	}
+
+	entry = &i2cQueue[i2cQueueTail & (I2C_QUEUE_SIZE - 1)];
+	memcpy(entry->txBuffer, tx, txCount);
+	entry->transaction.slaveAddress = address;
+	entry->transaction.writeBuf = entry->txBuffer;
+	entry->transaction.writeCount = txCount;
+	entry->transaction.readBuf = rx;
+	entry->transaction.readCount = rxCount;
+	entry->doneFxn = doneFxn;
+	entry->arg = arg;
+	i2cQueueTail++;
+
+	if (depth + 1 > i2cQueueMaxDepth) i2cQueueMaxDepth = depth + 1;
+	if (!i2cQueueBusy) i2cQueueStartNext();
+	Hwi_restore(key);
+
+	return true;
+}
+
+static void i2cQueueSyncDone(bool status, UArg arg)
+{
+	I2CQueue_Sync *sync = (I2CQueue_Sync *)arg;
+	sync->status = status;
+	Semaphore_post(sync->done);
+}
+
+/*
+ * Blocking transfer through the queue, Task context only. Waits for a free
+ * entry rather than failing when the queue is full, so it only returns
+ * false if the bus itself failed (or the write phase is too long).
+ */
+bool i2cQueueTransfer(uint8_t address, const uint8_t *tx, size_t txCount,
+		uint8_t *rx, size_t rxCount)
+{
+	Semaphore_Struct doneSemaphore;
+	Semaphore_Params semparams;
+	I2CQueue_Sync sync;
+
+	Semaphore_Params_init(&semparams);
+	semparams.mode = Semaphore_Mode_BINARY;
+	Semaphore_construct(&doneSemaphore, 0, &semparams);
+	sync.done = Semaphore_handle(&doneSemaphore);
+	sync.status = false;
+
+	while (txCount <= I2C_QUEUE_TX_MAX)
+	{
+		if (i2cQueuePost(address, tx, txCount, rx, rxCount,
+				i2cQueueSyncDone, (UArg)&sync))
+		{
+			Semaphore_pend(sync.done, BIOS_WAIT_FOREVER);
+			break;
+		}
+		/* Full: every retiring entry posts i2cQueueSpace */
+		Semaphore_pend(i2cQueueSpace, BIOS_WAIT_FOREVER);
+	}
+
+	Semaphore_destruct(&doneSemaphore);
+	return sync.status;
+}
+
+#endif /* TASKS_IMU_I2C_QUEUE_H_ */
@@ -0,0 +1,226 @@
+/*
+ * IMU_Bias.h
+ *
+ *  Background gyro/accel bias estimator.
+ *
+ *  Runs on each sensor's own ring one frame at a time, ahead of the vote
+ *  (IMU_Vote.h), since redundant parts have independent zero-rate offsets
+ *  and must agree once corrected. The gyro mean and variance
+ *  are tracked per axis; once the variance stays low for IMU_BIAS_SETTLE
+ *  frames the board is taken as stationary. The mean is only checked
+ *  against the zero-rate offset the part can have (IMU_BIAS_OFFSET_MAX),
+ *  since nothing calibrates at boot and the first residual is the whole
+ *  offset. The first stationary interval loads the mean into the bias in
+ *  one step; after that the mean must stay within IMU_BIAS_RATE_THS, and
+ *  gBiasRaw and aBiasRaw are pulled toward the residual with an
+ *  exponentially weighted fixed-point average. The read path subtracts
+ *  them (_autoCalc) from every following sample, so the estimate follows
+ *  slow drift such as temperature without a blocking calibration at boot.
+ *
+ *  A steady turn is as quiet as a bias. Before the first load anything
+ *  within the offset limit is taken as bias; after it only a slow turn
+ *  below IMU_BIAS_RATE_THS is.
+ *
+ *  Only the accel component along gravity is observable on the ground.
+ *  Set imuBiasGravity to 0 in free fall, where the whole accel reading
+ *  is bias.
+ */
+
+#ifndef TASKS_IMU_IMU_BIAS_H_
+#define TASKS_IMU_IMU_BIAS_H_
+
+#include "LSM9DS1.h"
+#include "IMU_Ring.h"
+#include "Fixed_Math.h"
+
+/* Variance tracker time constant, 2^4 = 16 frames */
+#define IMU_BIAS_VAR_SHIFT		4
+/* Bias update time constant, 2^8 = 256 stationary frames */
+#define IMU_BIAS_SHIFT			8
+/* Stationary when every gyro axis variance is below this (raw LSB^2) */
+#define IMU_BIAS_VAR_THS		400
+/* ... and every mean residual rate is below this once the bias is loaded
+ * (raw LSB, ~2 dps at 245 dps) */
+#define IMU_BIAS_RATE_THS		229
+/* ... or below the zero-rate offset limit before it is (30 dps at 245 dps) */
+#define IMU_BIAS_OFFSET_MAX		3429
+/* Deviations from the mean are clamped to this so the square fits in 32 bits */
+#define IMU_BIAS_DEV_MAX		32767
+/* Consecutive quiet frames before bias updates start */
+#define IMU_BIAS_SETTLE			32
+/* Accel updates only when |a| is within 1/8 of the expected gravity */
+#define IMU_BIAS_GRAVITY_TOL_SHIFT	3
+
+typedef struct IMU_BiasState
+{
+	int32_t gMeanQ8[3];		// Running gyro mean, raw << 8
+	int32_t gVar[3];		// Running gyro variance, raw^2
+	int32_t gBiasQ8[3];		// Bias estimates, raw << 8
+	int32_t aBiasQ8[3];
+	uint16_t quietFrames;
+	bool stationary;
+	bool loaded;			// Gyro bias loaded from a stationary mean
+	uint32_t updates;		// Frames used for a bias update
+	IMU_RingReader reader;
+} IMU_BiasState;
+
+IMU_BiasState imuBias[LSM9DS1_DEVICE_COUNT];
+
+/* Expected |accel| in raw counts while stationary, 0 in free fall */
+int32_t imuBiasGravity;
+
+/* True if a bias-corrected accel reading looks like gravity alone */
+bool imuAccelIsGravity(const int16_t a[3])
+{
+	const int32_t tol = imuBiasGravity >> IMU_BIAS_GRAVITY_TOL_SHIFT;
+	int32_t err;
+
+	if (imuBiasGravity == 0)
+		return false;
+	err = (int32_t)isqrt32((uint32_t)(a[0]*a[0]) + (uint32_t)(a[1]*a[1]) +
+			(uint32_t)(a[2]*a[2])) - imuBiasGravity;
+	return (err <= tol) && (err >= -tol);
+}
+
+/*
+ * Start the estimators from the current gBiasRaw/aBiasRaw and turn on the
+ * correction in the read path. Call after LSM9DS1begin().
+ */
+void imuBiasInit(void)
+{
+	int i, d;
+
+	for (d = 0; d < LSM9DS1_DEVICE_COUNT; d++)
+	{
+		IMU_BiasState *bias = &imuBias[d];
+
+		for (i = 0; i < 3; i++)
+		{
+			bias->gMeanQ8[i] = 0;
+			bias->gVar[i] = 0;
+			bias->gBiasQ8[i] = (int32_t)imuDevices[d].gBiasRaw[i] << 8;
+			bias->aBiasQ8[i] = (int32_t)imuDevices[d].aBiasRaw[i] << 8;
+		}
+		bias->quietFrames = 0;
+		bias->stationary = false;
+		bias->loaded = false;
+		bias->updates = 0;
+		imuRingReaderInit(imuDevices[d].ring, &bias->reader);
+		imuDevices[d].autoCalc = true;
+	}
+
+	// One g in raw counts at the current accel scale
+	imuBiasGravity = (imuDevices[0].aResQ32 != 0) ?
+			(int32_t)((((int64_t)1) << 32) / imuDevices[0].aResQ32) : 0;
+}
+
+/* Feed one bias-corrected frame from dev */
+void imuBiasUpdate(IMU_BiasState *bias, LSM9DS1_Device *dev, const IMU_Frame *frame)
+{
+	const int32_t meanLimit = bias->loaded ? IMU_BIAS_RATE_THS : IMU_BIAS_OFFSET_MAX;
+	bool quiet = true;
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		int32_t g = frame->xg[i];
+		int32_t mean, delta;
+
+		bias->gMeanQ8[i] += ((g << 8) - bias->gMeanQ8[i]) >> IMU_BIAS_VAR_SHIFT;
+		mean = bias->gMeanQ8[i] >> 8;
+		delta = g - mean;
+		if (delta > IMU_BIAS_DEV_MAX)
+			delta = IMU_BIAS_DEV_MAX;
+		else if (delta < -IMU_BIAS_DEV_MAX)
+			delta = -IMU_BIAS_DEV_MAX;
+		bias->gVar[i] += (delta * delta - bias->gVar[i]) >> IMU_BIAS_VAR_SHIFT;
+
+		if ((bias->gVar[i] > IMU_BIAS_VAR_THS) ||
+			(mean > meanLimit) || (mean < -meanLimit))
+			quiet = false;
+	}
+
+	if (!quiet)
+	{
+		bias->quietFrames = 0;
+		bias->stationary = false;
+		return;
+	}
+	if (bias->quietFrames < IMU_BIAS_SETTLE)
+	{
+		bias->quietFrames++;
+		return;
+	}
+	bias->stationary = true;
+	bias->updates++;
+
+	/* Gyro: the corrected rate should be zero. The first time, take the
+	 * whole mean; the residual stream shifts by it, so the mean does too,
+	 * and frames already read with the old bias must settle out again. */
+	for (i = 0; i < 3; i++)
+	{
+		if (!bias->loaded)
+		{
+			bias->gBiasQ8[i] += bias->gMeanQ8[i];
+			bias->gMeanQ8[i] = 0;
+		}
+		else
+		{
+			bias->gBiasQ8[i] += ((int32_t)frame->xg[i] << 8) >> IMU_BIAS_SHIFT;
+		}
+		dev->gBiasRaw[i] = (bias->gBiasQ8[i] + 128) >> 8;
+	}
+	if (!bias->loaded)
+		bias->quietFrames = 0;
+	bias->loaded = true;
+
+	/* Accel: the corrected vector should have magnitude imuBiasGravity */
+	{
+		int32_t a[3];
+		int32_t norm, scaleQ15;
+
+		a[0] = frame->xg[3];
+		a[1] = frame->xg[4];
+		a[2] = frame->xg[5];
+		norm = (int32_t)isqrt32((uint32_t)(a[0]*a[0]) + (uint32_t)(a[1]*a[1]) +
+				(uint32_t)(a[2]*a[2]));
+
+		if (imuBiasGravity == 0)
+		{
+			scaleQ15 = 1 << 15;
+		}
+		else
+		{
+			int32_t err = norm - imuBiasGravity;
+			if ((norm == 0) || (err > (imuBiasGravity >> IMU_BIAS_GRAVITY_TOL_SHIFT)) ||
+				(err < -(imuBiasGravity >> IMU_BIAS_GRAVITY_TOL_SHIFT)))
+				return;
+			scaleQ15 = (err << 15) / norm;
+		}
+
+		for (i = 0; i < 3; i++)
+		{
+			int32_t residual = (a[i] * scaleQ15) >> 15;
+			bias->aBiasQ8[i] += (residual << 8) >> IMU_BIAS_SHIFT;
+			dev->aBiasRaw[i] = (bias->aBiasQ8[i] + 128) >> 8;
+		}
+	}
+}
+
+/* Consume every frame each sensor published since the last call */
+void imuBiasRun(void)
+{
+	IMU_Frame frame;
+	int d;
+
+	for (d = 0; d < LSM9DS1_DEVICE_COUNT; d++)
+	{
+		while (imuRingRead(imuDevices[d].ring, &imuBias[d].reader, &frame))
+		{
+			if (imuDevices[d].present)
+				imuBiasUpdate(&imuBias[d], &imuDevices[d], &frame);
+		}
+	}
+}
+
+#endif /* TASKS_IMU_IMU_BIAS_H_ */
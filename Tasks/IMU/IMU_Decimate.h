@@ -0,0 +1,158 @@
+/*
+ * IMU_Decimate.h
+ *
+ *  Integer CIC decimator between the sensor and the low-rate consumers.
+ *
+ *  The gyro/accel frames in imuRing go through an IMU_DECIM_ORDER stage
+ *  CIC filter that keeps one frame in 2^IMU_DECIM_LOG2_RATIO. The result
+ *  lands in imuDecimRing. The sensor can then run at a high ODR while the
+ *  low-rate consumers see band-limited data, instead of single samples
+ *  that alias any vibration. LOG_ACCEL is the consumer today; the filters
+ *  integrate the gyro and need every frame, so they read imuRing. The CIC gain is a power of
+ *  two, so the output is rescaled to raw LSB by a shift. Integrators and
+ *  combs wrap modulo 2^32, which is exact as long as
+ *  16 + ORDER * LOG2_RATIO <= 32.
+ *
+ *  The cost is measured with the DWT cycle counter. imuDecim.cycles holds
+ *  the running average cycles per input frame (Q4).
+ */
+
+#ifndef TASKS_IMU_IMU_DECIMATE_H_
+#define TASKS_IMU_IMU_DECIMATE_H_
+
+#include "../../Peripherals/Cycle_Counter.h"
+#include "LSM9DS1.h"
+#include "IMU_Ring.h"
+
+/* Decimation ratio 2^3 = 8, e.g. 119 Hz in, 14.9 Hz out */
+#define IMU_DECIM_LOG2_RATIO	3
+#define IMU_DECIM_ORDER			3
+
+#define IMU_DECIM_RATIO			(1 << IMU_DECIM_LOG2_RATIO)
+#define IMU_DECIM_SHIFT			(IMU_DECIM_ORDER * IMU_DECIM_LOG2_RATIO)
+/* Group delay of the CIC, in input frames, x2 to stay integral */
+#define IMU_DECIM_DELAY_X2		(IMU_DECIM_ORDER * (IMU_DECIM_RATIO - 1))
+
+#if (16 + IMU_DECIM_SHIFT) > 32
+#error "IMU_DECIM_ORDER * IMU_DECIM_LOG2_RATIO must not exceed 16"
+#endif
+
+typedef struct IMU_Decimator
+{
+	uint32_t integ[IMU_DECIM_ORDER][6];
+	uint32_t comb[IMU_DECIM_ORDER][6];		// Previous comb inputs
+	uint8_t phase;							// Input frames into this output
+	IMU_RingReader reader;
+
+	/* Benchmark */
+	uint32_t cycles;		// Average cycles per input frame, Q4
+	uint32_t cyclesMax;		// Worst single input frame
+	uint32_t outputs;
+} IMU_Decimator;
+
+/* Decimated gyro/accel frames, mag is the latest at publication */
+IMU_Ring imuDecimRing;
+IMU_Decimator imuDecim;
+
+void imuDecimateInit(void)
+{
+	int i, j;
+
+	for (i = 0; i < IMU_DECIM_ORDER; i++)
+	{
+		for (j = 0; j < 6; j++)
+		{
+			imuDecim.integ[i][j] = 0;
+			imuDecim.comb[i][j] = 0;
+		}
+	}
+	imuDecim.phase = 0;
+	imuDecim.cycles = 0;
+	imuDecim.cyclesMax = 0;
+	imuDecim.outputs = 0;
+	imuRingInit(&imuDecimRing);
+	imuRingReaderInit(&imuRing, &imuDecim.reader);
+	cycleCounterInit();
+}
+
+/* Integrate one frame, true once IMU_DECIM_RATIO of them are in */
+static bool imuDecimateIntegrate(const int16_t xg[6])
+{
+	int i, j;
+
+	for (j = 0; j < 6; j++)
+	{
+		uint32_t acc = (uint32_t)(int32_t)xg[j];
+		for (i = 0; i < IMU_DECIM_ORDER; i++)
+		{
+			imuDecim.integ[i][j] += acc;
+			acc = imuDecim.integ[i][j];
+		}
+	}
+	if (++imuDecim.phase < IMU_DECIM_RATIO)
+		return false;
+	imuDecim.phase = 0;
+	return true;
+}
+
+/* Run the combs on the last integrator and write the rescaled output */
+static void imuDecimateComb(int16_t out[6])
+{
+	int i, j;
+
+	for (j = 0; j < 6; j++)
+	{
+		uint32_t acc = imuDecim.integ[IMU_DECIM_ORDER - 1][j];
+		int32_t y;
+		for (i = 0; i < IMU_DECIM_ORDER; i++)
+		{
+			uint32_t prev = imuDecim.comb[i][j];
+			imuDecim.comb[i][j] = acc;
+			acc -= prev;
+		}
+		y = ((int32_t)acc + (1 << (IMU_DECIM_SHIFT - 1))) >> IMU_DECIM_SHIFT;
+		if (y > 32767) y = 32767;
+		if (y < -32768) y = -32768;
+		out[j] = (int16_t)y;
+	}
+}
+
+/*
+ * Filter the frames published since the last call. Run from the task that
+ * consumes the sensor data, after the producers. Returns the number of
+ * frames published to imuDecimRing.
+ */
+uint8_t imuDecimateRun(void)
+{
+	IMU_Frame frame;
+	uint8_t published = 0;
+
+	while (1)
+	{
+		uint32_t start = cycleCount();
+		uint32_t spent;
+
+		if (!imuRingRead(&imuRing, &imuDecim.reader, &frame))
+			break;
+		if (imuDecimateIntegrate(frame.xg))
+		{
+			uint8_t frames = 1;
+			int16_t (*slot)[6] = imuRingReserve(&imuDecimRing, &frames);
+			/* Stamp the output at the centre of the filter's response */
+			uint32_t stamp = frame.stamp -
+				((IMU_DECIM_DELAY_X2 * gyroPeriodTicks()) >> 1);
+
+			imuDecimateComb(slot[0]);
+			imuRingCommit(&imuDecimRing, 1, stamp, 0, frame.mag);
+			imuDecim.outputs++;
+			published++;
+		}
+
+		spent = cycleCount() - start;
+		if (spent > imuDecim.cyclesMax) imuDecim.cyclesMax = spent;
+		imuDecim.cycles += (int32_t)((spent << 4) - imuDecim.cycles) >> 4;
+	}
+	return published;
+}
+
+#endif /* TASKS_IMU_IMU_DECIMATE_H_ */
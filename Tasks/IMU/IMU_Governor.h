@@ -0,0 +1,291 @@
+/*
+ * IMU_Governor.h
+ *
+ *  Activity-driven output data rate governor.
+ *
+ *  Watches the peak angular rate and the accel variance of the frames in
+ *  the IMU ring and moves the sensors between three rate profiles. Any
+ *  sign of more activity moves up at once. Moving down needs the lower
+ *  thresholds to hold for IMU_GOV_DWELL_US, so the rate does not flap at
+ *  a boundary. It starts in the low profile and only leaves it on activity.
+ *
+ *  Time spent in each profile and the transition counts are kept for
+ *  telemetry. Every IMU_GOV_REPORT_PERIOD a Clock function logs one
+ *  LOG_GOVERNOR record per profile: its share of the window and how often
+ *  it has been entered since boot. Time with the sensors asleep is in no
+ *  profile, so the shares add up to less than 1000 then.
+ */
+
+#ifndef TASKS_IMU_IMU_GOVERNOR_H_
+#define TASKS_IMU_IMU_GOVERNOR_H_
+
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include "../Log.h"
+#include "LSM9DS1.h"
+#include "IMU_Ring.h"
+
+typedef enum
+{
+	IMU_PROFILE_LOW = 0,		// Quiescent, lowest power
+	IMU_PROFILE_NOMINAL = 1,
+	IMU_PROFILE_HIGH = 2,		// Tumbling/detumbling
+	IMU_PROFILE_COUNT = 3
+} imuProfile_type;
+
+typedef struct
+{
+	uint8_t gyroODR;		// setGyroODR() value, accel follows the gyro
+	uint8_t accelODR;		// setAccelODR() value, used when the gyro sleeps
+	uint8_t magODR;			// setMagODR() value
+} imuProfile;
+
+static const imuProfile imuProfiles[IMU_PROFILE_COUNT] = {
+	{1, 1, 3},		// 14.9 Hz, 10 Hz, 5 Hz
+	{2, 2, 5},		// 59.5 Hz, 50 Hz, 20 Hz
+	{3, 3, 7}		// 119 Hz, 119 Hz, 80 Hz
+};
+
+/* Peak rate thresholds, raw gyro LSB at 245 dps: into/out of nominal at
+ * 2/1 dps, into/out of high at 30/10 dps */
+#define IMU_GOV_RATE_NOM_UP		229
+#define IMU_GOV_RATE_NOM_DOWN	114
+#define IMU_GOV_RATE_HIGH_UP	3429
+#define IMU_GOV_RATE_HIGH_DOWN	1143
+/* Accel variance (sum over axes) that leaves the low profile, raw LSB^2 */
+#define IMU_GOV_VAR_NOM_UP		40000
+#define IMU_GOV_VAR_NOM_DOWN	10000
+/* Variance tracker time constant, 2^3 = 8 frames */
+#define IMU_GOV_VAR_SHIFT		3
+/* Quiet time needed before stepping down a profile */
+#define IMU_GOV_DWELL_US		5000000
+/* Telemetry report period, Clock ticks */
+#define IMU_GOV_REPORT_PERIOD	(10000000 / Clock_tickPeriod)
+
+typedef struct IMU_Governor
+{
+	imuProfile_type profile;
+	int32_t aMeanQ8[3];
+	int32_t aVar;				// Summed accel variance, raw^2
+	int32_t peakRate;			// Largest |g| seen since the last evaluation
+	uint32_t quietSince;		// Tick the down-thresholds started holding
+	bool quiet;
+	bool suspended;				// Sensors asleep, time is in no profile
+	uint32_t lastTick;
+	IMU_RingReader reader;
+
+	/* Telemetry */
+	uint32_t ticksIn[IMU_PROFILE_COUNT];		// This report window
+	uint32_t transitions[IMU_PROFILE_COUNT][IMU_PROFILE_COUNT];	// [from][to], since boot
+	uint32_t windowStart;
+} IMU_Governor;
+
+IMU_Governor imuGovernor;
+
+static Clock_Struct imuGovernorClock;
+
+/* Every sensor runs the same profile, so redundant frames stay paired */
+static void imuGovernorApply(imuProfile_type profile)
+{
+	uint8_t i;
+
+	for (i = 0; i < LSM9DS1_DEVICE_COUNT; i++)
+	{
+		if (!imuDevices[i].present) continue;
+		LSM9DS1select(&imuDevices[i]);
+		setGyroODR(imuProfiles[profile].gyroODR);
+		setAccelODR(imuProfiles[profile].accelODR);
+		setMagODR(imuProfiles[profile].magODR);
+	}
+	LSM9DS1select(&imuDevices[0]);
+}
+
+/* Charge the time since lastTick to the current profile. Hwi disabled. */
+static void imuGovernorCharge(uint32_t now)
+{
+	if (!imuGovernor.suspended)
+		imuGovernor.ticksIn[imuGovernor.profile] += now - imuGovernor.lastTick;
+	imuGovernor.lastTick = now;
+}
+
+/* Log the window just ended and start a new one. Clock (Swi) context. */
+static Void imuGovernorReport(UArg arg)
+{
+	uint32_t ticks[IMU_PROFILE_COUNT], entered[IMU_PROFILE_COUNT];
+	uint32_t now, window;
+	int i, j;
+	UInt key;
+
+	key = Hwi_disable();
+	now = Clock_getTicks();
+	imuGovernorCharge(now);
+	window = now - imuGovernor.windowStart;
+	imuGovernor.windowStart = now;
+	for (i = 0; i < IMU_PROFILE_COUNT; i++)
+	{
+		ticks[i] = imuGovernor.ticksIn[i];
+		imuGovernor.ticksIn[i] = 0;
+		entered[i] = 0;
+		for (j = 0; j < IMU_PROFILE_COUNT; j++)
+			entered[i] += imuGovernor.transitions[j][i];
+	}
+	Hwi_restore(key);
+	if (window == 0)
+		return;
+
+	for (i = 0; i < IMU_PROFILE_COUNT; i++)
+		LOG3(LOG_GOVERNOR, i, (uint32_t)(((uint64_t)ticks[i] * 1000) / window), entered[i]);
+}
+
+/*
+ * Start in the low profile and start the periodic report. Call after
+ * LSM9DS1begin(). The first active frames move up within one pass.
+ */
+void imuGovernorInit(void)
+{
+	Clock_Params clkParams;
+	int i, j;
+
+	for (i = 0; i < 3; i++) imuGovernor.aMeanQ8[i] = 0;
+	imuGovernor.aVar = 0;
+	imuGovernor.peakRate = 0;
+	imuGovernor.quiet = false;
+	imuGovernor.suspended = false;
+	imuGovernor.lastTick = Clock_getTicks();
+	imuGovernor.windowStart = imuGovernor.lastTick;
+	for (i = 0; i < IMU_PROFILE_COUNT; i++)
+	{
+		imuGovernor.ticksIn[i] = 0;
+		for (j = 0; j < IMU_PROFILE_COUNT; j++)
+			imuGovernor.transitions[i][j] = 0;
+	}
+	imuRingReaderInit(&imuRing, &imuGovernor.reader);
+
+	imuGovernor.profile = IMU_PROFILE_LOW;
+	imuGovernorApply(imuGovernor.profile);
+
+	Clock_Params_init(&clkParams);
+	clkParams.period = IMU_GOV_REPORT_PERIOD;
+	clkParams.startFlag = TRUE;
+	Clock_construct(&imuGovernorClock, (Clock_FuncPtr)imuGovernorReport,
+					IMU_GOV_REPORT_PERIOD, &clkParams);
+}
+
+/* The sensors are going to sleep: stop charging time to the profile */
+void imuGovernorSuspend(void)
+{
+	UInt key = Hwi_disable();
+
+	imuGovernorCharge(Clock_getTicks());
+	imuGovernor.suspended = true;
+	Hwi_restore(key);
+}
+
+/* Reapply the current profile after the sensors were put to sleep, without
+ * counting the time asleep against it */
+void imuGovernorResume(void)
+{
+	UInt key = Hwi_disable();
+
+	imuGovernor.lastTick = Clock_getTicks();
+	imuGovernor.suspended = false;
+	Hwi_restore(key);
+	imuGovernor.quiet = false;
+	imuGovernor.peakRate = 0;
+	imuGovernorApply(imuGovernor.profile);
+}
+
+/*
+ * Fold in the frames published since the last call and change profile if
+ * needed. Task context only: a change is three register writes.
+ */
+void imuGovernorRun(void)
+{
+	IMU_Frame frame;
+	imuProfile_type target;
+	uint32_t now;
+	bool up, down;
+	UInt key;
+	int i;
+
+	while (imuRingRead(&imuRing, &imuGovernor.reader, &frame))
+	{
+		int32_t var = 0;
+		for (i = 0; i < 3; i++)
+		{
+			int32_t g = frame.xg[i];
+			int32_t a = frame.xg[3 + i];
+			int32_t d;
+
+			if (g < 0) g = -g;
+			if (g > imuGovernor.peakRate) imuGovernor.peakRate = g;
+
+			imuGovernor.aMeanQ8[i] += ((a << 8) - imuGovernor.aMeanQ8[i]) >> IMU_GOV_VAR_SHIFT;
+			d = a - (imuGovernor.aMeanQ8[i] >> 8);
+			var += d * d;
+		}
+		imuGovernor.aVar += (var - imuGovernor.aVar) >> IMU_GOV_VAR_SHIFT;
+	}
+
+	key = Hwi_disable();
+	now = Clock_getTicks();
+	imuGovernorCharge(now);
+	Hwi_restore(key);
+
+	/* Where the current activity belongs, and whether it is below the
+	 * hysteresis band of the current profile */
+	switch (imuGovernor.profile)
+	{
+	case IMU_PROFILE_LOW:
+		up = (imuGovernor.peakRate > IMU_GOV_RATE_NOM_UP) ||
+			(imuGovernor.aVar > IMU_GOV_VAR_NOM_UP);
+		down = false;
+		break;
+	case IMU_PROFILE_NOMINAL:
+		up = (imuGovernor.peakRate > IMU_GOV_RATE_HIGH_UP);
+		down = (imuGovernor.peakRate < IMU_GOV_RATE_NOM_DOWN) &&
+			(imuGovernor.aVar < IMU_GOV_VAR_NOM_DOWN);
+		break;
+	default:
+		up = false;
+		down = (imuGovernor.peakRate < IMU_GOV_RATE_HIGH_DOWN);
+		break;
+	}
+	if (up && (imuGovernor.peakRate > IMU_GOV_RATE_HIGH_UP))
+		target = IMU_PROFILE_HIGH;
+	else if (up)
+		target = (imuProfile_type)(imuGovernor.profile + 1);
+	else
+		target = imuGovernor.profile;
+	imuGovernor.peakRate = 0;
+
+	if (down && (target == imuGovernor.profile))
+	{
+		if (!imuGovernor.quiet)
+		{
+			imuGovernor.quiet = true;
+			imuGovernor.quietSince = now;
+		}
+		else if ((now - imuGovernor.quietSince) >= IMU_GOV_DWELL_US / Clock_tickPeriod)
+		{
+			target = (imuProfile_type)(imuGovernor.profile - 1);
+		}
+	}
+	else
+	{
+		imuGovernor.quiet = false;
+	}
+
+	if (target != imuGovernor.profile)
+	{
+		key = Hwi_disable();
+		imuGovernorCharge(Clock_getTicks());
+		imuGovernor.transitions[imuGovernor.profile][target]++;
+		imuGovernor.profile = target;
+		Hwi_restore(key);
+		imuGovernor.quiet = false;
+		imuGovernorApply(target);
+	}
+}
+
+#endif /* TASKS_IMU_IMU_GOVERNOR_H_ */
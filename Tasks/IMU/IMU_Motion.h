@@ -0,0 +1,140 @@
+/*
+ * IMU_Motion.h
+ *
+ *  Motion gating for the gyro/accel.
+ *
+ *  The LSM9DS1 inactivity detector watches the accel. Once it reports
+ *  inactivity the data-ready interrupt is unrouted, the gyro is put to
+ *  sleep and the accel and mag drop to their slowest rates, so neither the
+ *  CPU nor the I2C bus is woken per sample. The accel interrupt generator,
+ *  running on high-pass filtered data, is routed to XG INT1 (wired to
+ *  IOID_1). A threshold crossing there wakes everything up again.
+ *
+ *  With two sensors, the primary decides and a redundant one simply
+ *  follows it to sleep and back.
+ */
+
+#ifndef TASKS_IMU_IMU_MOTION_H_
+#define TASKS_IMU_IMU_MOTION_H_
+
+#include <ti/sysbios/knl/Clock.h>
+#include "LSM9DS1.h"
+#include "IMU_Governor.h"
+
+/* ACT_THS threshold and ACT_DUR duration of the inactivity detector */
+#define IMU_MOTION_INACT_THS	0x08
+#define IMU_MOTION_INACT_DUR	0x40
+/* Wake threshold on the high-passed accel, INT_GEN_THS_*_XL units */
+#define IMU_MOTION_WAKE_THS		0x04
+/* STATUS_REG_0 is polled once every this many gyro/accel wakeups */
+#define IMU_MOTION_CHECK_FRAMES	32
+
+volatile bool imuAsleep;
+volatile bool imuWakePending;		// Set by the IOID_1 callback
+
+/* Telemetry */
+uint32_t imuSleeps;
+uint32_t imuTicksAsleep;
+static uint32_t imuSleepTick;
+static uint8_t imuMotionCheck;
+
+/* Route gyro/accel data-ready (or FIFO threshold) back to XG INT2 */
+static void imuMotionRouteData(void)
+{
+#if IMU_FIFO_THRESHOLD
+	configFIFOMode(IMU_FIFO_THRESHOLD);
+#else
+	configInt(XG_INT2, INT_DRDY_XL, INT_ACTIVE_HIGH, INT_PUSH_PULL);
+#endif
+}
+
+/* Arm the inactivity detector and the wake generator. Call after
+ * LSM9DS1begin(). */
+void imuMotionInit(void)
+{
+	configInactivity(IMU_MOTION_INACT_DUR, IMU_MOTION_INACT_THS, true);
+
+	configAccelIntHPF(true);
+	configAccelThs(IMU_MOTION_WAKE_THS, X_AXIS, 0, false);
+	configAccelThs(IMU_MOTION_WAKE_THS, Y_AXIS, 0, false);
+	configAccelThs(IMU_MOTION_WAKE_THS, Z_AXIS, 0, false);
+	configAccelInt(XHIE_XL | YHIE_XL | ZHIE_XL, false);
+
+	imuAsleep = false;
+	imuWakePending = false;
+	imuSleeps = 0;
+	imuTicksAsleep = 0;
+	imuMotionCheck = 0;
+}
+
+void imuMotionSleep(void)
+{
+	uint8_t i;
+
+	configInt(XG_INT2, 0, INT_ACTIVE_HIGH, INT_PUSH_PULL);
+	imuGovernorSuspend();
+	for (i = 0; i < LSM9DS1_DEVICE_COUNT; i++)
+	{
+		if (!imuDevices[i].present) continue;
+		LSM9DS1select(&imuDevices[i]);
+		sleepGyro(true);
+		setAccelODR(XL_ODR_10);
+		setMagODR(M_ODR_0625);
+	}
+	LSM9DS1select(&imuDevices[0]);
+
+	/* Clear a latched event before arming the wake line */
+	getAccelIntSrc();
+	imuAsleep = true;
+	configInt(XG_INT1, INT_IG_XL, INT_ACTIVE_HIGH, INT_PUSH_PULL);
+
+	imuSleeps++;
+	imuSleepTick = Clock_getTicks();
+}
+
+void imuMotionWake(void)
+{
+	uint8_t i;
+
+	configInt(XG_INT1, 0, INT_ACTIVE_HIGH, INT_PUSH_PULL);
+	getAccelIntSrc();
+	imuAsleep = false;
+
+	for (i = 0; i < LSM9DS1_DEVICE_COUNT; i++)
+	{
+		if (!imuDevices[i].present) continue;
+		LSM9DS1select(&imuDevices[i]);
+		sleepGyro(false);
+	}
+	LSM9DS1select(&imuDevices[0]);
+	imuGovernorResume();
+	imuMotionRouteData();
+	imuTicksAsleep += Clock_getTicks() - imuSleepTick;
+	imuMotionCheck = 0;
+
+	/* Routing the data-ready raises INT2 at once if a sample is waiting,
+	 * so the first frame comes through pinCallback like any other. The
+	 * ring has one producer, so it is not read from here. */
+}
+
+/* IMU task hook: handle a wake request or poll for inactivity */
+void imuMotionRun(void)
+{
+	if (imuWakePending)
+	{
+		imuWakePending = false;
+		if (imuAsleep)
+			imuMotionWake();
+		return;
+	}
+	if (imuAsleep)
+		return;
+	if (++imuMotionCheck >= IMU_MOTION_CHECK_FRAMES)
+	{
+		imuMotionCheck = 0;
+		if (getInactivity())
+			imuMotionSleep();
+	}
+}
+
+#endif /* TASKS_IMU_IMU_MOTION_H_ */
@@ -0,0 +1,174 @@
+/*
+ * IMU_Ring.h
+ *
+ *  Single-producer, multi-consumer ring of timestamped IMU frames.
+ *
+ *  The producer (the gyro/accel read path) stamps every frame with a Clock
+ *  tick and a sequence number. Each consumer keeps its own IMU_RingReader
+ *  and reads at its own pace. A reader that falls more than a ring behind
+ *  is told how many frames it lost instead of silently skipping them.
+ *
+ *  Gyro/accel data is stored as a contiguous int16_t[6] per slot, so the
+ *  I2C driver can read FIFO bursts straight into the ring.
+ */
+
+#ifndef TASKS_IMU_IMU_RING_H_
+#define TASKS_IMU_IMU_RING_H_
+
+#include <xdc/std.h>
+
+/* Number of frames kept (power of two, at least one full FIFO) */
+#define IMU_RING_SIZE	64
+
+typedef struct IMU_Frame
+{
+	uint32_t seq;		// 1, 2, 3, ... in publication order
+	uint32_t stamp;		// Clock ticks at the sample instant
+	int16_t xg[6];		// gx, gy, gz, ax, ay, az (raw, bias corrected)
+	int16_t mag[3];		// Latest mx, my, mz at publication
+} IMU_Frame;
+
+typedef struct IMU_Ring
+{
+	int16_t xg[IMU_RING_SIZE][6];
+	int16_t mag[IMU_RING_SIZE][3];
+	uint32_t stamp[IMU_RING_SIZE];
+	volatile uint32_t seq[IMU_RING_SIZE];	// Frame held by each slot
+	volatile uint32_t head;					// Sequence of the next frame
+} IMU_Ring;
+
+typedef struct IMU_RingReader
+{
+	uint32_t next;		// Sequence this reader wants next
+	uint32_t dropped;	// Frames overwritten before they were read
+} IMU_RingReader;
+
+/* Ring filled by the gyro/accel read path */
+IMU_Ring imuRing;
+
+void imuRingInit(IMU_Ring *ring)
+{
+	int i;
+	for (i = 0; i < IMU_RING_SIZE; i++)
+	{
+		ring->seq[i] = 0;
+	}
+	ring->head = 1;
+}
+
+/* A new reader starts at the next frame to be published */
+void imuRingReaderInit(IMU_Ring *ring, IMU_RingReader *reader)
+{
+	reader->next = ring->head;
+	reader->dropped = 0;
+}
+
+/*
+ * Claim up to *frames slots, starting at the next sequence number, for the
+ * producer to fill in place. The count is trimmed so the slots are
+ * contiguous and at most half the ring. Returns the first slot. Claimed
+ * slots are retagged immediately, so a reader that was copying the old
+ * contents notices.
+ */
+int16_t (*imuRingReserve(IMU_Ring *ring, uint8_t *frames))[6]
+{
+	uint32_t head = ring->head;
+	uint32_t first = head & (IMU_RING_SIZE - 1);
+	uint32_t i;
+
+	/* Never retag the newest published frame */
+	if (*frames > IMU_RING_SIZE / 2)
+		*frames = IMU_RING_SIZE / 2;
+	if (*frames > IMU_RING_SIZE - first)
+		*frames = IMU_RING_SIZE - first;
+
+	for (i = 0; i < *frames; i++)
+	{
+		ring->seq[first + i] = head + i;
+	}
+	return &ring->xg[first];
+}
+
+/*
+ * Publish frames previously filled through imuRingReserve(). The first is
+ * stamped at stamp and the rest follow at period ticks.
+ */
+void imuRingCommit(IMU_Ring *ring, uint8_t frames, uint32_t stamp,
+		uint32_t period, const int16_t mag[3])
+{
+	uint32_t head = ring->head;
+	uint32_t i;
+
+	for (i = 0; i < frames; i++)
+	{
+		uint32_t slot = (head + i) & (IMU_RING_SIZE - 1);
+		ring->stamp[slot] = stamp + i * period;
+		ring->mag[slot][0] = mag[0];
+		ring->mag[slot][1] = mag[1];
+		ring->mag[slot][2] = mag[2];
+	}
+	ring->head = head + frames;
+}
+
+/* Copy the slot holding seq, false if the producer reused it meanwhile */
+static bool imuRingCopy(IMU_Ring *ring, uint32_t seq, IMU_Frame *frame)
+{
+	uint32_t slot = seq & (IMU_RING_SIZE - 1);
+	int i;
+
+	if (ring->seq[slot] != seq)
+		return false;
+	for (i = 0; i < 6; i++)
+	{
+		frame->xg[i] = ring->xg[slot][i];
+	}
+	for (i = 0; i < 3; i++)
+	{
+		frame->mag[i] = ring->mag[slot][i];
+	}
+	frame->stamp = ring->stamp[slot];
+	frame->seq = seq;
+	return (ring->seq[slot] == seq);
+}
+
+/* Read the next frame for this reader, false if none is ready */
+bool imuRingRead(IMU_Ring *ring, IMU_RingReader *reader, IMU_Frame *frame)
+{
+	while (1)
+	{
+		uint32_t head = ring->head;
+		int32_t pending = (int32_t)(head - reader->next);
+
+		if (pending <= 0)
+			return false;
+		if (pending > IMU_RING_SIZE)
+		{
+			reader->dropped += pending - IMU_RING_SIZE;
+			reader->next = head - IMU_RING_SIZE;
+		}
+		if (imuRingCopy(ring, reader->next, frame))
+		{
+			reader->next++;
+			return true;
+		}
+		/* Overwritten while we copied it */
+		reader->dropped++;
+		reader->next++;
+	}
+}
+
+/* Read the most recent frame, for consumers that only want the latest */
+bool imuRingLatest(IMU_Ring *ring, IMU_Frame *frame)
+{
+	while (1)
+	{
+		uint32_t head = ring->head;
+
+		if (head == 1)
+			return false;
+		if (imuRingCopy(ring, head - 1, frame))
+			return true;
+	}
+}
+
+#endif /* TASKS_IMU_IMU_RING_H_ */
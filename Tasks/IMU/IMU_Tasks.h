@@ -11,28 +11,171 @@
 #include <ti/sysbios/knl/Task.h>
 #include "../Semaphore_Initialization.h"
 #include "../Shared_Resources.h"
+#include "../Bus_Arbiter.h"
+#include "../Log.h"
 #include "LSM9DS1.h"
+#include "IMU_Bias.h"
+#include "IMU_Governor.h"
+#include "IMU_Motion.h"
+#include "IMU_Vote.h"
+#include "IMU_Decimate.h"
+#include "Attitude_Filter.h"
+#include "MEKF.h"
+#include "TRIAD.h"
+
+Task_Struct imuTask;
+
+/* Mag readings between ellipsoid fit solves (~25 s at 20 Hz) */
+#define MAG_CAL_SOLVE_INTERVAL	512
+/* Mag readings between die temperature samples (~1 s at 20 Hz) */
+#define TEMP_SAMPLE_INTERVAL	16
+
+/* One task services every IMU source. The deepest path is the MEKF
+ * alignment (mekfRun > questAttitude > questSolve), ~750 bytes with the
+ * task frame in a host -fcallgraph-info build; the rest is kernel calls
+ * and the soft-float library. Check LOG_TASK_STACK on the target after
+ * changing what runs here. */
+static uint8_t imuTaskStack[896];
+
+static uint16_t magCalCount;
+static uint8_t tempCount;
+/* LOG_ACCEL at most once per drain period, whatever the ODR, from the
+ * decimated stream so it does not alias vibration */
+static uint32_t accelLogTick;
+
+/* Ellipsoid solves run in the log task (logSetBackground) on a copy of one
+ * sensor's fit, so neither the bus lock nor this stack is held for them.
+ * Sensors take turns. */
+enum { MAG_SOLVE_IDLE, MAG_SOLVE_QUEUED, MAG_SOLVE_DONE };
+static MagCal magSolveFit;
+static volatile uint8_t magSolveState;
+static uint8_t magSolveDevice;
+static bool magSolveSolved;
+
+/* Log task: solve the queued fit */
+static void imuMagSolve(void)
+{
+	if (magSolveState != MAG_SOLVE_QUEUED)
+		return;
+	magSolveSolved = magCalSolve(&magSolveFit);
+	magSolveState = MAG_SOLVE_DONE;
+}
 
-Task_Struct magTask;
-Task_Struct gyroTask;
-Task_Struct accelTask;
+/* Take over a finished solve and queue the next one if due. Under the
+ * bus lock, loading the offset is a register write. */
+static void imuMagSolveStep(bool due)
+{
+	LSM9DS1_Device *dev = &imuDevices[magSolveDevice];
+
+	if (magSolveState == MAG_SOLVE_DONE) {
+		if (magSolveSolved) {
+			LSM9DS1select(dev);
+			loadMagCalibration(&magSolveFit, true);
+		} else {
+			dev->magCal.rejects++;
+		}
+		magSolveState = MAG_SOLVE_IDLE;
+		magSolveDevice = (magSolveDevice + 1) % LSM9DS1_DEVICE_COUNT;
+		dev = &imuDevices[magSolveDevice];
+	}
+	if (due && (magSolveState == MAG_SOLVE_IDLE) && dev->present) {
+		magSolveFit = dev->magCal;
+		magSolveState = MAG_SOLVE_QUEUED;
+	}
+}
 
-static uint8_t magTaskStack[450];
-static uint8_t gyroTaskStack[450];
-static uint8_t accelTaskStack[450];
+/* Mag data ready: read every sensor, with the occasional temperature
+ * sample and ellipsoid solve */
+static void imuServiceMag(void)
+{
+	bool solve = (++magCalCount >= MAG_CAL_SOLVE_INTERVAL);
+	bool temp = (++tempCount >= TEMP_SAMPLE_INTERVAL);
+	uint8_t i;
+
+	if (solve) magCalCount = 0;
+	if (temp) tempCount = 0;
+	for (i = 0; i < LSM9DS1_DEVICE_COUNT; i++) {
+		if (!imuDevices[i].present) continue;
+		LSM9DS1select(&imuDevices[i]);
+		readMag();
+		/* Updates the temperature compensation */
+		if (temp) readTemp();
+	}
+	imuMagSolveStep(solve);
+	LSM9DS1select(&imuDevices[0]);
+//	Watchdog_clear(watchdogHandle);
+//	LOG3(LOG_MAG, imu->mx, imu->my, imu->mz);
+}
 
-Void magTaskFunc(UArg arg0, UArg arg1)
+/* New gyro/accel frames (or a wake request): drain the FIFOs if used, then
+ * run the stream consumers in a fixed order */
+static void imuServiceGyroAccel(void)
 {
+	IMU_Frame frame;
+#if IMU_FIFO_THRESHOLD
+	uint8_t i;
+#endif
+
+	imuMotionRun();
+#if IMU_FIFO_THRESHOLD
+	for (i = LSM9DS1_DEVICE_COUNT; i-- > 0; ) {
+		if (!imuDevices[i].present) continue;
+		LSM9DS1select(&imuDevices[i]);
+		readFIFOFrames(IMU_FIFO_THRESHOLD, xgIntTick);
+	}
+	/* Frames that landed during the burst may hold FTH high */
+	if (getFIFOSamples() >= IMU_FIFO_THRESHOLD)
+		Event_post(imuEventHandle, IMU_EVENT_XG);
+#else
+	/* The frames were read by the transfers queued in pinCallback */
+#endif
+	/* Each sensor's bias first, so the vote compares corrected frames */
+	imuBiasRun();
+	imuVoteRun();
+	/* A position from the uplink, before either filter reads the field */
+	magModelRun();
+	attFilterRun();
+	mekfRun();
+	imuDecimateRun();
+	imuGovernorRun();
+	if (((Clock_getTicks() - accelLogTick) >= LOG_DRAIN_PERIOD) &&
+		imuRingLatest(&imuDecimRing, &frame)) {
+		accelLogTick = Clock_getTicks();
+//		LOG3(LOG_GYRO, frame.xg[0], frame.xg[1], frame.xg[2]);
+		LOG3(LOG_ACCEL, frame.xg[3], frame.xg[4], frame.xg[5]);
+	}
+}
+
+Void imuTaskFunc(UArg arg0, UArg arg1)
+{
+	UInt events;
+	uint8_t i;
+
 	I2C_init();
-    LSM9DS1init();
+	for (i = 0; i < LSM9DS1_DEVICE_COUNT; i++)
+		LSM9DS1init(&imuDevices[i], i);
     initI2C();
 
-	/* Initialization and Calibration */
-    uint16_t workpls = LSM9DS1begin();
-    configInt(XG_INT1, INT_DRDY_G, INT_ACTIVE_HIGH, INT_PUSH_PULL);
-    configInt(XG_INT2, INT_DRDY_XL, INT_ACTIVE_HIGH, INT_PUSH_PULL);
-    //		calibrate(1);
-    //		calibrateMag(1);
+	/* Initialization and Calibration. The primary is begun last so it
+	 * stays selected. */
+	for (i = LSM9DS1_DEVICE_COUNT; i-- > 0; ) {
+		LSM9DS1select(&imuDevices[i]);
+		LSM9DS1begin();
+#if IMU_FIFO_THRESHOLD
+		if (imuDevices[i].present)
+			configFIFOMode(IMU_FIFO_THRESHOLD);
+#endif
+	}
+    /* Gyro/accel bias is tracked in the background from here on */
+    imuBiasInit();
+    /* Sensor rates follow the activity from here on */
+    imuGovernorInit();
+    /* Gyro sleeps while the LSM9DS1 reports inactivity */
+    imuMotionInit();
+    /* Redundant sensors are fused into imuRing from here on */
+    imuVoteInit();
+    /* LOG_ACCEL reads the decimated stream */
+    imuDecimateInit();
 
     	/* getMagInitial is only required if you're calibrating for the computer attitude */
     //		getMagInitial();
@@ -40,101 +183,49 @@ Void magTaskFunc(UArg arg0, UArg arg1)
     /* Unlock other tasks */
 	goodToGo += 1;
 
-	/* Read from each sensor (improves reliability) */
-	readGyro();
-	readAccel();
+    /* Gyro and accel are read together on the primary's XG INT2 line.
+     * Routed only now that pinCallback reads: a sample is already waiting,
+     * so INT2 rises at once and the first frame comes through the queue
+     * like any other. The ring has one producer, so no read from here. */
+#if !IMU_FIFO_THRESHOLD
+    configInt(XG_INT2, INT_DRDY_XL, INT_ACTIVE_HIGH, INT_PUSH_PULL);
+#endif
+	/* Clears DRDY_M, so the next mag sample raises a fresh edge */
 	readMag();
+	magCalCount = 0;
+	tempCount = 0;
+	magSolveState = MAG_SOLVE_IDLE;
+	magSolveDevice = 0;
+	logSetBackground(imuMagSolve);
+#if TRIAD_BENCHMARK
+	triadBenchmark();
+#endif
     while (1) {
-    		Semaphore_pend(magSemaphoreHandle, BIOS_WAIT_FOREVER);
-    		Semaphore_pend(batonSemaphoreHandle, BIOS_WAIT_FOREVER);
-    		if(goodToGo){
-    			readMag();
-//    			Watchdog_clear(watchdogHandle);
-//    			Display_printf(display, 0, 0,
-//    									"Magnetometer X: %d \n", mx);
-//    			Display_printf(display, 0, 0,
-//    			    						"Magnetometer Y: %d \n", my);
-//    			Display_printf(display, 0, 0,
-//    			    						"Magnetometer Z: %d \n", mz);
-    		}
-    		Semaphore_post(batonSemaphoreHandle);
-    }
-}
-
-Void gyroTaskFunc(UArg arg0, UArg arg1)
-{
-    while (1) {
-    		Semaphore_pend(gyroSemaphoreHandle, BIOS_WAIT_FOREVER);
-    		Semaphore_pend(batonSemaphoreHandle, BIOS_WAIT_FOREVER);
+    		/* Everything that became ready since the last pass, in one wakeup */
+    		events = Event_pend(imuEventHandle, Event_Id_NONE, IMU_EVENT_ALL,
+    				BIOS_WAIT_FOREVER);
+    		/* Only the bus is shared, radio airtime never holds this up */
+    		arbiterEnter(RESOURCE_I2C);
     		if(goodToGo){
-    			readGyro();
-//    			Display_printf(display, 0, 0,
-//									"Gyro X: %d \n", gx);
-//			Display_printf(display, 0, 0,
-//									"Gyro Y: %d \n", gy);
-//			Display_printf(display, 0, 0,
-//									"Gyro Z: %d \n", gz);
-
+    			/* Mag first, so FIFO frames carry the freshest mag reading */
+    			if (events & IMU_EVENT_MAG)
+    				imuServiceMag();
+    			if (events & (IMU_EVENT_XG | IMU_EVENT_WAKE))
+    				imuServiceGyroAccel();
     		}
-    		Semaphore_post(batonSemaphoreHandle);
+    		/* TX is paced by clk0Fxn and sends the latest packed attitude */
+    		arbiterLeave(RESOURCE_I2C);
     }
 }
 
-Void accelTaskFunc(UArg arg0, UArg arg1)
-{
-    while (1) {
-    		Semaphore_pend(accelSemaphoreHandle, BIOS_WAIT_FOREVER);
-    		Semaphore_pend(batonSemaphoreHandle, BIOS_WAIT_FOREVER);
-    		if(goodToGo){
-    			readAccel();
-//    			while(tempAvailable()){
-//    				readTemp();
-//				Display_printf(display, 0, 0,
-//									"Temperature: %x \n", temperature);
-//    			}
-
-				Display_printf(display, 0, 0,
-									"Accel X: %d \n", ax);
-				Display_printf(display, 0, 0,
-									"Accel Y: %d \n", ay);
-				Display_printf(display, 0, 0,
-									"Accel Z: %d \n", az);
-    		}
-    		Semaphore_post(txDataSemaphoreHandle);
-    		Semaphore_post(batonSemaphoreHandle);
-    }
-}
-
-void createMagTask()
-{
-	Task_Params task_params;
-	Task_Params_init(&task_params);
-	task_params.stackSize = 450;
-	task_params.priority = 2;
-	task_params.stack = &magTaskStack;
-	Task_construct(&magTask, magTaskFunc,
-					   &task_params, NULL);
-}
-
-void createGyroTask()
-{
-	Task_Params task_params;
-	Task_Params_init(&task_params);
-	task_params.stackSize = 450;
-	task_params.priority = 2;
-	task_params.stack = &gyroTaskStack;
-	Task_construct(&gyroTask, gyroTaskFunc,
-					   &task_params, NULL);
-}
-
-void createAccelTask()
+void createIMUTask()
 {
 	Task_Params task_params;
 	Task_Params_init(&task_params);
-	task_params.stackSize = 450;
+	task_params.stackSize = sizeof(imuTaskStack);
 	task_params.priority = 2;
-	task_params.stack = &accelTaskStack;
-	Task_construct(&accelTask, accelTaskFunc,
+	task_params.stack = &imuTaskStack;
+	Task_construct(&imuTask, imuTaskFunc,
 					   &task_params, NULL);
 }
 
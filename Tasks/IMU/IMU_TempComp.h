@@ -0,0 +1,186 @@
+/*
+ * IMU_TempComp.h
+ *
+ *  Temperature compensation for the gyro and accel.
+ *
+ *  Each of the six channels has a bias and a scale that are polynomials
+ *  of degree IMU_TEMPCOMP_DEGREE in the die temperature t (°C from 25 °C):
+ *
+ *      bias(t)  = b0 + b1 t + b2 t^2             raw LSB
+ *      scale(t) = 1 + s1 t + s2 t^2
+ *      out      = (raw - bias(t)) * scale(t)
+ *
+ *  The polynomials are evaluated only when a new temperature is sampled,
+ *  at the mag rate or slower. The per-sample path is then a subtract and
+ *  a Q14 multiply. Compensation is off until tempCompLoad() is given a
+ *  table from a thermal calibration run.
+ */
+
+#ifndef TASKS_IMU_IMU_TEMPCOMP_H_
+#define TASKS_IMU_IMU_TEMPCOMP_H_
+
+#include <xdc/std.h>
+#include <ti/sysbios/hal/Hwi.h>
+
+#define IMU_TEMPCOMP_DEGREE		2
+/* OUT_TEMP is 16 LSB/°C with 0 at 25 °C, i.e. already t in Q4 */
+#define IMU_TEMPCOMP_T_SHIFT	4
+/* Gain format of the cached scale */
+#define IMU_TEMPCOMP_GAIN_SHIFT	14
+/* Operating range, °C. Readings outside it are clamped before the
+ * polynomials are evaluated, the range tempCompLoad() checked. */
+#define IMU_TEMPCOMP_T_MIN		(-40)
+#define IMU_TEMPCOMP_T_MAX		85
+
+/*
+ * Coefficient table, [channel][power] with channels gx gy gz ax ay az.
+ * bias: raw LSB / °C^power in Q8. scale: 1 / °C^power in Q24, the
+ * constant term scale[c][0] is unused (always 1).
+ */
+typedef struct IMU_TempCoeffs
+{
+	int32_t bias[6][IMU_TEMPCOMP_DEGREE + 1];
+	int32_t scale[6][IMU_TEMPCOMP_DEGREE + 1];
+} IMU_TempCoeffs;
+
+typedef struct IMU_TempComp
+{
+	IMU_TempCoeffs coeffs;
+	bool enabled;
+
+	/* Cached at the last temperature sample */
+	int16_t tempQ4;
+	int16_t offset[6];		// bias(t), raw LSB
+	int32_t gain[6];		// scale(t), Q14
+	uint32_t updates;
+} IMU_TempComp;
+
+/* Horner evaluation of c[0] + c[1] t + ... with t in Q4, same Q as c */
+static int32_t tempCompPoly(const int32_t *c, int32_t tQ4)
+{
+	int64_t acc = 0;
+	int i;
+
+	for (i = IMU_TEMPCOMP_DEGREE; i >= 0; i--)
+	{
+		acc = ((acc * tQ4) >> IMU_TEMPCOMP_T_SHIFT) + c[i];
+	}
+	if (acc > INT32_MAX) acc = INT32_MAX;
+	if (acc < INT32_MIN) acc = INT32_MIN;
+	return (int32_t)acc;
+}
+
+void tempCompInit(IMU_TempComp *tc)
+{
+	int i, j;
+
+	for (i = 0; i < 6; i++)
+	{
+		for (j = 0; j <= IMU_TEMPCOMP_DEGREE; j++)
+		{
+			tc->coeffs.bias[i][j] = 0;
+			tc->coeffs.scale[i][j] = 0;
+		}
+		tc->coeffs.scale[i][0] = 1L << 24;
+		tc->offset[i] = 0;
+		tc->gain[i] = 1L << IMU_TEMPCOMP_GAIN_SHIFT;
+	}
+	tc->tempQ4 = 0;
+	tc->enabled = false;
+	tc->updates = 0;
+}
+
+/*
+ * Re-evaluate the per-channel offset and gain at a new temperature
+ * reading. Task context; the cached values are swapped in with interrupts
+ * off, since the read path runs from the I2C callback.
+ */
+void tempCompUpdate(IMU_TempComp *tc, int16_t tempQ4)
+{
+	int16_t offset[6];
+	int32_t gain[6];
+	UInt key;
+	int i;
+
+	/* A gain outside 0.5..2 would overflow tempCompApply() */
+	if (tempQ4 < ((IMU_TEMPCOMP_T_MIN - 25) << IMU_TEMPCOMP_T_SHIFT))
+		tempQ4 = (IMU_TEMPCOMP_T_MIN - 25) << IMU_TEMPCOMP_T_SHIFT;
+	if (tempQ4 > ((IMU_TEMPCOMP_T_MAX - 25) << IMU_TEMPCOMP_T_SHIFT))
+		tempQ4 = (IMU_TEMPCOMP_T_MAX - 25) << IMU_TEMPCOMP_T_SHIFT;
+
+	for (i = 0; i < 6; i++)
+	{
+		int32_t b = tempCompPoly(tc->coeffs.bias[i], tempQ4);
+		int32_t s = tempCompPoly(tc->coeffs.scale[i], tempQ4);
+
+		b = (b + (1 << 7)) >> 8;
+		if (b > 32767) b = 32767;
+		if (b < -32768) b = -32768;
+		offset[i] = (int16_t)b;
+		gain[i] = (s + (1L << (23 - IMU_TEMPCOMP_GAIN_SHIFT))) >>
+				(24 - IMU_TEMPCOMP_GAIN_SHIFT);
+	}
+
+	key = Hwi_disable();
+	for (i = 0; i < 6; i++)
+	{
+		tc->offset[i] = offset[i];
+		tc->gain[i] = gain[i];
+	}
+	tc->tempQ4 = tempQ4;
+	Hwi_restore(key);
+	tc->updates++;
+}
+
+/*
+ * Replace the coefficient table and enable compensation. A scale that
+ * would leave a gain outside 0.5..2 over -40..85 °C is refused.
+ */
+bool tempCompLoad(IMU_TempComp *tc, const IMU_TempCoeffs *coeffs)
+{
+	int32_t scale[IMU_TEMPCOMP_DEGREE + 1];
+	int i, j, t;
+
+	for (i = 0; i < 6; i++)
+	{
+		for (j = 0; j <= IMU_TEMPCOMP_DEGREE; j++)
+			scale[j] = coeffs->scale[i][j];
+		scale[0] = 1L << 24;
+		/* 5 °C steps over the operating range */
+		for (t = IMU_TEMPCOMP_T_MIN - 25; t <= IMU_TEMPCOMP_T_MAX - 25; t += 5)
+		{
+			int32_t s = tempCompPoly(scale, t << IMU_TEMPCOMP_T_SHIFT);
+			if ((s < (1L << 23)) || (s > (1L << 25)))
+				return false;
+		}
+	}
+
+	tc->enabled = false;
+	tc->coeffs = *coeffs;
+	/* The constant scale term is 1, i.e. 2^24 in Q24 */
+	for (i = 0; i < 6; i++)
+		tc->coeffs.scale[i][0] = 1L << 24;
+	tempCompUpdate(tc, tc->tempQ4);
+	tc->enabled = true;
+	return true;
+}
+
+/* Compensate one gyro/accel frame in place, read path. The gain is at
+ * most 2.0, so the product fits in 32 bits. */
+void tempCompApply(const IMU_TempComp *tc, int16_t *frame)
+{
+	int i;
+
+	if (!tc->enabled)
+		return;
+	for (i = 0; i < 6; i++)
+	{
+		int32_t v = ((int32_t)frame[i] - tc->offset[i]) * tc->gain[i];
+		v = (v + (1L << (IMU_TEMPCOMP_GAIN_SHIFT - 1))) >> IMU_TEMPCOMP_GAIN_SHIFT;
+		if (v > 32767) v = 32767;
+		if (v < -32768) v = -32768;
+		frame[i] = (int16_t)v;
+	}
+}
+
+#endif /* TASKS_IMU_IMU_TEMPCOMP_H_ */
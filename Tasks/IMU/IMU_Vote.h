@@ -0,0 +1,209 @@
+/*
+ * IMU_Vote.h
+ *
+ *  Fusion of redundant LSM9DS1s (LSM9DS1_DEVICE_COUNT 2).
+ *
+ *  Both sensors are read on the primary's data-ready, so their frames in
+ *  imuDeviceRings are stamped within a fraction of a sample period of each
+ *  other. Frames are paired by stamp and compared channel by channel.
+ *  Each sensor's own bias is already subtracted (IMU_Bias.h runs on the
+ *  device rings), so a healthy pair agrees. Channels that agree within
+ *  tolerance are averaged. For a channel that disagrees, the sensor closer
+ *  to the last fused value wins and the other is charged a miscompare. A
+ *  sensor that loses IMU_VOTE_FAULT_LIMIT frames in a row is voted out,
+ *  and from then on the survivor passes straight through. The result is
+ *  published into imuRing, so the other consumers do not care how many
+ *  sensors there are.
+ */
+
+#ifndef TASKS_IMU_IMU_VOTE_H_
+#define TASKS_IMU_IMU_VOTE_H_
+
+#include <ti/sysbios/knl/Clock.h>
+#include "LSM9DS1.h"
+#include "IMU_Ring.h"
+
+#if LSM9DS1_DEVICE_COUNT > 1
+
+/* Largest agreeing difference, raw LSB (~3 dps at 245 dps, ~60 mg at 2 g) */
+#define IMU_VOTE_GYRO_TOL		343
+#define IMU_VOTE_ACCEL_TOL		983
+#define IMU_VOTE_MAG_TOL		1430
+/* Consecutive lost frames before a sensor is voted out */
+#define IMU_VOTE_FAULT_LIMIT	16
+/* A frame waits at most this long for its partner (Clock ticks) */
+#define IMU_VOTE_PAIR_TIMEOUT	(100000 / Clock_tickPeriod)
+
+typedef struct IMU_Vote
+{
+	IMU_RingReader reader[2];
+	IMU_Frame held[2];
+	bool have[2];
+	bool faulty[2];
+	uint8_t losses[2];		// Consecutive frames with a losing channel
+	int16_t last[9];		// Last fused xg + mag
+
+	/* Telemetry */
+	uint32_t agreed;		// Frames where every channel agreed
+	uint32_t miscompares[2];
+	uint32_t unpaired;		// Frames published from one sensor only
+} IMU_Vote;
+
+IMU_Vote imuVote;
+
+void imuVoteInit(void)
+{
+	int i;
+	for (i = 0; i < 2; i++)
+	{
+		imuRingReaderInit(&imuDeviceRings[i], &imuVote.reader[i]);
+		imuVote.have[i] = false;
+		imuVote.faulty[i] = !imuDevices[i].present;
+		imuVote.losses[i] = 0;
+		imuVote.miscompares[i] = 0;
+	}
+	for (i = 0; i < 9; i++) imuVote.last[i] = 0;
+	imuVote.agreed = 0;
+	imuVote.unpaired = 0;
+}
+
+static void imuVotePublish(const int16_t xg[6], const int16_t mag[3], uint32_t stamp)
+{
+	uint8_t frames = 1;
+	int16_t (*slot)[6] = imuRingReserve(&imuRing, &frames);
+	int i;
+
+	for (i = 0; i < 6; i++)
+	{
+		slot[0][i] = xg[i];
+		imuVote.last[i] = xg[i];
+	}
+	for (i = 0; i < 3; i++) imuVote.last[6 + i] = mag[i];
+	imuRingCommit(&imuRing, 1, stamp, 0, mag);
+}
+
+/* Vote one channel, returns the fused value and flags the loser */
+static int16_t imuVoteChannel(int16_t a, int16_t b, int16_t last,
+		int32_t tol, bool lost[2])
+{
+	int32_t diff = (int32_t)a - b;
+	int32_t da, db;
+
+	if ((diff <= tol) && (diff >= -tol))
+		return (int16_t)(((int32_t)a + b) >> 1);
+
+	da = (int32_t)a - last;
+	db = (int32_t)b - last;
+	if (da < 0) da = -da;
+	if (db < 0) db = -db;
+	if (da <= db)
+	{
+		lost[1] = true;
+		return a;
+	}
+	lost[0] = true;
+	return b;
+}
+
+static void imuVotePair(const IMU_Frame *f0, const IMU_Frame *f1)
+{
+	int16_t xg[6], mag[3];
+	bool lost[2] = {false, false};
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		xg[i] = imuVoteChannel(f0->xg[i], f1->xg[i], imuVote.last[i],
+				IMU_VOTE_GYRO_TOL, lost);
+		xg[3 + i] = imuVoteChannel(f0->xg[3 + i], f1->xg[3 + i], imuVote.last[3 + i],
+				IMU_VOTE_ACCEL_TOL, lost);
+		mag[i] = imuVoteChannel(f0->mag[i], f1->mag[i], imuVote.last[6 + i],
+				IMU_VOTE_MAG_TOL, lost);
+	}
+
+	if (!lost[0] && !lost[1]) imuVote.agreed++;
+	for (i = 0; i < 2; i++)
+	{
+		if (lost[i])
+		{
+			imuVote.miscompares[i]++;
+			if (++imuVote.losses[i] >= IMU_VOTE_FAULT_LIMIT)
+				imuVote.faulty[i] = true;
+		}
+		else
+		{
+			imuVote.losses[i] = 0;
+		}
+	}
+	imuVotePublish(xg, mag, f0->stamp);
+}
+
+/*
+ * Pair up and fuse the frames both sensors published since the last call.
+ * Run from the task that consumes the sensor data.
+ */
+void imuVoteRun(void)
+{
+	uint32_t now = Clock_getTicks();
+	/* Frames less than half a gyro period apart are the same sample */
+	int32_t maxSkew = (int32_t)(devGyroPeriodTicks(&imuDevices[0]) >> 1);
+	int i;
+
+	while (1)
+	{
+		for (i = 0; i < 2; i++)
+		{
+			if (imuVote.faulty[i])
+			{
+				/* A voted-out sensor is drained but never used */
+				while (imuRingRead(&imuDeviceRings[i], &imuVote.reader[i], &imuVote.held[i]));
+				imuVote.have[i] = false;
+			}
+			else if (!imuVote.have[i])
+			{
+				imuVote.have[i] = imuRingRead(&imuDeviceRings[i],
+						&imuVote.reader[i], &imuVote.held[i]);
+			}
+		}
+
+		if (imuVote.have[0] && imuVote.have[1])
+		{
+			int32_t skew = (int32_t)(imuVote.held[0].stamp - imuVote.held[1].stamp);
+			if ((skew <= maxSkew) && (skew >= -maxSkew))
+			{
+				imuVotePair(&imuVote.held[0], &imuVote.held[1]);
+				imuVote.have[0] = imuVote.have[1] = false;
+				continue;
+			}
+			/* The older one lost its partner */
+			i = (skew < 0) ? 0 : 1;
+		}
+		else if (imuVote.have[0] || imuVote.have[1])
+		{
+			i = imuVote.have[0] ? 0 : 1;
+			/* Wait for the partner unless it is out or overdue */
+			if (!imuVote.faulty[1 - i] &&
+				((now - imuVote.held[i].stamp) < IMU_VOTE_PAIR_TIMEOUT))
+				return;
+		}
+		else
+		{
+			return;
+		}
+
+		if (!imuVote.faulty[0] && !imuVote.faulty[1])
+			imuVote.unpaired++;
+		imuVotePublish(imuVote.held[i].xg, imuVote.held[i].mag, imuVote.held[i].stamp);
+		imuVote.have[i] = false;
+	}
+}
+
+#else
+
+/* Single sensor: it publishes straight into imuRing */
+#define imuVoteInit()
+#define imuVoteRun()
+
+#endif
+
+#endif /* TASKS_IMU_IMU_VOTE_H_ */
@@ -19,12 +19,20 @@
 /* Include necessary TI drivers */
 //#include <ti/drivers/GPIO.h>
 #include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/knl/Semaphore.h>
+#include <ti/sysbios/knl/Event.h>
 #include <ti/drivers/I2C.h>
+#include <xdc/runtime/Timestamp.h>
 
 /* Include board file for access to pin definitions */
 #include "Board.h"
 #include "Tasks/IMU/LSM9DS1_Registers.h"
 #include "Tasks/IMU/LSM9DS1_Types.h"
+#include "Tasks/IMU/LSM9DS1_Config.h"
+#include "Tasks/IMU/I2C_Queue.h"
+#include "Tasks/IMU/IMU_Ring.h"
+#include "Tasks/IMU/Mag_Calibration.h"
+#include "Tasks/IMU/IMU_TempComp.h"
 
 
 /* ===============================================================
@@ -46,6 +54,21 @@
 #define SENSITIVITY_MAGNETOMETER_12  0.00043
 #define SENSITIVITY_MAGNETOMETER_16  0.00058
 
+// The same sensitivities as Q32 fractions (units per LSB * 2^32), folded to
+// integers by the compiler. Every value fits in an int32_t.
+#define SENSITIVITY_Q32(s)	((int32_t)((s) * 4294967296.0 + 0.5))
+#define SENSITIVITY_ACCELEROMETER_2_Q32	SENSITIVITY_Q32(SENSITIVITY_ACCELEROMETER_2)
+#define SENSITIVITY_ACCELEROMETER_4_Q32	SENSITIVITY_Q32(SENSITIVITY_ACCELEROMETER_4)
+#define SENSITIVITY_ACCELEROMETER_8_Q32	SENSITIVITY_Q32(SENSITIVITY_ACCELEROMETER_8)
+#define SENSITIVITY_ACCELEROMETER_16_Q32	SENSITIVITY_Q32(SENSITIVITY_ACCELEROMETER_16)
+#define SENSITIVITY_GYROSCOPE_245_Q32	SENSITIVITY_Q32(SENSITIVITY_GYROSCOPE_245)
+#define SENSITIVITY_GYROSCOPE_500_Q32	SENSITIVITY_Q32(SENSITIVITY_GYROSCOPE_500)
+#define SENSITIVITY_GYROSCOPE_2000_Q32	SENSITIVITY_Q32(SENSITIVITY_GYROSCOPE_2000)
+#define SENSITIVITY_MAGNETOMETER_4_Q32	SENSITIVITY_Q32(SENSITIVITY_MAGNETOMETER_4)
+#define SENSITIVITY_MAGNETOMETER_8_Q32	SENSITIVITY_Q32(SENSITIVITY_MAGNETOMETER_8)
+#define SENSITIVITY_MAGNETOMETER_12_Q32	SENSITIVITY_Q32(SENSITIVITY_MAGNETOMETER_12)
+#define SENSITIVITY_MAGNETOMETER_16_Q32	SENSITIVITY_Q32(SENSITIVITY_MAGNETOMETER_16)
+
 
 /* Accelerometer/Gyroscope and Magnetometer ID's (from Sparkfun file) */
 #define LSM9DS1_AG_ADDR(sa0)		((sa0) == 0 ? 0x6A : 0x6B)
@@ -59,27 +82,120 @@ typedef enum {
 	ALL_AXIS
 } lsm9ds1_axis;
 
-/* Create global i2c handle and parameters structs */
-I2C_Handle      i2c;
-I2C_Params      i2cParams;
-I2C_Transaction i2cTransaction;
+/*
+ * Set to a FIFO watermark (1-31) to batch gyro/accel frames in the LSM9DS1
+ * FIFO and wake once per burst. 0 reads every accel data-ready from the
+ * pin interrupt.
+ */
+#define IMU_FIFO_THRESHOLD	0
+
+/*
+ * 1 writes the control registers from the compile-time images in
+ * LSM9DS1_Config.h with one burst per block. 0 uses the per-register
+ * initGyro()/initAccel()/initMag() path, e.g. to compare bootTime.
+ */
+#define LSM9DS1_BURST_CONFIG	1
+
+/* Gyro/accel frames as stored in the hardware FIFO */
+#define FIFO_FRAME_BYTES	12
+#define FIFO_MAX_FRAMES		32
+
+/* Longest burst read, bounds every transfer without staging buffers */
+#define I2C_READ_MAX		(FIFO_MAX_FRAMES * FIFO_FRAME_BYTES)
 
-/* global IMUSettings struct */
-IMUSettings settings;
+/*
+ * RAM shadow of the writable configuration registers, so read-modify-write
+ * helpers cost a single bus write. Filled by LSM9DS1begin() and kept
+ * coherent by xgWriteByte()/mWriteByte().
+ */
+typedef struct
+{
+	uint8_t first;
+	uint8_t count;
+} regBlock;
+
+static const regBlock xgShadowBlocks[] = {
+	{ACT_THS, 10},			// ACT_THS .. INT2_CTRL
+	{CTRL_REG1_G, 4},		// CTRL_REG1_G .. ORIENT_CFG_G
+	{CTRL_REG4, 7},			// CTRL_REG4 .. CTRL_REG10
+	{FIFO_CTRL, 1},
+	{INT_GEN_CFG_G, 8}		// INT_GEN_CFG_G .. INT_GEN_DUR_G
+};
+static const regBlock mShadowBlocks[] = {
+	{OFFSET_X_REG_L_M, 6},	// OFFSET_X_REG_L_M .. OFFSET_Z_REG_H_M
+	{CTRL_REG1_M, 5},		// CTRL_REG1_M .. CTRL_REG5_M
+	{INT_CFG_M, 1},
+	{INT_THS_L_M, 2}		// INT_THS_L_M .. INT_THS_H_M
+};
 
-/* Raw, signed 16-bit readings from the sensors and biases */
-int16_t gx, gy, gz;
-int16_t ax, ay, az;
-int16_t mx, my, mz;
-int16_t temperature;
-uint8_t temp_l, temp_h;
-float gBias[3], aBias[3], mBias[3];
-int16_t gBiasRaw[3], aBiasRaw[3], mBiasRaw[3];
+/*
+ * Everything the driver knows about one LSM9DS1. The functions below work
+ * on the device picked with LSM9DS1select(), so LSM9DS1_DEVICE_COUNT
+ * sensors can share the bus at their alternate SA0/SA1 addresses.
+ */
+typedef struct LSM9DS1_Device
+{
+	IMUSettings settings;
+	uint8_t mAddress, xgAddress;
+	bool present;					// WHO_AM_I answered
+
+	/* Raw, signed 16-bit readings from the sensors and biases */
+	int16_t gx, gy, gz;
+	int16_t ax, ay, az;
+	int16_t mx, my, mz;
+	int16_t mRaw[3];				// Mag reading before the soft-iron correction
+	int16_t temperature;
+	uint8_t temp_l, temp_h;
+	float gBias[3], aBias[3], mBias[3];
+	int16_t gBiasRaw[3], aBiasRaw[3], mBiasRaw[3];
+
+	float gRes, aRes, mRes;
+	int32_t gResQ32, aResQ32, mResQ32;
+	bool autoCalc;
+
+	/* Configuration register shadows */
+	uint8_t xgShadow[INT_GEN_DUR_G + 1];
+	uint8_t mShadow[INT_THS_H_M + 1];
+	bool xgShadowValid, mShadowValid;
+
+	MagCal magCal;
+	IMU_TempComp tempComp;
+	IMU_Ring *ring;					// Where gyro/accel frames are published
+
+	/* Boot benchmark: LSM9DS1begin() to the first published frame */
+	uint32_t bootStart;				// Timestamp at the start of LSM9DS1begin()
+	uint32_t bootTime;				// Timestamp counts, 0 until the first frame
+	uint32_t bootTransfers;			// I2C transactions issued by LSM9DS1begin()
+
+	/* Interrupt-driven gyro/accel read */
+	int16_t (*xgAsyncSlot)[6];
+	uint32_t xgAsyncStamp;
+	volatile bool xgAsyncPending;
+	Event_Handle xgAsyncEvent;		// Posted with xgAsyncEventId when published
+	UInt xgAsyncEventId;
+	uint32_t xgAsyncDropped;
+} LSM9DS1_Device;
+
+LSM9DS1_Device imuDevices[LSM9DS1_DEVICE_COUNT];
+
+/* Device the driver functions currently act on */
+LSM9DS1_Device *imu = &imuDevices[0];
+
+#if LSM9DS1_DEVICE_COUNT > 1
+/* Each sensor publishes into its own ring, IMU_Vote.h fuses them into imuRing */
+IMU_Ring imuDeviceRings[LSM9DS1_DEVICE_COUNT];
+#endif
+
+/* Point the driver at dev. Task context, under the same lock as the bus
+ * accesses that follow. */
+void LSM9DS1select(LSM9DS1_Device *dev)
+{
+	imu = dev;
+}
 
-/* Protected (not really)*/
-uint8_t _mAddress, _xgAddress;
-float gRes, aRes, mRes;
-bool _autoCalc;
+/* Gyro output data period in microseconds, indexed by the 3-bit ODR
+ * setting. 0 is power-down and 7 is reserved, neither has a period. */
+static const uint32_t gyroODRPeriodUs[8] = {0, 67114, 16807, 8403, 4202, 2101, 1050, 0};
 
 float AXN = 0;
 float AYN = 0;
@@ -89,97 +205,77 @@ float MYN;
 float MZN;
 
 /*
- * Initialization
+ * Initialization. Selects dev; device 0 sits at the SA0/SA1-high
+ * addresses, a second sensor at the alternate ones.
  */
-void LSM9DS1init(void)
-{
-	settings.device.agAddress = LSM9DS1_AG_ADDR(1);
-	settings.device.mAddress = LSM9DS1_M_ADDR(1);
-
-	settings.gyro.enabled = true;
-	settings.gyro.enableX = true;
-	settings.gyro.enableY = true;
-	settings.gyro.enableZ = true;
-	// gyro scale can be 245, 500, or 2000
-	settings.gyro.scale = 245;
-	// gyro sample rate: value between 1-6
-	// 1 = 14.9    4 = 238
-	// 2 = 59.5    5 = 476
-	// 3 = 119     6 = 952
-	settings.gyro.sampleRate = 0x01;
-	// gyro cutoff frequency: value between 0-3
-	// Actual value of cutoff frequency depends
-	// on sample rate.
-	settings.gyro.bandwidth = 0;
-	settings.gyro.lowPowerEnable = true;
-	settings.gyro.HPFEnable = false;
-	// Gyro HPF cutoff frequency: value between 0-9
-	// Actual value depends on sample rate. Only applies
-	// if gyroHPFEnable is true.
-	settings.gyro.HPFCutoff = 0;
-	settings.gyro.flipX = false;
-	settings.gyro.flipY = false;
-	settings.gyro.flipZ = false;
-	settings.gyro.orientation = 0;
-	settings.gyro.latchInterrupt = true;
-
-	settings.accel.enabled = true;
-	settings.accel.enableX = true;
-	settings.accel.enableY = true;
-	settings.accel.enableZ = true;
-	// accel scale can be 2, 4, 8, or 16
-	settings.accel.scale = 2;
-	// accel sample rate can be 1-6
-	// 1 = 10 Hz    4 = 238 Hz
-	// 2 = 50 Hz    5 = 476 Hz
-	// 3 = 119 Hz   6 = 952 Hz
-	settings.accel.sampleRate = 0x01;
-	// Accel cutoff freqeuncy can be any value between -1 - 3.
-	// -1 = bandwidth determined by sample rate
-	// 0 = 408 Hz   2 = 105 Hz
-	// 1 = 211 Hz   3 = 50 Hz
-	settings.accel.bandwidth = -1;
-	settings.accel.highResEnable = false;
-	// accelHighResBandwidth can be any value between 0-3
-	// LP cutoff is set to a factor of sample rate
-	// 0 = ODR/50    2 = ODR/9
-	// 1 = ODR/100   3 = ODR/400
-	settings.accel.highResBandwidth = 0;
-
-	settings.mag.enabled = true;
-	// mag scale can be 4, 8, 12, or 16
-	settings.mag.scale = 4;
-	// mag data rate can be 0-7
-	// 0 = 0.625 Hz  4 = 10 Hz
-	// 1 = 1.25 Hz   5 = 20 Hz
-	// 2 = 2.5 Hz    6 = 40 Hz
-	// 3 = 5 Hz      7 = 80 Hz
-	settings.mag.sampleRate = 5;
-	settings.mag.tempCompensationEnable = false;
-	// magPerformance can be any value between 0-3
-	// 0 = Low power mode      2 = high performance
-	// 1 = medium performance  3 = ultra-high performance
-	settings.mag.XYPerformance = 3;
-	settings.mag.ZPerformance = 3;
-	settings.mag.lowPowerEnable = false;
-	// magOperatingMode can be 0-2
-	// 0 = continuous conversion
-	// 1 = single-conversion
-	// 2 = power down
-	settings.mag.operatingMode = 0;
-
-	settings.temp.enabled = true;
+void LSM9DS1init(LSM9DS1_Device *dev, uint8_t index)
+{
+	LSM9DS1select(dev);
+	imu->settings.device.agAddress = LSM9DS1_AG_ADDR(index == 0);
+	imu->settings.device.mAddress = LSM9DS1_M_ADDR(index == 0);
+	imu->present = false;
+
+	imu->settings.gyro.enabled = true;
+	imu->settings.gyro.enableX = true;
+	imu->settings.gyro.enableY = true;
+	imu->settings.gyro.enableZ = true;
+	// The rest mirrors LSM9DS1_Config.h, see there for the allowed values
+	imu->settings.gyro.scale = LSM9DS1_GYRO_SCALE;
+	imu->settings.gyro.sampleRate = LSM9DS1_GYRO_ODR;
+	imu->settings.gyro.bandwidth = LSM9DS1_GYRO_BW;
+	imu->settings.gyro.lowPowerEnable = LSM9DS1_GYRO_LOW_POWER;
+	imu->settings.gyro.HPFEnable = LSM9DS1_GYRO_HPF;
+	imu->settings.gyro.HPFCutoff = LSM9DS1_GYRO_HPF_CUTOFF;
+	imu->settings.gyro.flipX = LSM9DS1_GYRO_FLIP_X;
+	imu->settings.gyro.flipY = LSM9DS1_GYRO_FLIP_Y;
+	imu->settings.gyro.flipZ = LSM9DS1_GYRO_FLIP_Z;
+	imu->settings.gyro.orientation = 0;
+	imu->settings.gyro.latchInterrupt = LSM9DS1_GYRO_LATCH_INT;
+
+	imu->settings.accel.enabled = true;
+	imu->settings.accel.enableX = true;
+	imu->settings.accel.enableY = true;
+	imu->settings.accel.enableZ = true;
+	imu->settings.accel.scale = LSM9DS1_ACCEL_SCALE;
+	imu->settings.accel.sampleRate = LSM9DS1_ACCEL_ODR;
+	imu->settings.accel.bandwidth = LSM9DS1_ACCEL_BW;
+	imu->settings.accel.highResEnable = LSM9DS1_ACCEL_HIGH_RES;
+	imu->settings.accel.highResBandwidth = LSM9DS1_ACCEL_HR_BW;
+
+	imu->settings.mag.enabled = true;
+	imu->settings.mag.scale = LSM9DS1_MAG_SCALE;
+	imu->settings.mag.sampleRate = LSM9DS1_MAG_ODR;
+	imu->settings.mag.tempCompensationEnable = LSM9DS1_MAG_TEMP_COMP;
+	imu->settings.mag.XYPerformance = LSM9DS1_MAG_XY_PERF;
+	imu->settings.mag.ZPerformance = LSM9DS1_MAG_Z_PERF;
+	imu->settings.mag.lowPowerEnable = LSM9DS1_MAG_LOW_POWER;
+	imu->settings.mag.operatingMode = LSM9DS1_MAG_MODE;
+
+	imu->settings.temp.enabled = true;
 	int i=0;
 	for (i=0; i<3; i++)
 	{
-		gBias[i] = 0;
-		aBias[i] = 0;
-		mBias[i] = 0;
-		gBiasRaw[i] = 0;
-		aBiasRaw[i] = 0;
-		mBiasRaw[i] = 0;
+		imu->gBias[i] = 0;
+		imu->aBias[i] = 0;
+		imu->mBias[i] = 0;
+		imu->gBiasRaw[i] = 0;
+		imu->aBiasRaw[i] = 0;
+		imu->mBiasRaw[i] = 0;
 	}
-	_autoCalc = false;
+	imu->autoCalc = false;
+	imu->xgAsyncPending = false;
+	imu->xgAsyncDropped = 0;
+	magCalInit(&imu->magCal);
+	tempCompInit(&imu->tempComp);
+
+#if LSM9DS1_DEVICE_COUNT > 1
+	imu->ring = &imuDeviceRings[index];
+	imuRingInit(imu->ring);
+#else
+	imu->ring = &imuRing;
+#endif
+	if (index == 0)
+		imuRingInit(&imuRing);
 }
 
 
@@ -189,133 +285,231 @@ void LSM9DS1init(void)
  * =================================================================
  */
 
-/* Function that opens I2C channel, turns on red LED if failure */
+/* Function that opens I2C channel */
 void initI2C(void){
-	I2C_Params_init(&i2cParams);
-	i2cParams.bitRate = I2C_400kHz;
-	i2c = I2C_open(Board_I2C0, &i2cParams);
-	if (i2c == NULL) {
-//		GPIO_write(Board_GPIO_LED0, Board_GPIO_LED_ON);
-		while (1);
-	}
-	else {
-	}
+	i2cQueueOpen();
 }
 
 /* Function that reads a byte from provided address/subaddress and returns value */
 uint8_t I2CreadByte(uint8_t address, uint8_t subAddress){
 
-	uint8_t data;
+	uint8_t data = 0;
 
     uint8_t txBuffer[1];
-    uint8_t rxBuffer[1];
 
     txBuffer[0] = subAddress;
-    i2cTransaction.slaveAddress = address;// 0x1e;
-    i2cTransaction.writeBuf = txBuffer;
-    i2cTransaction.writeCount = 1;
-    i2cTransaction.readBuf = rxBuffer;
-    i2cTransaction.readCount = 1;
-
 
-    if(I2C_transfer(i2c, &i2cTransaction)) {
+    if(i2cQueueTransfer(address, txBuffer, 1, &data, 1)) {
     }
     else{
 //    		GPIO_write(Board_GPIO_LED0, Board_GPIO_LED_ON);
     }
 
-    data = rxBuffer[0];
     return data;
 
 }
 
-/* Function that performs a burst read of from given address/subaddress */
-uint8_t I2CreadBytes(uint8_t address, uint8_t subAddress, uint8_t * dest, uint8_t count){
+/*
+ * Function that performs a burst read of from given address/subaddress.
+ * The bus transfers straight into dest, so nothing is staged on the stack.
+ */
+uint16_t I2CreadBytes(uint8_t address, uint8_t subAddress, uint8_t * dest, uint16_t count){
 
 	uint8_t txBuffer[1];
-	uint8_t rxBuffer[count];
-	int i=0;
-
-	txBuffer[0] = subAddress | 0x80;
 
-    i2cTransaction.slaveAddress = address;// 0x1e;
-    i2cTransaction.writeBuf = txBuffer;
-    i2cTransaction.writeCount = 1;
-    i2cTransaction.readBuf = rxBuffer;
-    i2cTransaction.readCount = count;
+	if (count > I2C_READ_MAX)
+		return 0;
 
+	txBuffer[0] = subAddress | 0x80;
 
-    if(I2C_transfer(i2c, &i2cTransaction)) {
+    if(i2cQueueTransfer(address, txBuffer, 1, dest, count)) {
     }
     else{
 //    		GPIO_write(Board_GPIO_LED0, Board_GPIO_LED_ON);
-    }
-
-    for (i=0; i<count; i+=1){
-    		dest[i] = rxBuffer[i];
+    		return 0;
     }
 
     return count;
 }
 
-void I2CwriteByte(uint8_t address, uint8_t subAddress, uint8_t data){
+bool I2CwriteByte(uint8_t address, uint8_t subAddress, uint8_t data){
 
 	uint8_t txBuffer[2];
 
 	txBuffer[0] = subAddress;
 	txBuffer[1] = data;
 
-    i2cTransaction.slaveAddress = address;
-    i2cTransaction.writeBuf = txBuffer;
-    i2cTransaction.writeCount = 2;
-    i2cTransaction.readBuf = NULL;
-    i2cTransaction.readCount = 0;
-
-    if(I2C_transfer(i2c, &i2cTransaction)) {
+    if(i2cQueueTransfer(address, txBuffer, 2, NULL, 0)) {
+    		return true;
     }
     else{
 //    		GPIO_write(Board_GPIO_LED0, Board_GPIO_LED_ON);
+    		return false;
     }
 }
 
+/* Burst write of count bytes (at most I2C_QUEUE_TX_MAX - 1) from subAddress on */
+bool I2CwriteBytes(uint8_t address, uint8_t subAddress, const uint8_t * data, uint8_t count){
+
+	uint8_t txBuffer[I2C_QUEUE_TX_MAX];
+
+	if (count > I2C_QUEUE_TX_MAX - 1)
+		return false;
+
+	txBuffer[0] = subAddress | 0x80;
+	memcpy(&txBuffer[1], data, count);
+
+    return i2cQueueTransfer(address, txBuffer, count + 1, NULL, 0);
+}
+
 /* ===============================================================
  * =================== BYTE READERS ==============================
  * ===============================================================
 */
-void xgWriteByte(uint8_t subAddress, uint8_t data)
+static bool regShadowed(const regBlock *blocks, uint8_t numBlocks, uint8_t subAddress)
+{
+	uint8_t i;
+	for (i = 0; i < numBlocks; i++)
+	{
+		if ((subAddress >= blocks[i].first) &&
+			(subAddress < blocks[i].first + blocks[i].count))
+			return true;
+	}
+	return false;
+}
+
+#define xgShadowed(reg) regShadowed(xgShadowBlocks, \
+		sizeof(xgShadowBlocks) / sizeof(xgShadowBlocks[0]), (reg))
+#define mShadowed(reg) regShadowed(mShadowBlocks, \
+		sizeof(mShadowBlocks) / sizeof(mShadowBlocks[0]), (reg))
+
+/*
+ * Register writes return false if the bus write failed. The shadow only
+ * takes the new value once the chip has acknowledged it.
+ */
+bool xgWriteByte(uint8_t subAddress, uint8_t data)
 {
 	// Write a byte using the gyro-specific I2C address
-	I2CwriteByte(_xgAddress, subAddress, data);
+	if (!I2CwriteByte(imu->xgAddress, subAddress, data))
+		return false;
+	if (xgShadowed(subAddress))
+		imu->xgShadow[subAddress] = data;
+	// BOOT and SW_RESET reload every register behind our back
+	if ((subAddress == CTRL_REG8) && (data & ((1<<7) | (1<<0))))
+		imu->xgShadowValid = false;
+	return true;
 }
 
-void mWriteByte(uint8_t subAddress, uint8_t data)
+bool mWriteByte(uint8_t subAddress, uint8_t data)
 {
 	// Write a byte using the accelerometer-specific I2C address
-	I2CwriteByte(_mAddress, subAddress, data);
+	if (!I2CwriteByte(imu->mAddress, subAddress, data))
+		return false;
+	if (mShadowed(subAddress))
+		imu->mShadow[subAddress] = data;
+	// REBOOT and SOFT_RST reload every register behind our back
+	if ((subAddress == CTRL_REG2_M) && (data & ((1<<3) | (1<<2))))
+		imu->mShadowValid = false;
+	return true;
+}
+
+/* Burst writes; the blocks written must not contain BOOT/SW_RESET bits */
+bool xgWriteBytes(uint8_t subAddress, const uint8_t * data, uint8_t count)
+{
+	uint8_t i;
+	if (!I2CwriteBytes(imu->xgAddress, subAddress, data, count))
+		return false;
+	for (i = 0; i < count; i++)
+	{
+		if (xgShadowed(subAddress + i))
+			imu->xgShadow[subAddress + i] = data[i];
+	}
+	return true;
+}
+
+bool mWriteBytes(uint8_t subAddress, const uint8_t * data, uint8_t count)
+{
+	uint8_t i;
+	if (!I2CwriteBytes(imu->mAddress, subAddress, data, count))
+		return false;
+	for (i = 0; i < count; i++)
+	{
+		if (mShadowed(subAddress + i))
+			imu->mShadow[subAddress + i] = data[i];
+	}
+	return true;
 }
 
 uint8_t xgReadByte(uint8_t subAddress)
 {
 	// Read a byte using the gyro-specific I2C address
-	return I2CreadByte(_xgAddress, subAddress);
+	return I2CreadByte(imu->xgAddress, subAddress);
 }
 
-uint8_t xgReadBytes(uint8_t subAddress, uint8_t * dest, uint8_t count)
+uint16_t xgReadBytes(uint8_t subAddress, uint8_t * dest, uint16_t count)
 {
 	// Read multiple bytes using the gyro-specific I2C address
-	return I2CreadBytes(_xgAddress, subAddress, dest, count);
+	return I2CreadBytes(imu->xgAddress, subAddress, dest, count);
 }
 
 uint8_t mReadByte(uint8_t subAddress)
 {
 	// Read a byte using the accelerometer-specific I2C address
-	return I2CreadByte(_mAddress, subAddress);
+	return I2CreadByte(imu->mAddress, subAddress);
 }
 
-uint8_t mReadBytes(uint8_t subAddress, uint8_t * dest, uint8_t count)
+uint16_t mReadBytes(uint8_t subAddress, uint8_t * dest, uint16_t count)
 {
 	// Read multiple bytes using the accelerometer-specific I2C address
-	return I2CreadBytes(_mAddress, subAddress, dest, count);
+	return I2CreadBytes(imu->mAddress, subAddress, dest, count);
+}
+
+/* Read a configuration register from the shadow, or the bus if uncached */
+uint8_t xgReadCached(uint8_t subAddress)
+{
+	if (imu->xgShadowValid && xgShadowed(subAddress))
+		return imu->xgShadow[subAddress];
+	return xgReadByte(subAddress);
+}
+
+uint8_t mReadCached(uint8_t subAddress)
+{
+	if (imu->mShadowValid && mShadowed(subAddress))
+		return imu->mShadow[subAddress];
+	return mReadByte(subAddress);
+}
+
+/* Fill the shadows with one burst read per contiguous register block */
+void loadShadowRegisters(void)
+{
+	uint8_t i;
+	imu->xgShadowValid = true;
+	for (i = 0; i < sizeof(xgShadowBlocks) / sizeof(xgShadowBlocks[0]); i++)
+	{
+		if (xgReadBytes(xgShadowBlocks[i].first, &imu->xgShadow[xgShadowBlocks[i].first],
+				xgShadowBlocks[i].count) != xgShadowBlocks[i].count)
+			imu->xgShadowValid = false;
+	}
+	imu->mShadowValid = true;
+	for (i = 0; i < sizeof(mShadowBlocks) / sizeof(mShadowBlocks[0]); i++)
+	{
+		if (mReadBytes(mShadowBlocks[i].first, &imu->mShadow[mShadowBlocks[i].first],
+				mShadowBlocks[i].count) != mShadowBlocks[i].count)
+			imu->mShadowValid = false;
+	}
+}
+
+/*
+ * Read gyro/accel frames straight into sample slots. The output registers
+ * are little-endian, as is the Cortex-M3, so each 12-byte frame lands in
+ * a slot as gx, gy, gz, ax, ay, az without decoding.
+ */
+uint8_t xgReadFrames(int16_t (*slot)[6], uint8_t frames)
+{
+	uint16_t count = frames * FIFO_FRAME_BYTES;
+	if (xgReadBytes(OUT_X_L_G, (uint8_t *)slot, count) != count)
+		return 0;
+	return frames;
 }
 
 /* ===============================================================
@@ -324,37 +518,40 @@ uint8_t mReadBytes(uint8_t subAddress, uint8_t * dest, uint8_t count)
 */
 void constrainScales(void)
 {
-	if ((settings.gyro.scale != 245) && (settings.gyro.scale != 500) &&
-		(settings.gyro.scale != 2000))
+	if ((imu->settings.gyro.scale != 245) && (imu->settings.gyro.scale != 500) &&
+		(imu->settings.gyro.scale != 2000))
 	{
-		settings.gyro.scale = 245;
+		imu->settings.gyro.scale = 245;
 	}
 
-	if ((settings.accel.scale != 2) && (settings.accel.scale != 4) &&
-		(settings.accel.scale != 8) && (settings.accel.scale != 16))
+	if ((imu->settings.accel.scale != 2) && (imu->settings.accel.scale != 4) &&
+		(imu->settings.accel.scale != 8) && (imu->settings.accel.scale != 16))
 	{
-		settings.accel.scale = 2;
+		imu->settings.accel.scale = 2;
 	}
 
-	if ((settings.mag.scale != 4) && (settings.mag.scale != 8) &&
-		(settings.mag.scale != 12) && (settings.mag.scale != 16))
+	if ((imu->settings.mag.scale != 4) && (imu->settings.mag.scale != 8) &&
+		(imu->settings.mag.scale != 12) && (imu->settings.mag.scale != 16))
 	{
-		settings.mag.scale = 4;
+		imu->settings.mag.scale = 4;
 	}
 }
 
 void calcgRes()
 {
-	switch (settings.gyro.scale)
+	switch (imu->settings.gyro.scale)
 	{
 	case 245:
-		gRes = SENSITIVITY_GYROSCOPE_245;
+		imu->gRes = SENSITIVITY_GYROSCOPE_245;
+		imu->gResQ32 = SENSITIVITY_GYROSCOPE_245_Q32;
 		break;
 	case 500:
-		gRes = SENSITIVITY_GYROSCOPE_500;
+		imu->gRes = SENSITIVITY_GYROSCOPE_500;
+		imu->gResQ32 = SENSITIVITY_GYROSCOPE_500_Q32;
 		break;
 	case 2000:
-		gRes = SENSITIVITY_GYROSCOPE_2000;
+		imu->gRes = SENSITIVITY_GYROSCOPE_2000;
+		imu->gResQ32 = SENSITIVITY_GYROSCOPE_2000_Q32;
 		break;
 	default:
 		break;
@@ -363,19 +560,23 @@ void calcgRes()
 
 void calcaRes()
 {
-	switch (settings.accel.scale)
+	switch (imu->settings.accel.scale)
 	{
 	case 2:
-		aRes = SENSITIVITY_ACCELEROMETER_2;
+		imu->aRes = SENSITIVITY_ACCELEROMETER_2;
+		imu->aResQ32 = SENSITIVITY_ACCELEROMETER_2_Q32;
 		break;
 	case 4:
-		aRes = SENSITIVITY_ACCELEROMETER_4;
+		imu->aRes = SENSITIVITY_ACCELEROMETER_4;
+		imu->aResQ32 = SENSITIVITY_ACCELEROMETER_4_Q32;
 		break;
 	case 8:
-		aRes = SENSITIVITY_ACCELEROMETER_8;
+		imu->aRes = SENSITIVITY_ACCELEROMETER_8;
+		imu->aResQ32 = SENSITIVITY_ACCELEROMETER_8_Q32;
 		break;
 	case 16:
-		aRes = SENSITIVITY_ACCELEROMETER_16;
+		imu->aRes = SENSITIVITY_ACCELEROMETER_16;
+		imu->aResQ32 = SENSITIVITY_ACCELEROMETER_16_Q32;
 		break;
 	default:
 		break;
@@ -384,19 +585,23 @@ void calcaRes()
 
 void calcmRes()
 {
-	switch (settings.mag.scale)
+	switch (imu->settings.mag.scale)
 	{
 	case 4:
-		mRes = SENSITIVITY_MAGNETOMETER_4;
+		imu->mRes = SENSITIVITY_MAGNETOMETER_4;
+		imu->mResQ32 = SENSITIVITY_MAGNETOMETER_4_Q32;
 		break;
 	case 8:
-		mRes = SENSITIVITY_MAGNETOMETER_8;
+		imu->mRes = SENSITIVITY_MAGNETOMETER_8;
+		imu->mResQ32 = SENSITIVITY_MAGNETOMETER_8_Q32;
 		break;
 	case 12:
-		mRes = SENSITIVITY_MAGNETOMETER_12;
+		imu->mRes = SENSITIVITY_MAGNETOMETER_12;
+		imu->mResQ32 = SENSITIVITY_MAGNETOMETER_12_Q32;
 		break;
 	case 16:
-		mRes = SENSITIVITY_MAGNETOMETER_16;
+		imu->mRes = SENSITIVITY_MAGNETOMETER_16;
+		imu->mResQ32 = SENSITIVITY_MAGNETOMETER_16_Q32;
 		break;
 	}
 }
@@ -418,11 +623,11 @@ void initGyro()
 
 	// To disable gyro, set sample rate bits to 0. We'll only set sample
 	// rate if the gyro is enabled.
-	if (settings.gyro.enabled)
+	if (imu->settings.gyro.enabled)
 	{
-		tempRegValue = (settings.gyro.sampleRate & 0x07) << 5;
+		tempRegValue = (imu->settings.gyro.sampleRate & 0x07) << 5;
 	}
-	switch (settings.gyro.scale)
+	switch (imu->settings.gyro.scale)
 	{
 		case 500:
 			tempRegValue |= (0x1 << 3);
@@ -432,7 +637,7 @@ void initGyro()
 			break;
 		// Otherwise we'll set it to 245 dps (0x0 << 4)
 	}
-	tempRegValue |= (settings.gyro.bandwidth & 0x3);
+	tempRegValue |= (imu->settings.gyro.bandwidth & 0x3);
 	xgWriteByte(CTRL_REG1_G, tempRegValue);
 
 	// CTRL_REG2_G (Default value: 0x00)
@@ -446,10 +651,10 @@ void initGyro()
 	// LP_mode - Low-power mode enable (0: disabled, 1: enabled)
 	// HP_EN - HPF enable (0:disabled, 1: enabled)
 	// HPCF_G[3:0] - HPF cutoff frequency
-	tempRegValue = settings.gyro.lowPowerEnable ? (1<<7) : 0;
-	if (settings.gyro.HPFEnable)
+	tempRegValue = imu->settings.gyro.lowPowerEnable ? (1<<7) : 0;
+	if (imu->settings.gyro.HPFEnable)
 	{
-		tempRegValue |= (1<<6) | (settings.gyro.HPFCutoff & 0x0F);
+		tempRegValue |= (1<<6) | (imu->settings.gyro.HPFCutoff & 0x0F);
 	}
 	xgWriteByte(CTRL_REG3_G, tempRegValue);
 
@@ -461,10 +666,10 @@ void initGyro()
 	// LIR_XL1 - Latched interrupt (0:not latched, 1:latched)
 	// 4D_XL1 - 4D option on interrupt (0:6D used, 1:4D used)
 	tempRegValue = 0;
-	if (settings.gyro.enableZ) tempRegValue |= (1<<5);
-	if (settings.gyro.enableY) tempRegValue |= (1<<4);
-	if (settings.gyro.enableX) tempRegValue |= (1<<3);
-	if (settings.gyro.latchInterrupt) tempRegValue |= (1<<1);
+	if (imu->settings.gyro.enableZ) tempRegValue |= (1<<5);
+	if (imu->settings.gyro.enableY) tempRegValue |= (1<<4);
+	if (imu->settings.gyro.enableX) tempRegValue |= (1<<3);
+	if (imu->settings.gyro.latchInterrupt) tempRegValue |= (1<<1);
 	xgWriteByte(CTRL_REG4, tempRegValue);
 
 	// ORIENT_CFG_G (Default value: 0x00)
@@ -472,9 +677,9 @@ void initGyro()
 	// SignX_G - Pitch axis (X) angular rate sign (0: positive, 1: negative)
 	// Orient [2:0] - Directional user orientation selection
 	tempRegValue = 0;
-	if (settings.gyro.flipX) tempRegValue |= (1<<5);
-	if (settings.gyro.flipY) tempRegValue |= (1<<4);
-	if (settings.gyro.flipZ) tempRegValue |= (1<<3);
+	if (imu->settings.gyro.flipX) tempRegValue |= (1<<5);
+	if (imu->settings.gyro.flipY) tempRegValue |= (1<<4);
+	if (imu->settings.gyro.flipZ) tempRegValue |= (1<<3);
 	xgWriteByte(ORIENT_CFG_G, tempRegValue);
 }
 
@@ -489,9 +694,9 @@ void initAccel()
 	//	Zen_XL - Z-axis output enabled
 	//	Yen_XL - Y-axis output enabled
 	//	Xen_XL - X-axis output enabled
-	if (settings.accel.enableZ) tempRegValue |= (1<<5);
-	if (settings.accel.enableY) tempRegValue |= (1<<4);
-	if (settings.accel.enableX) tempRegValue |= (1<<3);
+	if (imu->settings.accel.enableZ) tempRegValue |= (1<<5);
+	if (imu->settings.accel.enableY) tempRegValue |= (1<<4);
+	if (imu->settings.accel.enableX) tempRegValue |= (1<<3);
 
 	xgWriteByte(CTRL_REG5_XL, tempRegValue);
 
@@ -503,11 +708,11 @@ void initAccel()
 	// BW_XL[1:0] - Anti-aliasing filter bandwidth selection
 	tempRegValue = 0;
 	// To disable the accel, set the sampleRate bits to 0.
-	if (settings.accel.enabled)
+	if (imu->settings.accel.enabled)
 	{
-		tempRegValue |= (settings.accel.sampleRate & 0x07) << 5;
+		tempRegValue |= (imu->settings.accel.sampleRate & 0x07) << 5;
 	}
-	switch (settings.accel.scale)
+	switch (imu->settings.accel.scale)
 	{
 		case 4:
 			tempRegValue |= (0x2 << 3);
@@ -520,10 +725,10 @@ void initAccel()
 			break;
 		// Otherwise it'll be set to 2g (0x0 << 3)
 	}
-	if (settings.accel.bandwidth >= 0)
+	if (imu->settings.accel.bandwidth >= 0)
 	{
 		tempRegValue |= (1<<2); // Set BW_SCAL_ODR
-		tempRegValue |= (settings.accel.bandwidth & 0x03);
+		tempRegValue |= (imu->settings.accel.bandwidth & 0x03);
 	}
 	xgWriteByte(CTRL_REG6_XL, tempRegValue);
 
@@ -534,10 +739,10 @@ void initAccel()
 	// FDS - Filtered data selection
 	// HPIS1 - HPF enabled for interrupt function
 	tempRegValue = 0;
-	if (settings.accel.highResEnable)
+	if (imu->settings.accel.highResEnable)
 	{
 		tempRegValue |= (1<<7); // Set HR bit
-		tempRegValue |= (settings.accel.highResBandwidth & 0x3) << 5;
+		tempRegValue |= (imu->settings.accel.highResBandwidth & 0x3) << 5;
 	}
 	xgWriteByte(CTRL_REG7_XL, tempRegValue);
 }
@@ -554,9 +759,9 @@ void initMag()
 	//	10: high performance, 11:ultra-high performance
 	// DO[2:0] - Output data rate selection
 	// ST - Self-test enable
-	if (settings.mag.tempCompensationEnable) tempRegValue |= (1<<7);
-	tempRegValue |= (settings.mag.XYPerformance & 0x3) << 5;
-	tempRegValue |= (settings.mag.sampleRate & 0x7) << 2;
+	if (imu->settings.mag.tempCompensationEnable) tempRegValue |= (1<<7);
+	tempRegValue |= (imu->settings.mag.XYPerformance & 0x3) << 5;
+	tempRegValue |= (imu->settings.mag.sampleRate & 0x7) << 2;
 	mWriteByte(CTRL_REG1_M, tempRegValue);
 
 	// CTRL_REG2_M (Default value 0x00)
@@ -565,7 +770,7 @@ void initMag()
 	// REBOOT - Reboot memory content (0:normal, 1:reboot)
 	// SOFT_RST - Reset config and user registers (0:default, 1:reset)
 	tempRegValue = 0;
-	switch (settings.mag.scale)
+	switch (imu->settings.mag.scale)
 	{
 	case 8:
 		tempRegValue |= (0x1 << 5);
@@ -589,8 +794,8 @@ void initMag()
 	//	00:continuous conversion, 01:single-conversion,
 	//  10,11: Power-down
 	tempRegValue = 0;
-	if (settings.mag.lowPowerEnable) tempRegValue |= (1<<5);
-	tempRegValue |= (settings.mag.operatingMode & 0x3);
+	if (imu->settings.mag.lowPowerEnable) tempRegValue |= (1<<5);
+	tempRegValue |= (imu->settings.mag.operatingMode & 0x3);
 	mWriteByte(CTRL_REG3_M, tempRegValue); // Continuous conversion mode
 
 	// CTRL_REG4_M (Default value: 0x00)
@@ -600,7 +805,7 @@ void initMag()
 	//	10:high performance, 10:ultra-high performance
 	// BLE - Big/little endian data
 	tempRegValue = 0;
-	tempRegValue = (settings.mag.ZPerformance & 0x3) << 2;
+	tempRegValue = (imu->settings.mag.ZPerformance & 0x3) << 2;
 	mWriteByte(CTRL_REG4_M, tempRegValue);
 
 	// CTRL_REG5_M (Default value: 0x00)
@@ -611,6 +816,16 @@ void initMag()
 	mWriteByte(CTRL_REG5_M, tempRegValue);
 }
 
+/* Write the compile-time register images, one burst per block */
+bool writeConfigImages(void)
+{
+	bool ok = true;
+	ok &= xgWriteBytes(CTRL_REG1_G, xgGyroImage, sizeof(xgGyroImage));
+	ok &= xgWriteBytes(CTRL_REG4, xgAccelImage, sizeof(xgAccelImage));
+	ok &= mWriteBytes(CTRL_REG1_M, mImage, sizeof(mImage));
+	return ok;
+}
+
 /*
  * ==============================================================
  * ===================== Read Sensors ===========================
@@ -621,21 +836,21 @@ void readGyro()
 	uint8_t temp[6]; // We'll read six bytes from the gyro into temp
 	if ( xgReadBytes(OUT_X_L_G, temp, 6) == 6) //Read 6 bytes, start at OUT_X_L_G
 	{
-		gx = (temp[1] << 8) | temp[0]; // Store x-axis values into gx
-		gy = (temp[3] << 8) | temp[2]; // Store y-axis values into gy
-		gz = (temp[5] << 8) | temp[4]; // Store z-axis values into gz
-		if (_autoCalc)
+		imu->gx = (temp[1] << 8) | temp[0]; // Store x-axis values into gx
+		imu->gy = (temp[3] << 8) | temp[2]; // Store y-axis values into gy
+		imu->gz = (temp[5] << 8) | temp[4]; // Store z-axis values into gz
+		if (imu->autoCalc)
 		{
-			gx -= gBiasRaw[X_AXIS];
-			gy -= gBiasRaw[Y_AXIS];
-			gz -= gBiasRaw[Z_AXIS];
+			imu->gx -= imu->gBiasRaw[X_AXIS];
+			imu->gy -= imu->gBiasRaw[Y_AXIS];
+			imu->gz -= imu->gBiasRaw[Z_AXIS];
 		}
 	}
 }
 
 void sleepGyro(bool enable)
 {
-	uint8_t temp = xgReadByte(CTRL_REG9);
+	uint8_t temp = xgReadCached(CTRL_REG9);
 	if (enable) temp |= (1<<6);
 	else temp &= ~(1<<6);
 	xgWriteByte(CTRL_REG9, temp);
@@ -646,26 +861,177 @@ void readAccel()
 	uint8_t temp[6]; // We'll read six bytes from the accelerometer into temp
 	if ( xgReadBytes(OUT_X_L_XL, temp, 6) == 6 )//Read 6 bytes, start at OUT_X_L_XL
 	{
-		ax = (temp[1] << 8) | temp[0]; // Store x-axis values into ax
-		ay = (temp[3] << 8) | temp[2]; // Store y-axis values into ay
-		az = (temp[5] << 8) | temp[4]; // Store z-axis values into az
-		if (_autoCalc)
+		imu->ax = (temp[1] << 8) | temp[0]; // Store x-axis values into ax
+		imu->ay = (temp[3] << 8) | temp[2]; // Store y-axis values into ay
+		imu->az = (temp[5] << 8) | temp[4]; // Store z-axis values into az
+		if (imu->autoCalc)
 		{
-			ax -= aBiasRaw[X_AXIS];
-			ay -= aBiasRaw[Y_AXIS];
-			az -= aBiasRaw[Z_AXIS];
+			imu->ax -= imu->aBiasRaw[X_AXIS];
+			imu->ay -= imu->aBiasRaw[Y_AXIS];
+			imu->az -= imu->aBiasRaw[Z_AXIS];
 		}
 	}
 }
 
+/* The frame helpers take the device explicitly, they also run from the
+ * I2C completion callback where the selection may belong to a task */
+static void applyGyroAccelBias(LSM9DS1_Device *dev, int16_t *frame)
+{
+	// Thermal model first, the tracked bias takes out what it leaves
+	tempCompApply(&dev->tempComp, frame);
+	if (dev->autoCalc)
+	{
+		frame[0] -= dev->gBiasRaw[X_AXIS];
+		frame[1] -= dev->gBiasRaw[Y_AXIS];
+		frame[2] -= dev->gBiasRaw[Z_AXIS];
+		frame[3] -= dev->aBiasRaw[X_AXIS];
+		frame[4] -= dev->aBiasRaw[Y_AXIS];
+		frame[5] -= dev->aBiasRaw[Z_AXIS];
+	}
+}
+
+static void publishGyroAccel(LSM9DS1_Device *dev, const int16_t *frame)
+{
+	dev->gx = frame[0];
+	dev->gy = frame[1];
+	dev->gz = frame[2];
+	dev->ax = frame[3];
+	dev->ay = frame[4];
+	dev->az = frame[5];
+}
+
+static uint32_t devGyroPeriodTicks(LSM9DS1_Device *dev)
+{
+	return gyroODRPeriodUs[dev->settings.gyro.sampleRate & 0x07] / Clock_tickPeriod;
+}
+
+/* Current gyro sample period in Clock ticks */
+uint32_t gyroPeriodTicks(void)
+{
+	return devGyroPeriodTicks(imu);
+}
+
+/*
+ * Bias-correct frames the bus has written into reserved ring slots and
+ * publish them, the first stamped at stamp.
+ */
+static void commitGyroAccel(LSM9DS1_Device *dev, int16_t (*slot)[6],
+		uint8_t frames, uint32_t stamp)
+{
+	int16_t mag[3];
+	uint8_t i;
+
+	for (i = 0; i < frames; i++)
+	{
+		applyGyroAccelBias(dev, slot[i]);
+	}
+	mag[0] = dev->mx;
+	mag[1] = dev->my;
+	mag[2] = dev->mz;
+	imuRingCommit(dev->ring, frames, stamp, devGyroPeriodTicks(dev), mag);
+
+	/* Keep the latest frame in the device readings */
+	publishGyroAccel(dev, slot[frames-1]);
+
+	/* Output registers read back zero until the first conversion */
+	if ((dev->bootTime == 0) && (slot[0][3] | slot[0][4] | slot[0][5]))
+		dev->bootTime = Timestamp_get32() - dev->bootStart;
+}
+
+void readGyroAccel()
+{
+	// With both sensors active the register pointer rolls over from
+	// OUT_Z_H_G to OUT_X_L_XL, so one 12-byte burst returns the gyro and
+	// accel samples taken at the same instant.
+	uint8_t frames = 1;
+	int16_t (*slot)[6] = imuRingReserve(imu->ring, &frames);
+	uint32_t stamp = Clock_getTicks();
+	if ( xgReadFrames(slot, 1) == 1) // Read 12 bytes, start at OUT_X_L_G
+	{
+		commitGyroAccel(imu, slot, 1, stamp);
+	}
+}
+
+static void readGyroAccelDone(bool status, UArg arg)
+{
+	LSM9DS1_Device *dev = (LSM9DS1_Device *)arg;
+
+	if (status)
+	{
+		commitGyroAccel(dev, dev->xgAsyncSlot, 1, dev->xgAsyncStamp);
+	}
+	dev->xgAsyncPending = false;
+	if (dev->xgAsyncEvent)
+		Event_post(dev->xgAsyncEvent, dev->xgAsyncEventId);
+}
+
+/*
+ * Queue the same 12-byte burst as readGyroAccel() on dev without blocking,
+ * into its next ring slot. Safe to call from the pin interrupt; eventId is
+ * posted to event (may be NULL) once the frame is published. Reads queued for
+ * several devices go out back to back and complete in order.
+ */
+bool readGyroAccelAsync(LSM9DS1_Device *dev, Event_Handle event, UInt eventId)
+{
+	uint8_t txBuffer[1];
+	uint8_t frames = 1;
+
+	if (dev->xgAsyncPending)
+	{
+		dev->xgAsyncDropped++;
+		return false;
+	}
+	dev->xgAsyncPending = true;
+	dev->xgAsyncStamp = Clock_getTicks();
+	dev->xgAsyncEvent = event;
+	dev->xgAsyncEventId = eventId;
+	dev->xgAsyncSlot = imuRingReserve(dev->ring, &frames);
+
+	txBuffer[0] = OUT_X_L_G | 0x80;
+	if (!i2cQueuePost(dev->xgAddress, txBuffer, 1, (uint8_t *)dev->xgAsyncSlot, 12,
+			readGyroAccelDone, (UArg)dev))
+	{
+		dev->xgAsyncPending = false;
+		dev->xgAsyncDropped++;
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Queue the gyro/accel burst of every sensor that answered, interleaved on
+ * the bus. eventId is posted once the last one is published.
+ */
+void readGyroAccelAllAsync(Event_Handle event, UInt eventId)
+{
+	int8_t i, last = -1;
+
+	for (i = 0; i < LSM9DS1_DEVICE_COUNT; i++)
+	{
+		if (imuDevices[i].present) last = i;
+	}
+	for (i = 0; i <= last; i++)
+	{
+		if (imuDevices[i].present)
+			readGyroAccelAsync(&imuDevices[i], (i == last) ? event : NULL, eventId);
+	}
+}
+
 void readMag()
 {
 	uint8_t temp[6]; // We'll read six bytes from the mag into temp
+	int16_t corrected[3];
 	if ( mReadBytes(OUT_X_L_M, temp, 6) == 6) // Read 6 bytes, beginning at OUT_X_L_M
 	{
-		mx = (temp[1] << 8) | temp[0]; // Store x-axis values into mx
-		my = (temp[3] << 8) | temp[2]; // Store y-axis values into my
-		mz = (temp[5] << 8) | temp[4]; // Store z-axis values into mz
+		imu->mRaw[0] = (temp[1] << 8) | temp[0]; // Store x-axis values into mRaw
+		imu->mRaw[1] = (temp[3] << 8) | temp[2]; // Store y-axis values into mRaw
+		imu->mRaw[2] = (temp[5] << 8) | temp[4]; // Store z-axis values into mRaw
+		// Feed the ellipsoid fit, then apply the current soft-iron correction
+		magCalAccumulate(&imu->magCal, imu->mRaw);
+		magCalApply(&imu->magCal, imu->mRaw, corrected);
+		imu->mx = corrected[0];
+		imu->my = corrected[1];
+		imu->mz = corrected[2];
 	}
 }
 
@@ -674,12 +1040,19 @@ void readTemp()
 	uint8_t temp[2]; // We'll read two bytes from the temperature sensor into temp
 	if ( xgReadBytes(OUT_TEMP_L, temp, 2) == 2 ) // Read 2 bytes, start at OUT_TEMP_L
 	{
-		temperature = (temp[1] << 8) | temp[0];
-		temp_l = temp[0];
-		temp_h = temp[1];
+		imu->temperature = (temp[1] << 8) | temp[0];
+		imu->temp_l = temp[0];
+		imu->temp_h = temp[1];
+		tempCompUpdate(&imu->tempComp, imu->temperature);
 	}
 }
 
+/* Load a thermal calibration table, false if its scale is implausible */
+bool loadTempCoeffs(const IMU_TempCoeffs *coeffs)
+{
+	return tempCompLoad(&imu->tempComp, coeffs);
+}
+
 /*
  * ==============================================================
  * ===================== FIFO helpers ===========================
@@ -687,7 +1060,7 @@ void readTemp()
  */
 void enableFIFO(bool enable)
 {
-	uint8_t temp = xgReadByte(CTRL_REG9);
+	uint8_t temp = xgReadCached(CTRL_REG9);
 	if (enable) temp |= (1<<1);
 	else temp &= ~(1<<1);
 	xgWriteByte(CTRL_REG9, temp);
@@ -706,87 +1079,127 @@ uint8_t getFIFOSamples()
 	return (xgReadByte(FIFO_SRC) & 0x3F);
 }
 
+/*
+ * Drain every gyro/accel frame held in the FIFO straight into the IMU
+ * ring, using one burst read (two if the ring wraps). thsTick is the
+ * Clock tick at which the FTH interrupt fired, i.e. when the FIFO reached
+ * fifoThs frames. Each frame is stamped relative to it using the gyro
+ * ODR. Returns the number of frames published.
+ */
+uint8_t readFIFOFrames(uint8_t fifoThs, uint32_t thsTick)
+{
+	uint8_t count = getFIFOSamples();
+	uint32_t period = gyroPeriodTicks();
+	uint32_t stamp = thsTick - ((int32_t)fifoThs - 1) * (int32_t)period;
+	uint8_t published = 0;
+
+	if (count > FIFO_MAX_FRAMES) count = FIFO_MAX_FRAMES;
+
+	while (published < count)
+	{
+		uint8_t frames = count - published;
+		int16_t (*slot)[6] = imuRingReserve(imu->ring, &frames);
+
+		if (xgReadFrames(slot, frames) != frames)
+			break;
+		commitGyroAccel(imu, slot, frames, stamp + published * period);
+		published += frames;
+	}
+
+	return published;
+}
+
 
 
 /* ===============================================================
  * =================== Interrupt/Threshold =======================
  * ===============================================================
 */
-//void configAccelInt(uint8_t generator, bool andInterrupts)
-//{
-//	// Use variables from accel_interrupt_generator, OR'd together to create
-//	// the [generator]value.
-//	uint8_t temp = generator;
-//	if (andInterrupts) temp |= 0x80;
-//	xgWriteByte(INT_GEN_CFG_XL, temp);
-//}
-//
-//void configAccelThs(uint8_t threshold, lsm9ds1_axis axis, uint8_t duration, bool wait)
-//{
-//	// Write threshold value to INT_GEN_THS_?_XL.
-//	// axis will be 0, 1, or 2 (x, y, z respectively)
-//	xgWriteByte(INT_GEN_THS_X_XL + axis, threshold);
-//
-//	// Write duration and wait to INT_GEN_DUR_XL
-//	uint8_t temp;
-//	temp = (duration & 0x7F);
-//	if (wait) temp |= 0x80;
-//	xgWriteByte(INT_GEN_DUR_XL, temp);
-//}
-//
-//uint8_t getAccelIntSrc()
-//{
-//	uint8_t intSrc = xgReadByte(INT_GEN_SRC_XL);
-//
-//	// Check if the IA_XL (interrupt active) bit is set
-//	if (intSrc & (1<<6))
-//	{
-//		return (intSrc & 0x3F);
-//	}
-//
-//	return 0;
-//}
-//
-//void configGyroInt(uint8_t generator, bool aoi, bool latch)
-//{
-//	// Use variables from accel_interrupt_generator, OR'd together to create
-//	// the [generator]value.
-//	uint8_t temp = generator;
-//	if (aoi) temp |= 0x80;
-//	if (latch) temp |= 0x40;
-//	xgWriteByte(INT_GEN_CFG_G, temp);
-//}
+void configAccelInt(uint8_t generator, bool andInterrupts)
+{
+	// Use variables from accel_interrupt_generator, OR'd together to create
+	// the [generator]value.
+	uint8_t temp = generator;
+	if (andInterrupts) temp |= 0x80;
+	xgWriteByte(INT_GEN_CFG_XL, temp);
+}
+
+void configAccelThs(uint8_t threshold, lsm9ds1_axis axis, uint8_t duration, bool wait)
+{
+	// Write threshold value to INT_GEN_THS_?_XL.
+	// axis will be 0, 1, or 2 (x, y, z respectively)
+	xgWriteByte(INT_GEN_THS_X_XL + axis, threshold);
+
+	// Write duration and wait to INT_GEN_DUR_XL
+	uint8_t temp;
+	temp = (duration & 0x7F);
+	if (wait) temp |= 0x80;
+	xgWriteByte(INT_GEN_DUR_XL, temp);
+}
+
+/* Run the accel interrupt generator on high-pass filtered data, so a
+ * threshold catches motion rather than gravity */
+void configAccelIntHPF(bool enable)
+{
+	uint8_t temp = xgReadCached(CTRL_REG7_XL);
+	if (enable) temp |= (1<<0);
+	else temp &= ~(1<<0);
+	xgWriteByte(CTRL_REG7_XL, temp);
+}
+
+uint8_t getAccelIntSrc()
+{
+	uint8_t intSrc = xgReadByte(INT_GEN_SRC_XL);
+
+	// Check if the IA_XL (interrupt active) bit is set
+	if (intSrc & (1<<6))
+	{
+		return (intSrc & 0x3F);
+	}
+
+	return 0;
+}
+
+void configGyroInt(uint8_t generator, bool aoi, bool latch)
+{
+	// Use variables from accel_interrupt_generator, OR'd together to create
+	// the [generator]value.
+	uint8_t temp = generator;
+	if (aoi) temp |= 0x80;
+	if (latch) temp |= 0x40;
+	xgWriteByte(INT_GEN_CFG_G, temp);
+}
+
+void configGyroThs(int16_t threshold, lsm9ds1_axis axis, uint8_t duration, bool wait)
+{
+	uint8_t buffer[2];
+	buffer[0] = (threshold & 0x7F00) >> 8;
+	buffer[1] = (threshold & 0x00FF);
+	// Write threshold value to INT_GEN_THS_?H_G and  INT_GEN_THS_?L_G.
+	// axis will be 0, 1, or 2 (x, y, z respectively)
+	xgWriteByte(INT_GEN_THS_XH_G + (axis * 2), buffer[0]);
+	xgWriteByte(INT_GEN_THS_XH_G + 1 + (axis * 2), buffer[1]);
+
+	// Write duration and wait to INT_GEN_DUR_XL
+	uint8_t temp;
+	temp = (duration & 0x7F);
+	if (wait) temp |= 0x80;
+	xgWriteByte(INT_GEN_DUR_G, temp);
+}
+
+uint8_t getGyroIntSrc()
+{
+	uint8_t intSrc = xgReadByte(INT_GEN_SRC_G);
+
+	// Check if the IA_G (interrupt active) bit is set
+	if (intSrc & (1<<6))
+	{
+		return (intSrc & 0x3F);
+	}
+
+	return 0;
+}
 
-//void configGyroThs(int16_t threshold, lsm9ds1_axis axis, uint8_t duration, bool wait)
-//{
-//	uint8_t buffer[2];
-//	buffer[0] = (threshold & 0x7F00) >> 8;
-//	buffer[1] = (threshold & 0x00FF);
-//	// Write threshold value to INT_GEN_THS_?H_G and  INT_GEN_THS_?L_G.
-//	// axis will be 0, 1, or 2 (x, y, z respectively)
-//	xgWriteByte(INT_GEN_THS_XH_G + (axis * 2), buffer[0]);
-//	xgWriteByte(INT_GEN_THS_XH_G + 1 + (axis * 2), buffer[1]);
-//
-//	// Write duration and wait to INT_GEN_DUR_XL
-//	uint8_t temp;
-//	temp = (duration & 0x7F);
-//	if (wait) temp |= 0x80;
-//	xgWriteByte(INT_GEN_DUR_G, temp);
-//}
-//
-//uint8_t getGyroIntSrc()
-//{
-//	uint8_t intSrc = xgReadByte(INT_GEN_SRC_G);
-//
-//	// Check if the IA_G (interrupt active) bit is set
-//	if (intSrc & (1<<6))
-//	{
-//		return (intSrc & 0x3F);
-//	}
-//
-//	return 0;
-//}
-//
 //void configMagInt(uint8_t generator, h_lactive activeLow, bool latch)
 //{
 //	// Mask out non-generator bits (0-4)
@@ -832,7 +1245,7 @@ void configInt(interrupt_select intpt, uint8_t generator,
 
 	// Configure CTRL_REG8
 	uint8_t temp;
-	temp = xgReadByte(CTRL_REG8);
+	temp = xgReadCached(CTRL_REG8);
 
 	if (activeLow) temp |= (1<<5);
 	else temp &= ~(1<<5);
@@ -842,27 +1255,39 @@ void configInt(interrupt_select intpt, uint8_t generator,
 
 	xgWriteByte(CTRL_REG8, temp);
 }
-//
-///*
-// * Inactivity
-// */
-//void configInactivity(uint8_t duration, uint8_t threshold, bool sleepOn)
-//{
-//	uint8_t temp = 0;
-//
-//	temp = threshold & 0x7F;
-//	if (sleepOn) temp |= (1<<7);
-//	xgWriteByte(ACT_THS, temp);
-//
-//	xgWriteByte(ACT_DUR, duration);
-//}
-//
-//uint8_t getInactivity()
-//{
-//	uint8_t temp = xgReadByte(STATUS_REG_0);
-//	temp &= (0x10);
-//	return temp;
-//}
+
+/*
+ * Batch gyro/accel samples in the FIFO and raise INT_FTH on the XG INT2
+ * pin once fifoThs frames are stored, instead of a DRDY per sample.
+ */
+void configFIFOMode(uint8_t fifoThs)
+{
+	setFIFO(FIFO_OFF, 0x00);	// Bypass mode clears any stale frames
+	enableFIFO(true);
+	setFIFO(FIFO_CONT, fifoThs);
+	configInt(XG_INT2, INT_FTH, INT_ACTIVE_HIGH, INT_PUSH_PULL);
+}
+
+/*
+ * Inactivity
+ */
+void configInactivity(uint8_t duration, uint8_t threshold, bool sleepOn)
+{
+	uint8_t temp = 0;
+
+	temp = threshold & 0x7F;
+	if (sleepOn) temp |= (1<<7);
+	xgWriteByte(ACT_THS, temp);
+
+	xgWriteByte(ACT_DUR, duration);
+}
+
+uint8_t getInactivity()
+{
+	uint8_t temp = xgReadByte(STATUS_REG_0);
+	temp &= (0x10);
+	return temp;
+}
 
 /* ===============================================================
  * =================== ODR =======================================
@@ -874,14 +1299,14 @@ void setGyroODR(uint8_t gRate)
 	if ((gRate & 0x07) != 0)
 	{
 		// We need to preserve the other bytes in CTRL_REG1_G. So, first read it:
-		uint8_t temp = xgReadByte(CTRL_REG1_G);
+		uint8_t temp = xgReadCached(CTRL_REG1_G);
 		// Then mask out the gyro ODR bits:
 		temp &= 0xFF^(0x7 << 5);
 		temp |= (gRate & 0x07) << 5;
-		// Update our settings struct
-		settings.gyro.sampleRate = gRate & 0x07;
-		// And write the new register value back into CTRL_REG1_G:
-		xgWriteByte(CTRL_REG1_G, temp);
+		// Write the new register value back into CTRL_REG1_G, and update
+		// our settings struct once the sensor has it:
+		if (xgWriteByte(CTRL_REG1_G, temp))
+			imu->settings.gyro.sampleRate = gRate & 0x07;
 	}
 }
 
@@ -891,28 +1316,28 @@ void setAccelODR(uint8_t aRate)
 	if ((aRate & 0x07) != 0)
 	{
 		// We need to preserve the other bytes in CTRL_REG1_XM. So, first read it:
-		uint8_t temp = xgReadByte(CTRL_REG6_XL);
+		uint8_t temp = xgReadCached(CTRL_REG6_XL);
 		// Then mask out the accel ODR bits:
 		temp &= 0x1F;
 		// Then shift in our new ODR bits:
 		temp |= ((aRate & 0x07) << 5);
-		settings.accel.sampleRate = aRate & 0x07;
 		// And write the new register value back into CTRL_REG1_XM:
-		xgWriteByte(CTRL_REG6_XL, temp);
+		if (xgWriteByte(CTRL_REG6_XL, temp))
+			imu->settings.accel.sampleRate = aRate & 0x07;
 	}
 }
 
 void setMagODR(uint8_t mRate)
 {
 	// We need to preserve the other bytes in CTRL_REG5_XM. So, first read it:
-	uint8_t temp = mReadByte(CTRL_REG1_M);
+	uint8_t temp = mReadCached(CTRL_REG1_M);
 	// Then mask out the mag ODR bits:
 	temp &= 0xFF^(0x7 << 2);
 	// Then shift in our new ODR bits:
 	temp |= ((mRate & 0x07) << 2);
-	settings.mag.sampleRate = mRate & 0x07;
 	// And write the new register value back into CTRL_REG5_XM:
-	mWriteByte(CTRL_REG1_M, temp);
+	if (mWriteByte(CTRL_REG1_M, temp))
+		imu->settings.mag.sampleRate = mRate & 0x07;
 }
 
 
@@ -923,39 +1348,65 @@ void setMagODR(uint8_t mRate)
 float calcGyro(int16_t gyro)
 {
 	// Return the gyro raw reading times our pre-calculated DPS / (ADC tick):
-	return gRes * gyro;
+	return imu->gRes * gyro;
 }
 
 float calcAccel(int16_t accel)
 {
 	// Return the accel raw reading times our pre-calculated g's / (ADC tick):
-	return -1*aRes * accel;
+	return -1*imu->aRes * accel;
 }
 
 float calcMag(int16_t mag)
 {
 	// Return the mag raw reading times our pre-calculated Gs / (ADC tick):
-	return mRes * mag;
+	return imu->mRes * mag;
+}
+
+/*
+ * Fixed-point conversions. They return dps, g and gauss in Q16.16 using
+ * one 32x32->64 multiply (SMULL on the M3) instead of soft-float code.
+ * The result is raw * sensitivity * 2^16 rounded to the nearest integer,
+ * except that the Q32 sensitivity carries at most 0.5 LSB of rounding. For
+ * |raw| <= 32768 the error against the exact product is therefore at most
+ * 0.25 + 0.5 = 0.75 Q16 LSB (1.2e-5 units). The single-precision calc*()
+ * path is within 0.1 LSB for accel and mag but up to 8 LSB for the gyro
+ * at full scale.
+ */
+int32_t calcGyroQ16(int16_t gyro)
+{
+	return (int32_t)(((int64_t)gyro * imu->gResQ32 + 0x8000) >> 16);
+}
+
+int32_t calcAccelQ16(int16_t accel)
+{
+	// Same sign convention as calcAccel()
+	return -(int32_t)(((int64_t)accel * imu->aResQ32 + 0x8000) >> 16);
+}
+
+int32_t calcMagQ16(int16_t mag)
+{
+	return (int32_t)(((int64_t)mag * imu->mResQ32 + 0x8000) >> 16);
 }
 
 void setGyroScale(uint16_t gScl)
 {
 	// Read current value of CTRL_REG1_G:
-	uint8_t ctrl1RegValue = xgReadByte(CTRL_REG1_G);
+	uint8_t ctrl1RegValue = xgReadCached(CTRL_REG1_G);
 	// Mask out scale bits (3 & 4):
 	ctrl1RegValue &= 0xE7;
 	switch (gScl)
 	{
 		case 500:
 			ctrl1RegValue |= (0x1 << 3);
-			settings.gyro.scale = 500;
+			imu->settings.gyro.scale = 500;
 			break;
 		case 2000:
 			ctrl1RegValue |= (0x3 << 3);
-			settings.gyro.scale = 2000;
+			imu->settings.gyro.scale = 2000;
 			break;
 		default: // Otherwise we'll set it to 245 dps (0x0 << 4)
-			settings.gyro.scale = 245;
+			imu->settings.gyro.scale = 245;
 			break;
 	}
 	xgWriteByte(CTRL_REG1_G, ctrl1RegValue);
@@ -966,7 +1417,7 @@ void setGyroScale(uint16_t gScl)
 void setAccelScale(uint8_t aScl)
 {
 	// We need to preserve the other bytes in CTRL_REG6_XL. So, first read it:
-	uint8_t tempRegValue = xgReadByte(CTRL_REG6_XL);
+	uint8_t tempRegValue = xgReadCached(CTRL_REG6_XL);
 	// Mask out accel scale bits:
 	tempRegValue &= 0xE7;
 
@@ -974,18 +1425,18 @@ void setAccelScale(uint8_t aScl)
 	{
 		case 4:
 			tempRegValue |= (0x2 << 3);
-			settings.accel.scale = 4;
+			imu->settings.accel.scale = 4;
 			break;
 		case 8:
 			tempRegValue |= (0x3 << 3);
-			settings.accel.scale = 8;
+			imu->settings.accel.scale = 8;
 			break;
 		case 16:
 			tempRegValue |= (0x1 << 3);
-			settings.accel.scale = 16;
+			imu->settings.accel.scale = 16;
 			break;
 		default: // Otherwise it'll be set to 2g (0x0 << 3)
-			settings.accel.scale = 2;
+			imu->settings.accel.scale = 2;
 			break;
 	}
 	xgWriteByte(CTRL_REG6_XL, tempRegValue);
@@ -997,7 +1448,7 @@ void setAccelScale(uint8_t aScl)
 void setMagScale(uint8_t mScl)
 {
 	// We need to preserve the other bytes in CTRL_REG6_XM. So, first read it:
-	uint8_t temp = mReadByte(CTRL_REG2_M);
+	uint8_t temp = mReadCached(CTRL_REG2_M);
 	// Then mask out the mag scale bits:
 	temp &= 0xFF^(0x3 << 5);
 
@@ -1005,18 +1456,18 @@ void setMagScale(uint8_t mScl)
 	{
 	case 8:
 		temp |= (0x1 << 5);
-		settings.mag.scale = 8;
+		imu->settings.mag.scale = 8;
 		break;
 	case 12:
 		temp |= (0x2 << 5);
-		settings.mag.scale = 12;
+		imu->settings.mag.scale = 12;
 		break;
 	case 16:
 		temp |= (0x3 << 5);
-		settings.mag.scale = 16;
+		imu->settings.mag.scale = 16;
 		break;
 	default: // Otherwise we'll default to 4 gauss (00)
-		settings.mag.scale = 4;
+		imu->settings.mag.scale = 4;
 		break;
 	}
 
@@ -1078,6 +1529,7 @@ void magOffset(uint8_t axis, int16_t offset)
 	lsb = offset & 0x00FF;
 	mWriteByte(OFFSET_X_REG_L_M + (2 * axis), lsb);
 	mWriteByte(OFFSET_X_REG_H_M + (2 * axis), msb);
+	magCalSetHardwareOffset(&imu->magCal, axis, offset);
 }
 
 // This is a function that uses the FIFO to accumulate sample of accelerometer and gyro data, average
@@ -1105,26 +1557,26 @@ void calibrate(bool autoCalc)
 	for(ii = 0; ii < samples ; ii++)
 	{	// Read the gyro data stored in the FIFO
 		readGyro();
-		gBiasRawTemp[0] += gx;
-		gBiasRawTemp[1] += gy;
-		gBiasRawTemp[2] += gz;
+		gBiasRawTemp[0] += imu->gx;
+		gBiasRawTemp[1] += imu->gy;
+		gBiasRawTemp[2] += imu->gz;
 		readAccel();
-		aBiasRawTemp[0] += ax;
-		aBiasRawTemp[1] += ay;
-		aBiasRawTemp[2] += az - (int16_t)(1./aRes); // Assumes sensor facing up!
+		aBiasRawTemp[0] += imu->ax;
+		aBiasRawTemp[1] += imu->ay;
+		aBiasRawTemp[2] += imu->az - (int16_t)(1./imu->aRes); // Assumes sensor facing up!
 	}
 	for (ii = 0; ii < 3; ii++)
 	{
-		gBiasRaw[ii] = gBiasRawTemp[ii] / samples;
-		gBias[ii] = calcGyro(gBiasRaw[ii]);
-		aBiasRaw[ii] = aBiasRawTemp[ii] / samples;
-		aBias[ii] = calcAccel(aBiasRaw[ii]);
+		imu->gBiasRaw[ii] = gBiasRawTemp[ii] / samples;
+		imu->gBias[ii] = calcGyro(imu->gBiasRaw[ii]);
+		imu->aBiasRaw[ii] = aBiasRawTemp[ii] / samples;
+		imu->aBias[ii] = calcAccel(imu->aBiasRaw[ii]);
 	}
 
 //	enableFIFO(false);
 //	setFIFO(FIFO_OFF, 0x00);
 
-	if (autoCalc) _autoCalc = true;
+	if (autoCalc) imu->autoCalc = true;
 }
 
 void getMagInitial()
@@ -1136,9 +1588,9 @@ void getMagInitial()
 	for(ii = 0; ii < samples ; ii++)
 	{
 		readMag();
-		mcalib[0] += mx;
-		mcalib[1] += my;
-		mcalib[2] += mz;
+		mcalib[0] += imu->mx;
+		mcalib[1] += imu->my;
+		mcalib[2] += imu->mz;
 		readAccel();
 	}
 	MXN = mcalib[0]/samples;
@@ -1147,35 +1599,38 @@ void getMagInitial()
 
 }
 
-void calibrateMag(bool loadIn)
+// Takes the centre of the current mag correction as the mag bias. Does not
+// touch the bus unless loadIn is set, in which case the offset is moved into
+// the sensor's offset registers.
+static void loadMagBias(bool loadIn)
 {
-	int i, j;
-	int16_t magMin[3] = {0, 0, 0};
-	int16_t magMax[3] = {0, 0, 0}; // The road warrior
+	int j;
 
-	for (i=0; i<20; i++)
-	{
-		while (!magAvailable(ALL_AXIS))
-			;
-		readMag();
-		int16_t magTemp[3] = {0, 0, 0};
-		magTemp[0] = mx;
-		magTemp[1] = my;
-		magTemp[2] = mz;
-		for (j = 0; j < 3; j++)
-		{
-			if (magTemp[j] > magMax[j]) magMax[j] = magTemp[j];
-			if (magTemp[j] < magMin[j]) magMin[j] = magTemp[j];
-		}
-	}
 	for (j = 0; j < 3; j++)
 	{
-		mBiasRaw[j] = (magMax[j] + magMin[j]) / 2;
-		mBias[j] = calcMag(mBiasRaw[j]);
+		imu->mBiasRaw[j] = imu->magCal.center[j];
+		imu->mBias[j] = calcMag(imu->mBiasRaw[j]);
 		if (loadIn)
-			magOffset(j, mBiasRaw[j]);
+			magOffset(j, imu->mBiasRaw[j]);
 	}
+}
 
+// Solves the ellipsoid fit accumulated by readMag() for the hard-iron offset
+// and soft-iron matrix, then loads it as loadMagBias() does. Returns false
+// (and keeps the previous correction) until enough well spread samples exist.
+bool calibrateMag(bool loadIn)
+{
+	if (!magCalSolve(&imu->magCal))
+		return false;
+	loadMagBias(loadIn);
+	return true;
+}
+
+// Takes over a solve made elsewhere on a copy of this sensor's fit
+void loadMagCalibration(const MagCal *fit, bool loadIn)
+{
+	magCalLoad(&imu->magCal, fit);
+	loadMagBias(loadIn);
 }
 /* ===============================================================
  * =================== LSM9DS1 ===================================
@@ -1183,9 +1638,12 @@ void calibrateMag(bool loadIn)
 */
 uint16_t LSM9DS1begin(void)
 {
-	//to do: don't use _xgAddress or _mAddress, duplicating memory
-	_xgAddress = settings.device.agAddress;
-	_mAddress = settings.device.mAddress;
+	imu->xgAddress = imu->settings.device.agAddress;
+	imu->mAddress = imu->settings.device.mAddress;
+
+	imu->bootStart = Timestamp_get32();
+	imu->bootTime = 0;
+	imu->bootTransfers = i2cQueueCompleted + i2cQueueFailed;
 
 	constrainScales();
 	// Once we have the scale values, we can calculate the resolution
@@ -1205,7 +1663,15 @@ uint16_t LSM9DS1begin(void)
 
 	if (whoAmICombined != ((WHO_AM_I_AG_RSP << 8) | WHO_AM_I_M_RSP))
 		return 0;
+	imu->present = true;
+
+	// Cache the configuration registers so later updates skip the read
+	loadShadowRegisters();
 
+#if LSM9DS1_BURST_CONFIG
+	// Gyro, accel and mag in three bursts from the register images
+	writeConfigImages();
+#else
 	// Gyro initialization stuff:
 	initGyro();	// This will "turn on" the gyro. Setting up interrupts, etc.
 
@@ -1214,6 +1680,8 @@ uint16_t LSM9DS1begin(void)
 
 	// Magnetometer initialization stuff:
 	initMag(); // "Turn on" all axes of the mag. Set up interrupts, etc.
+#endif
+	imu->bootTransfers = i2cQueueCompleted + i2cQueueFailed - imu->bootTransfers;
 
 	// Once everything is initialized, return the WHO_AM_I registers we read:
 	return whoAmICombined;
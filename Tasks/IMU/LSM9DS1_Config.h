@@ -0,0 +1,146 @@
+/*
+ * LSM9DS1_Config.h
+ *
+ *  Constant LSM9DS1 configuration and the control register images derived
+ *  from it. Every image is folded by the compiler, so bring-up is one
+ *  auto-increment write per contiguous register block instead of working
+ *  out and writing each register in turn. LSM9DS1init() copies the same
+ *  values into settings for the runtime setters.
+ */
+
+#ifndef TASKS_IMU_LSM9DS1_CONFIG_H_
+#define TASKS_IMU_LSM9DS1_CONFIG_H_
+
+#include "Tasks/IMU/LSM9DS1_Registers.h"
+
+/* ===============================================================
+ * =================== Configuration =============================
+ * ===============================================================
+*/
+// Number of LSM9DS1s on the bus (1 or 2). The second one has SA0/SA1 low.
+#ifndef LSM9DS1_DEVICE_COUNT
+#define LSM9DS1_DEVICE_COUNT		1
+#endif
+
+// gyro scale can be 245, 500, or 2000
+#define LSM9DS1_GYRO_SCALE			245
+// gyro sample rate: value between 1-6
+// 1 = 14.9    4 = 238
+// 2 = 59.5    5 = 476
+// 3 = 119     6 = 952
+#define LSM9DS1_GYRO_ODR			1
+// gyro cutoff frequency: value between 0-3
+#define LSM9DS1_GYRO_BW				0
+#define LSM9DS1_GYRO_LOW_POWER		1
+#define LSM9DS1_GYRO_HPF			0
+// Gyro HPF cutoff frequency: value between 0-9
+#define LSM9DS1_GYRO_HPF_CUTOFF		0
+#define LSM9DS1_GYRO_FLIP_X			0
+#define LSM9DS1_GYRO_FLIP_Y			0
+#define LSM9DS1_GYRO_FLIP_Z			0
+#define LSM9DS1_GYRO_LATCH_INT		1
+
+// accel scale can be 2, 4, 8, or 16
+#define LSM9DS1_ACCEL_SCALE			2
+// accel sample rate can be 1-6
+// 1 = 10 Hz    4 = 238 Hz
+// 2 = 50 Hz    5 = 476 Hz
+// 3 = 119 Hz   6 = 952 Hz
+#define LSM9DS1_ACCEL_ODR			1
+// -1 = bandwidth determined by sample rate
+// 0 = 408 Hz   2 = 105 Hz
+// 1 = 211 Hz   3 = 50 Hz
+#define LSM9DS1_ACCEL_BW			(-1)
+#define LSM9DS1_ACCEL_HIGH_RES		0
+// 0 = ODR/50    2 = ODR/9
+// 1 = ODR/100   3 = ODR/400
+#define LSM9DS1_ACCEL_HR_BW			0
+
+// mag scale can be 4, 8, 12, or 16
+#define LSM9DS1_MAG_SCALE			4
+// mag data rate can be 0-7
+// 0 = 0.625 Hz  4 = 10 Hz
+// 1 = 1.25 Hz   5 = 20 Hz
+// 2 = 2.5 Hz    6 = 40 Hz
+// 3 = 5 Hz      7 = 80 Hz
+#define LSM9DS1_MAG_ODR				5
+#define LSM9DS1_MAG_TEMP_COMP		0
+// 0 = Low power mode      2 = high performance
+// 1 = medium performance  3 = ultra-high performance
+#define LSM9DS1_MAG_XY_PERF			3
+#define LSM9DS1_MAG_Z_PERF			3
+#define LSM9DS1_MAG_LOW_POWER		0
+// 0 = continuous conversion, 1 = single-conversion, 2 = power down
+#define LSM9DS1_MAG_MODE			0
+
+#if (LSM9DS1_DEVICE_COUNT < 1) || (LSM9DS1_DEVICE_COUNT > 2)
+#error "LSM9DS1_DEVICE_COUNT must be 1 or 2"
+#endif
+#if (LSM9DS1_GYRO_SCALE != 245) && (LSM9DS1_GYRO_SCALE != 500) && \
+	(LSM9DS1_GYRO_SCALE != 2000)
+#error "LSM9DS1_GYRO_SCALE must be 245, 500 or 2000"
+#endif
+#if (LSM9DS1_ACCEL_SCALE != 2) && (LSM9DS1_ACCEL_SCALE != 4) && \
+	(LSM9DS1_ACCEL_SCALE != 8) && (LSM9DS1_ACCEL_SCALE != 16)
+#error "LSM9DS1_ACCEL_SCALE must be 2, 4, 8 or 16"
+#endif
+#if (LSM9DS1_MAG_SCALE != 4) && (LSM9DS1_MAG_SCALE != 8) && \
+	(LSM9DS1_MAG_SCALE != 12) && (LSM9DS1_MAG_SCALE != 16)
+#error "LSM9DS1_MAG_SCALE must be 4, 8, 12 or 16"
+#endif
+
+/* ===============================================================
+ * =================== Register images ===========================
+ * ===============================================================
+*/
+// Bit layouts are documented next to initGyro(), initAccel() and initMag()
+#define LSM9DS1_CTRL_REG1_G_VAL	(((LSM9DS1_GYRO_ODR & 0x07) << 5) | \
+		((LSM9DS1_GYRO_SCALE == 500 ? 0x1 : LSM9DS1_GYRO_SCALE == 2000 ? 0x3 : 0x0) << 3) | \
+		(LSM9DS1_GYRO_BW & 0x3))
+#define LSM9DS1_CTRL_REG2_G_VAL	0x00
+#define LSM9DS1_CTRL_REG3_G_VAL	((LSM9DS1_GYRO_LOW_POWER ? (1<<7) : 0) | \
+		(LSM9DS1_GYRO_HPF ? ((1<<6) | (LSM9DS1_GYRO_HPF_CUTOFF & 0x0F)) : 0))
+#define LSM9DS1_ORIENT_CFG_G_VAL	((LSM9DS1_GYRO_FLIP_X ? (1<<5) : 0) | \
+		(LSM9DS1_GYRO_FLIP_Y ? (1<<4) : 0) | (LSM9DS1_GYRO_FLIP_Z ? (1<<3) : 0))
+
+#define LSM9DS1_CTRL_REG4_VAL	((1<<5) | (1<<4) | (1<<3) | \
+		(LSM9DS1_GYRO_LATCH_INT ? (1<<1) : 0))
+#define LSM9DS1_CTRL_REG5_XL_VAL	((1<<5) | (1<<4) | (1<<3))
+#define LSM9DS1_CTRL_REG6_XL_VAL	(((LSM9DS1_ACCEL_ODR & 0x07) << 5) | \
+		((LSM9DS1_ACCEL_SCALE == 4 ? 0x2 : LSM9DS1_ACCEL_SCALE == 8 ? 0x3 : \
+		  LSM9DS1_ACCEL_SCALE == 16 ? 0x1 : 0x0) << 3) | \
+		(LSM9DS1_ACCEL_BW >= 0 ? ((1<<2) | (LSM9DS1_ACCEL_BW & 0x03)) : 0))
+#define LSM9DS1_CTRL_REG7_XL_VAL	(LSM9DS1_ACCEL_HIGH_RES ? \
+		((1<<7) | ((LSM9DS1_ACCEL_HR_BW & 0x3) << 5)) : 0)
+
+#define LSM9DS1_CTRL_REG1_M_VAL	((LSM9DS1_MAG_TEMP_COMP ? (1<<7) : 0) | \
+		((LSM9DS1_MAG_XY_PERF & 0x3) << 5) | ((LSM9DS1_MAG_ODR & 0x7) << 2))
+#define LSM9DS1_CTRL_REG2_M_VAL	((LSM9DS1_MAG_SCALE == 8 ? 0x1 : LSM9DS1_MAG_SCALE == 12 ? 0x2 : \
+		LSM9DS1_MAG_SCALE == 16 ? 0x3 : 0x0) << 5)
+#define LSM9DS1_CTRL_REG3_M_VAL	((LSM9DS1_MAG_LOW_POWER ? (1<<5) : 0) | \
+		(LSM9DS1_MAG_MODE & 0x3))
+#define LSM9DS1_CTRL_REG4_M_VAL	((LSM9DS1_MAG_Z_PERF & 0x3) << 2)
+#define LSM9DS1_CTRL_REG5_M_VAL	0x00
+
+/* One image per contiguous block, written first register first */
+static const uint8_t xgGyroImage[] = {		// CTRL_REG1_G .. ORIENT_CFG_G
+	LSM9DS1_CTRL_REG1_G_VAL,
+	LSM9DS1_CTRL_REG2_G_VAL,
+	LSM9DS1_CTRL_REG3_G_VAL,
+	LSM9DS1_ORIENT_CFG_G_VAL
+};
+static const uint8_t xgAccelImage[] = {		// CTRL_REG4 .. CTRL_REG7_XL
+	LSM9DS1_CTRL_REG4_VAL,
+	LSM9DS1_CTRL_REG5_XL_VAL,
+	LSM9DS1_CTRL_REG6_XL_VAL,
+	LSM9DS1_CTRL_REG7_XL_VAL
+};
+static const uint8_t mImage[] = {			// CTRL_REG1_M .. CTRL_REG5_M
+	LSM9DS1_CTRL_REG1_M_VAL,
+	LSM9DS1_CTRL_REG2_M_VAL,
+	LSM9DS1_CTRL_REG3_M_VAL,
+	LSM9DS1_CTRL_REG4_M_VAL,
+	LSM9DS1_CTRL_REG5_M_VAL
+};
+
+#endif /* TASKS_IMU_LSM9DS1_CONFIG_H_ */
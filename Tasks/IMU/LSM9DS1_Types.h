@@ -163,7 +163,7 @@ typedef enum
 	FIFO_THS = 1,
 	FIFO_CONT_TRIGGER = 3,
 	FIFO_OFF_TRIGGER = 4,
-	FIFO_CONT = 5
+	FIFO_CONT = 6
 } fifoMode_type;
 
 typedef struct gyroSettings
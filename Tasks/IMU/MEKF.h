@@ -0,0 +1,509 @@
+/*
+ * MEKF.h
+ *
+ *  Multiplicative extended Kalman filter for precision attitude.
+ *
+ *  The state is the attitude quaternion and the gyro bias. The filter
+ *  covariance is over the 6-state error: a small body-frame rotation and
+ *  the bias error. Every gyro frame in imuRing moves the quaternion by the
+ *  bias-corrected rate. Every IMU_MEKF_UPDATE_PERIOD, on the next new mag
+ *  sample, the covariance is carried over the elapsed time and the
+ *  measured field is compared with the modelled one (Mag_Model.h). On the
+ *  ground, an accel reading that passes imuAccelIsGravity() is used the
+ *  same way against straight down. Each vector goes in as three scalar
+ *  updates, so there is no matrix inverse. The error is then folded into
+ *  the quaternion and the bias, and reset to zero. The first mag sample
+ *  aligns the filter with QUEST (QUEST.h) over the mag, gravity on the
+ *  ground and a sun vector if there is one, or with the mag alone by the
+ *  shortest turn onto the modelled field.
+ *
+ *  The cost does not depend on the data. The covariance step is a fixed
+ *  sequence of 3x3 block products, and an update is at most six scalar
+ *  updates. mekf.cycles and mekf.cyclesMax hold the DWT cycle count of the
+ *  last and longest update, mekf.frameCyclesMax that of the per-frame
+ *  step. Every IMU_MEKF_REPORT updates a LOG_MEKF record gives the 1-sigma
+ *  attitude uncertainty and the update cost.
+ *
+ *  The reference frame is local North-East-Down at the magModel position.
+ *  Its slow rotation with the orbit is not modelled. With the mag alone
+ *  the angle about the field only becomes observable as the field
+ *  direction changes, i.e. as the position moves along the orbit. In
+ *  tools/host/mekf_mc, with the position updated every second, that holds
+ *  an attitude the filter was handed from 10 deg off: 17 of 20 runs end
+ *  an orbit valid at 0.6 deg rms, the rest with sigma above the bound
+ *  below. On board the only position source is the POSITION uplink
+ *  (Mag_Model.h), so between uplinks the field model, and the attitude
+ *  with it, goes stale. From a cold start the mag alone cannot find the
+ *  angle about the field, and the sigma it reports is optimistic.
+ *
+ *  So a mag-only alignment is provisional: updates with a gravity reading
+ *  retry QUEST and align again once it succeeds. mekfValid is set only after an
+ *  alignment with a second vector (or a hand-over), and while the 1-sigma
+ *  attitude uncertainty is below IMU_MEKF_VALID_SIGMA. All the math is
+ *  single precision.
+ *
+ *  The radio sends mekfQuatPacked while mekfValid is set, and the
+ *  complementary filter's output otherwise (RF_TX_Tasks.h).
+ */
+
+#ifndef TASKS_IMU_MEKF_H_
+#define TASKS_IMU_MEKF_H_
+
+#include <math.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include "../../Peripherals/Cycle_Counter.h"
+#include "../Log.h"
+#include "LSM9DS1.h"
+#include "IMU_Ring.h"
+#include "IMU_Bias.h"
+#include "Quaternion.h"
+#include "Attitude_Filter.h"
+#include "Mag_Model.h"
+#include "QUEST.h"
+
+/* Shortest time between updates, Clock ticks */
+#define IMU_MEKF_UPDATE_PERIOD		(100000 / Clock_tickPeriod)
+/* Longest gap one covariance step may cover */
+#define IMU_MEKF_MAX_GAP			(1000000 / Clock_tickPeriod)
+/* Gyro angle random walk, rad/s/sqrt(Hz) (LSM9DS1 ~0.008 dps/sqrt(Hz)) */
+#define IMU_MEKF_GYRO_NOISE			1.4e-4f
+/* Gyro bias random walk, rad/s^(3/2) */
+#define IMU_MEKF_BIAS_NOISE			2e-5f
+/* Unit vector noise, including the dipole model error for the mag */
+#define IMU_MEKF_MAG_SIGMA			0.03f
+#define IMU_MEKF_ACCEL_SIGMA		0.05f
+/* Initial 1-sigma: attitude after alignment, rad, and bias, rad/s */
+#define IMU_MEKF_INIT_ATT_SIGMA		0.3f
+#define IMU_MEKF_INIT_BIAS_SIGMA	0.02f
+/* Scalar updates with a larger innovation (in sigmas) are skipped */
+#define IMU_MEKF_GATE				5.0f
+/* mekfValid only while the attitude 1-sigma is below this, urad (10 deg) */
+#define IMU_MEKF_VALID_SIGMA		174533
+/* Updates between LOG_MEKF records */
+#define IMU_MEKF_REPORT				100
+
+typedef struct IMU_Mekf
+{
+	float q[4];				// Reference (NED) to body
+	float bias[3];			// Gyro bias, rad/s
+	float P[6][6];			// Error covariance, rotation then bias
+	float dx[6];			// Error estimate within an update
+
+	/* Since the last update */
+	float rateSum[3];		// Bias-corrected rate, rad/s
+	uint16_t rateFrames;
+	int32_t accelSum[3];
+	uint16_t accelFrames;
+
+	int16_t lastMag[3];
+	uint32_t lastUpdate;	// Stamp of the last update
+	bool aligned;
+	bool magOnly;			// Aligned on the mag alone, angle about it unknown
+	IMU_RingReader reader;
+	bool ready;
+
+	/* Telemetry */
+	uint32_t updates;
+	uint32_t rejected;		// Scalar updates outside the gate
+	uint32_t sigma;			// Attitude 1-sigma, urad
+	uint32_t cycles;		// Last update
+	uint32_t cyclesMax;
+	uint32_t frameCyclesMax;
+} IMU_Mekf;
+
+IMU_Mekf mekf;
+
+/* Straight down in the reference frame */
+static const float mekfDown[3] = {0.0f, 0.0f, 1.0f};
+
+/* Latest attitude, Q14, w >= 0, and packed with quatPack() */
+int16_t mekfQuat[4];
+uint16_t mekfQuatPacked[3];
+bool mekfValid;
+
+/* v' = q v q*, i.e. A(q) v */
+static void mekfRotate(const float q[4], const float v[3], float out[3])
+{
+	float t[3];
+
+	/* t = 2 u x v, out = v + w t + u x t */
+	t[0] = 2.0f * (q[2] * v[2] - q[3] * v[1]);
+	t[1] = 2.0f * (q[3] * v[0] - q[1] * v[2]);
+	t[2] = 2.0f * (q[1] * v[1] - q[2] * v[0]);
+	out[0] = v[0] + q[0] * t[0] + q[2] * t[2] - q[3] * t[1];
+	out[1] = v[1] + q[0] * t[1] + q[3] * t[0] - q[1] * t[2];
+	out[2] = v[2] + q[0] * t[2] + q[1] * t[1] - q[2] * t[0];
+}
+
+/* q = (1, u) q, then back to unit length */
+static void mekfTurn(const float u[3])
+{
+	float *q = mekf.q;
+	const float w = q[0], x = q[1], y = q[2], z = q[3];
+	float n;
+	int i;
+
+	q[0] = w - u[0] * x - u[1] * y - u[2] * z;
+	q[1] = x + w * u[0] + u[1] * z - u[2] * y;
+	q[2] = y + w * u[1] + u[2] * x - u[0] * z;
+	q[3] = z + w * u[2] + u[0] * y - u[1] * x;
+
+	/* |q| stays close to one, so one Newton step for 1/|q| is enough */
+	n = q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3];
+	n = 1.5f - 0.5f * n;
+	for (i = 0; i < 4; i++) q[i] *= n;
+}
+
+/* Unit vector of a raw reading, false if it is zero */
+static bool mekfUnit(const int32_t v[3], float out[3])
+{
+	float n = (float)v[0] * v[0] + (float)v[1] * v[1] + (float)v[2] * v[2];
+	int i;
+
+	if (n <= 0.0f)
+		return false;
+	n = 1.0f / sqrtf(n);
+	for (i = 0; i < 3; i++) out[i] = v[i] * n;
+	return true;
+}
+
+/*
+ * Carry the covariance over dt with the mean rate w. The transition is
+ * [F -dt I; 0 I] with F = I - [w x] dt, so only three 3x3 products are
+ * needed.
+ */
+static void mekfPropagateCovariance(const float w[3], float dt)
+{
+	const float v = IMU_MEKF_GYRO_NOISE * IMU_MEKF_GYRO_NOISE;
+	const float u = IMU_MEKF_BIAS_NOISE * IMU_MEKF_BIAS_NOISE;
+	float F[3][3], A[3][3], B[3][3];
+	float (*P)[6] = mekf.P;
+	int i, j, k;
+
+	F[0][0] = 1.0f;			F[0][1] = w[2] * dt;	F[0][2] = -w[1] * dt;
+	F[1][0] = -w[2] * dt;	F[1][1] = 1.0f;			F[1][2] = w[0] * dt;
+	F[2][0] = w[1] * dt;	F[2][1] = -w[0] * dt;	F[2][2] = 1.0f;
+
+	/* A = F P11 - dt P21, B = F P12 - dt P22 */
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			float a = -dt * P[3 + i][j], b = -dt * P[3 + i][3 + j];
+			for (k = 0; k < 3; k++)
+			{
+				a += F[i][k] * P[k][j];
+				b += F[i][k] * P[k][3 + j];
+			}
+			A[i][j] = a;
+			B[i][j] = b;
+		}
+	}
+	/* P11 = A F' - dt B, P12 = B, P21 = B', P22 unchanged */
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			float a = -dt * B[i][j];
+			for (k = 0; k < 3; k++) a += A[i][k] * F[j][k];
+			P[i][j] = a;
+			P[i][3 + j] = B[i][j];
+			P[3 + j][i] = B[i][j];
+		}
+	}
+
+	/* Process noise, then keep P11 exactly symmetric */
+	for (i = 0; i < 3; i++)
+	{
+		P[i][i] += v * dt + u * dt * dt * dt * (1.0f / 3.0f);
+		P[i][3 + i] -= 0.5f * u * dt * dt;
+		P[3 + i][i] -= 0.5f * u * dt * dt;
+		P[3 + i][3 + i] += u * dt;
+		for (j = 0; j < i; j++)
+		{
+			float s = 0.5f * (P[i][j] + P[j][i]);
+			P[i][j] = s;
+			P[j][i] = s;
+		}
+	}
+}
+
+/*
+ * One measured unit vector b against reference r. The prediction is
+ * h = A r, and a small rotation e changes it by h x e, so the rows of H
+ * are those of [h x] followed by zeros.
+ */
+static void mekfVectorUpdate(const float b[3], const float r[3], float sigma)
+{
+	const float var = sigma * sigma;
+	float h[3], H[3][3];
+	float (*P)[6] = mekf.P;
+	int axis, i, j;
+
+	mekfRotate(mekf.q, r, h);
+	H[0][0] = 0.0f;		H[0][1] = -h[2];	H[0][2] = h[1];
+	H[1][0] = h[2];		H[1][1] = 0.0f;		H[1][2] = -h[0];
+	H[2][0] = -h[1];	H[2][1] = h[0];		H[2][2] = 0.0f;
+
+	for (axis = 0; axis < 3; axis++)
+	{
+		const float *row = H[axis];
+		float PH[6], s, innovation, k;
+
+		for (i = 0; i < 6; i++)
+			PH[i] = P[i][0] * row[0] + P[i][1] * row[1] + P[i][2] * row[2];
+		s = row[0] * PH[0] + row[1] * PH[1] + row[2] * PH[2] + var;
+		innovation = b[axis] - h[axis] -
+				(row[0] * mekf.dx[0] + row[1] * mekf.dx[1] + row[2] * mekf.dx[2]);
+		if (innovation * innovation > IMU_MEKF_GATE * IMU_MEKF_GATE * s)
+		{
+			mekf.rejected++;
+			continue;
+		}
+
+		k = innovation / s;
+		s = 1.0f / s;
+		for (i = 0; i < 6; i++)
+		{
+			mekf.dx[i] += PH[i] * k;
+			for (j = 0; j <= i; j++)
+			{
+				P[i][j] -= PH[i] * PH[j] * s;
+				P[j][i] = P[i][j];
+			}
+		}
+	}
+}
+
+/* Attitude 1-sigma from the covariance, urad */
+static void mekfSetSigma(void)
+{
+	mekf.sigma = (uint32_t)(sqrtf(mekf.P[0][0] + mekf.P[1][1] + mekf.P[2][2]) * 1e6f);
+}
+
+/*
+ * Start from the measured vectors, with the initial uncertainty. False if
+ * nothing changed: no usable reading, or QUEST failed again while the
+ * filter already holds a mag-only alignment.
+ */
+static bool mekfAlign(const float mag[3], const float *down)
+{
+	float q[4];
+	bool solved;
+	int i, j;
+
+	/* QUEST over the mag, down and any recent sun vector */
+	solved = questAttitude(mag, down, q);
+	if (solved)
+	{
+		for (i = 0; i < 4; i++) mekf.q[i] = q[i];
+	}
+	else if (mekf.aligned)
+	{
+		return false;
+	}
+	else
+	{
+		/* No second vector, or down too close to the field: the shortest
+		 * turn taking the model onto the reading. The angle about the field
+		 * is left to the filter, and the next gravity reading retries. */
+		const float *r = magModel.unit;
+		float c = 1.0f + r[0] * mag[0] + r[1] * mag[1] + r[2] * mag[2];
+		float n;
+
+		if (c < 1e-3f)
+			return false;
+		mekf.q[0] = c;
+		mekf.q[1] = r[1] * mag[2] - r[2] * mag[1];
+		mekf.q[2] = r[2] * mag[0] - r[0] * mag[2];
+		mekf.q[3] = r[0] * mag[1] - r[1] * mag[0];
+		n = 1.0f / sqrtf(mekf.q[0] * mekf.q[0] + mekf.q[1] * mekf.q[1] +
+				mekf.q[2] * mekf.q[2] + mekf.q[3] * mekf.q[3]);
+		for (i = 0; i < 4; i++) mekf.q[i] *= n;
+	}
+
+	for (i = 0; i < 6; i++)
+	{
+		for (j = 0; j < 6; j++) mekf.P[i][j] = 0.0f;
+	}
+	for (i = 0; i < 3; i++)
+	{
+		/* With the mag alone the angle about the field is unknown */
+		mekf.P[i][i] = solved ? IMU_MEKF_INIT_ATT_SIGMA * IMU_MEKF_INIT_ATT_SIGMA : 4.0f;
+		mekf.P[3 + i][3 + i] = IMU_MEKF_INIT_BIAS_SIGMA * IMU_MEKF_INIT_BIAS_SIGMA;
+	}
+	mekf.aligned = true;
+	mekf.magOnly = !solved;
+	mekfSetSigma();
+	return true;
+}
+
+/* Measurement update on a new mag sample */
+static void mekfUpdate(const IMU_Frame *frame)
+{
+	const float tickSeconds = Clock_tickPeriod * 1e-6f;
+	float mag[3], down[3], rate[3], u[3], dt;
+	int32_t v[3];
+	bool haveDown;
+	uint32_t ticks, start;
+	int i;
+
+	start = cycleCount();
+	ticks = frame->stamp - mekf.lastUpdate;
+	mekf.lastUpdate = frame->stamp;
+	if (ticks > IMU_MEKF_MAX_GAP)
+		ticks = IMU_MEKF_MAX_GAP;
+	dt = ticks * tickSeconds;
+
+	v[0] = IMU_ATT_MAG_SIGN_X * frame->mag[0];
+	v[1] = IMU_ATT_MAG_SIGN_Y * frame->mag[1];
+	v[2] = IMU_ATT_MAG_SIGN_Z * frame->mag[2];
+	if (!mekfUnit(v, mag))
+		return;
+	/* Down is minus the accel, as in calcAccel() */
+	for (i = 0; i < 3; i++) v[i] = -mekf.accelSum[i];
+	haveDown = (mekf.accelFrames != 0) && mekfUnit(v, down);
+	for (i = 0; i < 3; i++)
+	{
+		rate[i] = (mekf.rateFrames != 0) ? mekf.rateSum[i] / mekf.rateFrames : 0.0f;
+		mekf.rateSum[i] = 0.0f;
+		mekf.accelSum[i] = 0;
+	}
+	mekf.rateFrames = 0;
+	mekf.accelFrames = 0;
+
+	/* A mag-only alignment is replaced as soon as QUEST can use gravity */
+	if ((!mekf.aligned || (mekf.magOnly && haveDown)) &&
+		mekfAlign(mag, haveDown ? down : NULL))
+		return;
+	if (!mekf.aligned)
+		return;
+
+	mekfPropagateCovariance(rate, dt);
+	for (i = 0; i < 6; i++) mekf.dx[i] = 0.0f;
+	mekfVectorUpdate(mag, magModel.unit, IMU_MEKF_MAG_SIGMA);
+	if (haveDown)
+		mekfVectorUpdate(down, mekfDown, IMU_MEKF_ACCEL_SIGMA);
+
+	/* Reset: A = (I - [e x]) A is q = (1, -e/2) q */
+	for (i = 0; i < 3; i++)
+	{
+		u[i] = -0.5f * mekf.dx[i];
+		mekf.bias[i] += mekf.dx[3 + i];
+	}
+	mekfTurn(u);
+
+	mekfSetSigma();
+	mekf.cycles = cycleCount() - start;
+	if (mekf.cycles > mekf.cyclesMax)
+		mekf.cyclesMax = mekf.cycles;
+	if (++mekf.updates % IMU_MEKF_REPORT == 0)
+		LOG3(LOG_MEKF, mekf.sigma, mekf.cycles, mekf.cyclesMax);
+}
+
+/* Gyro step for one frame */
+static void mekfPropagate(const IMU_Frame *frame, float radPerLsb, float dt)
+{
+	float u[3];
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		float w = frame->xg[i] * radPerLsb - mekf.bias[i];
+		mekf.rateSum[i] += w;
+		/* dq/dt = -1/2 (0, w) q */
+		u[i] = -0.5f * w * dt;
+	}
+	mekf.rateFrames++;
+	mekfTurn(u);
+}
+
+void mekfInit(void)
+{
+	int i;
+
+	mekf.q[0] = 1.0f;
+	for (i = 0; i < 3; i++)
+	{
+		mekf.q[1 + i] = 0.0f;
+		mekf.bias[i] = 0.0f;
+		mekf.rateSum[i] = 0.0f;
+		mekf.accelSum[i] = 0;
+		mekf.lastMag[i] = 0;
+	}
+	mekf.rateFrames = 0;
+	mekf.accelFrames = 0;
+	mekf.aligned = false;
+	mekf.magOnly = false;
+	mekf.updates = 0;
+	mekf.rejected = 0;
+	mekf.cyclesMax = 0;
+	mekf.frameCyclesMax = 0;
+	mekfValid = false;
+	if (magModel.updates == 0)
+		magModelInit();
+	imuRingReaderInit(&imuRing, &mekf.reader);
+	cycleCounterInit();
+	mekf.ready = true;
+}
+
+/*
+ * Run the filter over the frames published since the last call. Run from
+ * the task that consumes the sensor data, after imuVoteRun().
+ */
+void mekfRun(void)
+{
+	const float radPerLsb = imu->gRes * 0.017453293f;
+	const float dt = gyroPeriodTicks() * Clock_tickPeriod * 1e-6f;
+	IMU_Frame frame;
+	bool fresh = false;
+	int16_t q14[4];
+	UInt key;
+	int i;
+
+	if (!mekf.ready)
+		mekfInit();
+
+	while (imuRingRead(&imuRing, &mekf.reader, &frame))
+	{
+		uint32_t start = cycleCount();
+		uint32_t cycles;
+
+		fresh = true;
+		if (mekf.aligned)
+			mekfPropagate(&frame, radPerLsb, dt);
+		if (imuAccelIsGravity(&frame.xg[3]) && (mekf.accelFrames != UINT16_MAX))
+		{
+			for (i = 0; i < 3; i++) mekf.accelSum[i] += frame.xg[3 + i] >> 2;
+			mekf.accelFrames++;
+		}
+		cycles = cycleCount() - start;
+		if (cycles > mekf.frameCyclesMax)
+			mekf.frameCyclesMax = cycles;
+
+		if ((frame.mag[0] | frame.mag[1] | frame.mag[2]) != 0 &&
+			((frame.mag[0] != mekf.lastMag[0]) || (frame.mag[1] != mekf.lastMag[1]) ||
+			 (frame.mag[2] != mekf.lastMag[2])) &&
+			(!mekf.aligned || (frame.stamp - mekf.lastUpdate >= IMU_MEKF_UPDATE_PERIOD)))
+		{
+			for (i = 0; i < 3; i++) mekf.lastMag[i] = frame.mag[i];
+			mekfUpdate(&frame);
+		}
+	}
+	if (!fresh || !mekf.aligned)
+		return;
+
+	for (i = 0; i < 4; i++) q14[i] = (int16_t)lrintf(mekf.q[i] * Q14_ONE);
+	if (q14[0] < 0)
+	{
+		for (i = 0; i < 4; i++) q14[i] = -q14[i];
+	}
+	key = Hwi_disable();
+	for (i = 0; i < 4; i++) mekfQuat[i] = q14[i];
+	mekfValid = !mekf.magOnly && (mekf.sigma < IMU_MEKF_VALID_SIGMA);
+	quatPack(mekfQuat, mekfValid, mekfQuatPacked);
+	Hwi_restore(key);
+}
+
+#endif /* TASKS_IMU_MEKF_H_ */
@@ -0,0 +1,421 @@
+/*
+ * Mag_Calibration.h
+ *
+ *  Incremental hard/soft-iron calibration for the magnetometer.
+ *
+ *  Every raw sample is folded into the sums of a least-squares fit of the
+ *  general quadric
+ *
+ *      p0 x^2 + p1 y^2 + p2 z^2 + p3 xy + p4 xz + p5 yz
+ *          + p6 x + p7 y + p8 z + p9 = 0,    p0 + p1 + p2 = 1
+ *
+ *  (45 + 9 integer sums and the sample count, independent of the number of
+ *  samples). The constant term is free, so the fit does not care where the
+ *  origin is: a hard-iron offset larger than the field itself is as good
+ *  as none. The trace of the quadratic part is never zero for an
+ *  ellipsoid, so fixing it to one loses nothing. Once in a while
+ *  magCalSolve() solves the normal equations for the centre (hard iron)
+ *  and a symmetric 3x3 correction matrix (soft iron) that maps the
+ *  ellipsoid back onto a sphere of the same mean radius. The matrix is
+ *  kept in Q14 and applied per sample with integer math only.
+ *
+ *  The solve can run in another task on a copy of the fit: the owner of
+ *  the sensor takes the result over with magCalLoad().
+ *
+ *  The fit needs samples spread over the sphere, i.e. the board has to
+ *  rotate. Degenerate fits (too few samples, data in a plane, a badly
+ *  stretched ellipsoid) are rejected and the previous correction is kept.
+ */
+
+#ifndef TASKS_IMU_MAG_CALIBRATION_H_
+#define TASKS_IMU_MAG_CALIBRATION_H_
+
+#include <xdc/std.h>
+#include <math.h>
+
+/* Readings plus the hardware offset span 17 bits. Shifted down by this
+ * before accumulation they fit in 14, so a fourth power stays below 2^52
+ * and MAG_CAL_MAX_SAMPLES of them below 2^62. */
+#define MAG_CAL_SHIFT			3
+/* When this many samples are held, all sums are halved (forgetting factor) */
+#define MAG_CAL_MAX_SAMPLES		1024
+/* Fewest samples accepted for a solve */
+#define MAG_CAL_MIN_SAMPLES		200
+/* Largest accepted ratio between the longest and shortest ellipsoid axis */
+#define MAG_CAL_MAX_AXIS_RATIO	2.0
+/* Jacobi sweeps for the 3x3 eigen decomposition */
+#define MAG_CAL_JACOBI_SWEEPS	8
+
+#define MAG_CAL_TERMS			9
+#define MAG_CAL_PAIRS			(MAG_CAL_TERMS * (MAG_CAL_TERMS + 1) / 2)
+
+typedef struct MagCal
+{
+	/* Sufficient statistics */
+	int64_t sumPP[MAG_CAL_PAIRS];	// Upper triangle of sum(phi phi^T)
+	int64_t sumP[MAG_CAL_TERMS];	// sum(phi)
+	uint32_t samples;
+
+	/* Current correction: out = W * (raw - swOffset) */
+	int16_t swOffset[3];			// Part of the centre not removed by the sensor
+	int16_t hwOffset[3];			// Loaded into OFFSET_*_REG_M
+	int16_t wQ14[3][3];
+	bool valid;
+
+	/* Last solve */
+	int16_t center[3];				// Hard-iron offset, raw LSB
+	float radius;					// Mean field magnitude, raw LSB
+	uint32_t solves;
+	uint32_t rejects;
+} MagCal;
+
+void magCalInit(MagCal *cal)
+{
+	int i, j;
+
+	for (i = 0; i < MAG_CAL_PAIRS; i++) cal->sumPP[i] = 0;
+	for (i = 0; i < MAG_CAL_TERMS; i++) cal->sumP[i] = 0;
+	cal->samples = 0;
+	for (i = 0; i < 3; i++)
+	{
+		cal->swOffset[i] = 0;
+		cal->hwOffset[i] = 0;
+		cal->center[i] = 0;
+		for (j = 0; j < 3; j++)
+			cal->wQ14[i][j] = (i == j) ? (1 << 14) : 0;
+	}
+	cal->valid = false;
+	cal->radius = 0;
+	cal->solves = 0;
+	cal->rejects = 0;
+}
+
+/* Fold in one reading as output by the sensor (hardware offset removed) */
+void magCalAccumulate(MagCal *cal, const int16_t out[3])
+{
+	int32_t x = ((int32_t)out[0] + cal->hwOffset[0]) >> MAG_CAL_SHIFT;
+	int32_t y = ((int32_t)out[1] + cal->hwOffset[1]) >> MAG_CAL_SHIFT;
+	int32_t z = ((int32_t)out[2] + cal->hwOffset[2]) >> MAG_CAL_SHIFT;
+	int64_t phi[MAG_CAL_TERMS];
+	int i, j, k;
+
+	if (cal->samples >= MAG_CAL_MAX_SAMPLES)
+	{
+		for (i = 0; i < MAG_CAL_PAIRS; i++) cal->sumPP[i] >>= 1;
+		for (i = 0; i < MAG_CAL_TERMS; i++) cal->sumP[i] >>= 1;
+		cal->samples >>= 1;
+	}
+
+	phi[0] = x * x;
+	phi[1] = y * y;
+	phi[2] = z * z;
+	phi[3] = x * y;
+	phi[4] = x * z;
+	phi[5] = y * z;
+	phi[6] = x;
+	phi[7] = y;
+	phi[8] = z;
+
+	k = 0;
+	for (i = 0; i < MAG_CAL_TERMS; i++)
+	{
+		cal->sumP[i] += phi[i];
+		for (j = i; j < MAG_CAL_TERMS; j++)
+		{
+			cal->sumPP[k++] += phi[i] * phi[j];
+		}
+	}
+	cal->samples++;
+}
+
+/* Apply the current correction to a sensor reading */
+void magCalApply(const MagCal *cal, const int16_t out[3], int16_t corrected[3])
+{
+	int32_t d[3];
+	int i;
+
+	if (!cal->valid)
+	{
+		for (i = 0; i < 3; i++) corrected[i] = out[i];
+		return;
+	}
+	for (i = 0; i < 3; i++) d[i] = (int32_t)out[i] - cal->swOffset[i];
+	for (i = 0; i < 3; i++)
+	{
+		int64_t acc = (int64_t)cal->wQ14[i][0] * d[0] +
+				(int64_t)cal->wQ14[i][1] * d[1] +
+				(int64_t)cal->wQ14[i][2] * d[2];
+		int32_t v = (int32_t)((acc + (1 << 13)) >> 14);
+		if (v > 32767) v = 32767;
+		if (v < -32768) v = -32768;
+		corrected[i] = (int16_t)v;
+	}
+}
+
+/* Cyclic Jacobi eigen decomposition of a symmetric 3x3 matrix. On return
+ * a holds the eigenvalues on its diagonal and v the eigenvectors (columns). */
+static void magCalJacobi(double a[3][3], double v[3][3])
+{
+	int sweep, p, q, k;
+
+	for (p = 0; p < 3; p++)
+		for (q = 0; q < 3; q++)
+			v[p][q] = (p == q) ? 1.0 : 0.0;
+
+	for (sweep = 0; sweep < MAG_CAL_JACOBI_SWEEPS; sweep++)
+	{
+		for (p = 0; p < 2; p++)
+		{
+			for (q = p + 1; q < 3; q++)
+			{
+				double theta, t, c, s;
+
+				if (fabs(a[p][q]) < 1e-15 * (fabs(a[p][p]) + fabs(a[q][q])))
+					continue;
+				theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+				t = (theta >= 0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+				c = 1.0 / sqrt(t * t + 1.0);
+				s = t * c;
+
+				for (k = 0; k < 3; k++)
+				{
+					double akp = a[k][p], akq = a[k][q];
+					a[k][p] = c * akp - s * akq;
+					a[k][q] = s * akp + c * akq;
+				}
+				for (k = 0; k < 3; k++)
+				{
+					double apk = a[p][k], aqk = a[q][k];
+					a[p][k] = c * apk - s * aqk;
+					a[q][k] = s * apk + c * aqk;
+				}
+				for (k = 0; k < 3; k++)
+				{
+					double vkp = v[k][p], vkq = v[k][q];
+					v[k][p] = c * vkp - s * vkq;
+					v[k][q] = s * vkp + c * vkq;
+				}
+			}
+		}
+	}
+}
+
+/* Feature i of the fit from the monomials x^2 .. z, 1 (p2 eliminated) */
+static double magCalFeature(const double *phi, int i)
+{
+	switch (i)
+	{
+	case 0: return phi[0] - phi[2];
+	case 1: return phi[1] - phi[2];
+	default: return phi[i + 1];
+	}
+}
+
+/*
+ * Solve the accumulated fit. On success the centre and correction matrix
+ * are replaced and true is returned; the caller decides whether to load
+ * the centre into the sensor (see magCalSetHardwareOffset). Task context
+ * only, the solve is a few thousand software floating point operations.
+ * One solve at a time: the working set is static.
+ */
+bool magCalSolve(MagCal *cal)
+{
+	/* Static to keep ~2 kB of doubles off the small task stacks */
+	static double g[MAG_CAL_TERMS + 1][MAG_CAL_TERMS + 1];
+	static double m[MAG_CAL_TERMS][MAG_CAL_TERMS];
+	static double rhs[MAG_CAL_TERMS];
+	static double scale[MAG_CAL_TERMS + 1], h[MAG_CAL_TERMS + 1];
+	static double A[3][3], b[3], c[3], inv[3][3];
+	static double V[3][3], radii[3];
+	double s, n, det, k, rMean, rMin, rMax;
+	int i, j, l, idx;
+
+	if (cal->samples < MAG_CAL_MIN_SAMPLES)
+		goto reject;
+	n = (double)cal->samples;
+
+	/* Work in units of the typical reading, so every term is near one */
+	s = sqrt((double)(cal->sumPP[0] + cal->sumPP[9] + cal->sumPP[17]) / (3.0 * n));
+	s = sqrt(s);
+	if (s < 1.0)
+		goto reject;
+	for (i = 0; i < 6; i++) scale[i] = s * s;
+	for (i = 6; i < 9; i++) scale[i] = s;
+	scale[9] = 1.0;
+
+	/* Mean of phi phi^T over the monomials x^2 .. z and the constant */
+	idx = 0;
+	for (i = 0; i < MAG_CAL_TERMS; i++)
+	{
+		for (j = i; j < MAG_CAL_TERMS; j++)
+		{
+			g[i][j] = (double)cal->sumPP[idx++] / (scale[i] * scale[j] * n);
+			g[j][i] = g[i][j];
+		}
+		g[i][MAG_CAL_TERMS] = (double)cal->sumP[i] / (scale[i] * n);
+		g[MAG_CAL_TERMS][i] = g[i][MAG_CAL_TERMS];
+	}
+	g[MAG_CAL_TERMS][MAG_CAL_TERMS] = 1.0;
+
+	/* Normal equations of features . u = -z^2 */
+	for (i = 0; i < MAG_CAL_TERMS; i++)
+	{
+		for (l = 0; l <= MAG_CAL_TERMS; l++) h[l] = magCalFeature(g[l], i);
+		for (j = 0; j < MAG_CAL_TERMS; j++) m[i][j] = magCalFeature(h, j);
+		rhs[i] = -h[2];
+	}
+
+	/* Cholesky, in place in the lower triangle */
+	for (j = 0; j < MAG_CAL_TERMS; j++)
+	{
+		double d = m[j][j];
+		for (l = 0; l < j; l++) d -= m[j][l] * m[j][l];
+		if (d <= 1e-12 * m[j][j])
+			goto reject;		// Samples do not span the ellipsoid
+		m[j][j] = sqrt(d);
+		for (i = j + 1; i < MAG_CAL_TERMS; i++)
+		{
+			double e = m[i][j];
+			for (l = 0; l < j; l++) e -= m[i][l] * m[j][l];
+			m[i][j] = e / m[j][j];
+		}
+	}
+	for (i = 0; i < MAG_CAL_TERMS; i++)
+	{
+		double e = rhs[i];
+		for (l = 0; l < i; l++) e -= m[i][l] * rhs[l];
+		rhs[i] = e / m[i][i];
+	}
+	for (i = MAG_CAL_TERMS - 1; i >= 0; i--)
+	{
+		double e = rhs[i];
+		for (l = i + 1; l < MAG_CAL_TERMS; l++) e -= m[l][i] * rhs[l];
+		rhs[i] = e / m[i][i];
+	}
+
+	/* x^T A x + 2 b^T x + d = 0, trace(A) = 1, in units of s */
+	A[0][0] = rhs[0];
+	A[1][1] = rhs[1];
+	A[2][2] = 1.0 - rhs[0] - rhs[1];
+	A[0][1] = A[1][0] = rhs[2] / 2;
+	A[0][2] = A[2][0] = rhs[3] / 2;
+	A[1][2] = A[2][1] = rhs[4] / 2;
+	b[0] = rhs[5] / 2;
+	b[1] = rhs[6] / 2;
+	b[2] = rhs[7] / 2;
+
+	/* Centre c = -A^-1 b */
+	inv[0][0] = A[1][1] * A[2][2] - A[1][2] * A[2][1];
+	inv[0][1] = A[0][2] * A[2][1] - A[0][1] * A[2][2];
+	inv[0][2] = A[0][1] * A[1][2] - A[0][2] * A[1][1];
+	inv[1][1] = A[0][0] * A[2][2] - A[0][2] * A[2][0];
+	inv[1][2] = A[0][2] * A[1][0] - A[0][0] * A[1][2];
+	inv[2][2] = A[0][0] * A[1][1] - A[0][1] * A[1][0];
+	inv[1][0] = inv[0][1];
+	inv[2][0] = inv[0][2];
+	inv[2][1] = inv[1][2];
+	det = A[0][0] * inv[0][0] + A[0][1] * inv[1][0] + A[0][2] * inv[2][0];
+	if (det <= 0)
+		goto reject;		// Not an ellipsoid
+	for (i = 0; i < 3; i++)
+		c[i] = -(inv[i][0] * b[0] + inv[i][1] * b[1] + inv[i][2] * b[2]) / det;
+
+	/* (x - c)^T A (x - c) = c^T A c - d */
+	k = -rhs[8];
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+			k += c[i] * A[i][j] * c[j];
+	if (k <= 0)
+		goto reject;
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+			A[i][j] /= k;
+
+	/* Axes: A = V diag(1/r^2) V^T */
+	magCalJacobi(A, V);
+	rMean = 1.0;
+	rMin = 1e30;
+	rMax = 0;
+	for (i = 0; i < 3; i++)
+	{
+		if (A[i][i] <= 0)
+			goto reject;
+		radii[i] = 1.0 / sqrt(A[i][i]);
+		rMean *= radii[i];
+		if (radii[i] < rMin) rMin = radii[i];
+		if (radii[i] > rMax) rMax = radii[i];
+	}
+	if (rMax > MAG_CAL_MAX_AXIS_RATIO * rMin)
+		goto reject;
+	rMean = cbrt(rMean) * s;
+
+	/* Back to raw LSB and check everything fits the integer formats */
+	for (i = 0; i < 3; i++)
+	{
+		c[i] *= s * (double)(1 << MAG_CAL_SHIFT);
+		if (c[i] > 32767.0 || c[i] < -32768.0)
+			goto reject;
+	}
+
+	/* W = V diag(rMean / r) V^T, symmetric so the body axes are not rotated */
+	{
+		int16_t w[3][3];
+		for (i = 0; i < 3; i++)
+		{
+			for (j = 0; j < 3; j++)
+			{
+				double e = 0;
+				for (l = 0; l < 3; l++)
+					e += V[i][l] * (rMean / (radii[l] * s)) * V[j][l];
+				e *= 16384.0;
+				if (e > 32767.0 || e < -32768.0)
+					goto reject;
+				w[i][j] = (int16_t)floor(e + 0.5);
+			}
+		}
+		for (i = 0; i < 3; i++)
+		{
+			cal->center[i] = (int16_t)floor(c[i] + 0.5);
+			cal->swOffset[i] = cal->center[i] - cal->hwOffset[i];
+			for (j = 0; j < 3; j++)
+				cal->wQ14[i][j] = w[i][j];
+		}
+	}
+	cal->radius = (float)(rMean * (1 << MAG_CAL_SHIFT));
+	cal->valid = true;
+	cal->solves++;
+	return true;
+
+reject:
+	cal->rejects++;
+	return false;
+}
+
+/*
+ * Take over the result of a solve made on a copy of cal (fit). The sums
+ * in cal kept growing meanwhile and are left alone.
+ */
+void magCalLoad(MagCal *cal, const MagCal *fit)
+{
+	int i, j;
+
+	for (i = 0; i < 3; i++)
+	{
+		cal->center[i] = fit->center[i];
+		cal->swOffset[i] = cal->center[i] - cal->hwOffset[i];
+		for (j = 0; j < 3; j++)
+			cal->wQ14[i][j] = fit->wQ14[i][j];
+	}
+	cal->radius = fit->radius;
+	cal->valid = true;
+	cal->solves++;
+}
+
+/* Record that the sensor now subtracts offset from its readings */
+void magCalSetHardwareOffset(MagCal *cal, uint8_t axis, int16_t offset)
+{
+	cal->hwOffset[axis] = offset;
+	cal->swOffset[axis] = cal->center[axis] - offset;
+}
+
+#endif /* TASKS_IMU_MAG_CALIBRATION_H_ */
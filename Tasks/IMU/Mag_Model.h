@@ -0,0 +1,115 @@
+/*
+ * Mag_Model.h
+ *
+ *  Reference geomagnetic field for the attitude estimator: a centred
+ *  tilted dipole with the IGRF-13 (2020) degree one coefficients. It is
+ *  within a few degrees of the full model in low Earth orbit, which is
+ *  about what the soft-iron calibration leaves anyway, and costs a handful
+ *  of trig calls when the position changes.
+ *
+ *  The field is given in the local North-East-Down frame at the position
+ *  set with magModelSetPosition(). Until a position is known the default
+ *  is the lab, MAG_MODEL_DEFAULT_LAT/LON. The only source on board is the
+ *  POSITION uplink (RF_RX_Tasks.h): the radio callback hands the fix to
+ *  magModelPost(), and the IMU task applies it with magModelRun() between
+ *  frames, so the filters never see the field change halfway through.
+ *  The GPS task is not running, so in orbit the field is only as current
+ *  as the last uplink.
+ */
+
+#ifndef TASKS_IMU_MAG_MODEL_H_
+#define TASKS_IMU_MAG_MODEL_H_
+
+#include <math.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ti/sysbios/hal/Hwi.h>
+
+/* IGRF-13 epoch 2020 dipole, nT */
+#define MAG_MODEL_G10			(-29404.8f)
+#define MAG_MODEL_G11			(-1450.9f)
+#define MAG_MODEL_H11			4652.5f
+/* Reference radius, km */
+#define MAG_MODEL_RADIUS		6371.2f
+
+/* Ithaca, NY, geocentric degrees and km above the reference radius */
+#define MAG_MODEL_DEFAULT_LAT	42.44f
+#define MAG_MODEL_DEFAULT_LON	(-76.50f)
+#define MAG_MODEL_DEFAULT_ALT	0.0f
+
+typedef struct MagModel
+{
+	float ned[3];			// Field at the position, nT
+	float unit[3];			// Same, unit length
+	uint32_t updates;		// Changes of position
+} MagModel;
+
+MagModel magModel;
+
+/* Position from magModelPost(), waiting for magModelRun() */
+static float magModelPending[3];
+static volatile bool magModelPendingSet;
+
+/* Work out the field at a new position, degrees and km */
+void magModelSetPosition(float latDeg, float lonDeg, float altKm)
+{
+	const float deg = 0.017453293f;
+	const float colat = (90.0f - latDeg) * deg;
+	const float lon = lonDeg * deg;
+	const float ct = cosf(colat), st = sinf(colat);
+	const float cp = cosf(lon), sp = sinf(lon);
+	const float ratio = MAG_MODEL_RADIUS / (MAG_MODEL_RADIUS + altKm);
+	const float r3 = ratio * ratio * ratio;
+	const float g = MAG_MODEL_G11 * cp + MAG_MODEL_H11 * sp;
+	float br, btheta, bphi, n;
+	int i;
+
+	/* B = -grad V for the degree one potential, spherical components */
+	br = 2.0f * r3 * (MAG_MODEL_G10 * ct + g * st);
+	btheta = r3 * (MAG_MODEL_G10 * st - g * ct);
+	bphi = r3 * (MAG_MODEL_G11 * sp - MAG_MODEL_H11 * cp);
+
+	magModel.ned[0] = -btheta;
+	magModel.ned[1] = bphi;
+	magModel.ned[2] = -br;
+	n = 1.0f / sqrtf(magModel.ned[0] * magModel.ned[0] +
+			magModel.ned[1] * magModel.ned[1] + magModel.ned[2] * magModel.ned[2]);
+	for (i = 0; i < 3; i++) magModel.unit[i] = magModel.ned[i] * n;
+	magModel.updates++;
+}
+
+void magModelInit(void)
+{
+	magModelSetPosition(MAG_MODEL_DEFAULT_LAT, MAG_MODEL_DEFAULT_LON, MAG_MODEL_DEFAULT_ALT);
+}
+
+/* Queue a new position, degrees and km. Safe from Swi or Hwi context. */
+void magModelPost(float latDeg, float lonDeg, float altKm)
+{
+	UInt key = Hwi_disable();
+
+	magModelPending[0] = latDeg;
+	magModelPending[1] = lonDeg;
+	magModelPending[2] = altKm;
+	magModelPendingSet = true;
+	Hwi_restore(key);
+}
+
+/* Apply a queued position. Run from the IMU task, ahead of the filters. */
+void magModelRun(void)
+{
+	float p[3];
+	UInt key;
+
+	if (!magModelPendingSet)
+		return;
+	key = Hwi_disable();
+	p[0] = magModelPending[0];
+	p[1] = magModelPending[1];
+	p[2] = magModelPending[2];
+	magModelPendingSet = false;
+	Hwi_restore(key);
+	magModelSetPosition(p[0], p[1], p[2]);
+}
+
+#endif /* TASKS_IMU_MAG_MODEL_H_ */
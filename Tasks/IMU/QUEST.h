@@ -0,0 +1,328 @@
+/*
+ * QUEST.h
+ *
+ *  Optimal attitude from N weighted vector pairs (Wahba's problem), solved
+ *  with QUEST for the largest eigenvalue and ESOQ2 for the quaternion.
+ *
+ *  TRIAD takes the accel direction as exact and uses only the part of the
+ *  mag normal to it. Here every pair counts in proportion to its weight,
+ *  so the mag and accel noise are both averaged in. questAttitude() takes
+ *  the mag against Mag_Model.h, the accel against straight down if the
+ *  caller has a gravity reading, and a coarse sun vector when a sun sensor
+ *  driver has supplied one with questSetSun(). tools/host/quest_bench
+ *  compares it with TRIAD on the same readings. With the mag and accel
+ *  alone the gain is small, 0.1 to 0.6 degrees rms against errors of 5 to
+ *  25 degrees, for four to five times TRIAD's cycles on the host. That is
+ *  affordable only because it runs once per alignment; the sun vector is
+ *  what really improves the answer. Both reject pairs closer than 5
+ *  degrees (QUEST_MIN_SINE) as degenerate.
+ *
+ *  The MEKF (MEKF.h) is the only caller: it aligns from questAttitude(),
+ *  so QUEST runs once per alignment rather than on every frame. In orbit
+ *  the accel is gated out, and nothing calls questSetSun() yet (there is
+ *  no sun sensor driver), so there is a single pair, questValid stays
+ *  false and the MEKF falls back to aligning on the mag alone. It does the
+ *  same on the ground when down and the field are too close together.
+ *
+ *  The largest eigenvalue of Davenport's K matrix is found with
+ *  QUEST_ITERATIONS Newton steps on its characteristic polynomial,
+ *  starting from the sum of the weights. That start is already within the
+ *  residual of a good solution, so two steps are plenty. ESOQ2 then gets
+ *  the rotation axis as the null vector of a symmetric 3x3 matrix, from the
+ *  largest cross product of its rows. There is no division by a small
+ *  number anywhere, not even at 180 degrees. The cost is the same for
+ *  every sample. quest.cycles holds the DWT count of the last solve.
+ *
+ *  The quaternion has the Quaternion.h convention, reference (NED) to
+ *  body. Single precision, which costs about 0.02 degrees rms with the mag
+ *  and gravity ~20 degrees apart (as at mid latitudes), well below the
+ *  noise of either vector.
+ */
+
+#ifndef TASKS_IMU_QUEST_H_
+#define TASKS_IMU_QUEST_H_
+
+#include <math.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include "../../Peripherals/Cycle_Counter.h"
+#include "Fixed_Math.h"
+#include "Mag_Model.h"
+
+#define QUEST_MAX_PAIRS			4
+#define QUEST_ITERATIONS		2
+/* Weights, 1/sigma^2 of each unit vector */
+#define QUEST_MAG_WEIGHT		(1.0f / (0.03f * 0.03f))
+#define QUEST_ACCEL_WEIGHT		(1.0f / (0.05f * 0.05f))
+/* A sun vector older than this is not used */
+#define QUEST_SUN_MAX_AGE		(1000000 / Clock_tickPeriod)
+/* Two of the body directions, and two of the reference ones, must be
+ * further apart than this, sin(5 degrees) as TRIAD_MIN_SINE */
+#define QUEST_MIN_SINE			0.0872f
+
+typedef struct QuestPair
+{
+	float body[3];			// Unit vectors
+	float ref[3];
+	float weight;
+} QuestPair;
+
+typedef struct QuestSolver
+{
+	QuestPair pairs[QUEST_MAX_PAIRS];
+	uint8_t count;
+
+	/* Coarse sun vector from questSetSun() */
+	QuestPair sun;
+	uint32_t sunStamp;
+	bool sunValid;
+
+	/* Telemetry */
+	float loss;				// Wahba loss of the last solve, sum(w) - lambda
+	uint32_t solves;
+	uint32_t failures;		// Fewer than two independent directions
+	uint32_t cycles;		// Last solve
+	uint32_t cyclesMax;
+} QuestSolver;
+
+QuestSolver quest;
+
+/* Attitude of the last questAttitude(), Q14, w >= 0 */
+int16_t questQuat[4];
+bool questValid;
+
+/* Drop the pairs of the last solve */
+void questReset(void)
+{
+	quest.count = 0;
+}
+
+/* Add a pair of unit vectors, false if the table is full */
+bool questAddPair(const float body[3], const float ref[3], float weight)
+{
+	QuestPair *pair;
+	int i;
+
+	if (quest.count >= QUEST_MAX_PAIRS)
+		return false;
+	pair = &quest.pairs[quest.count++];
+	for (i = 0; i < 3; i++)
+	{
+		pair->body[i] = body[i];
+		pair->ref[i] = ref[i];
+	}
+	pair->weight = weight;
+	return true;
+}
+
+/*
+ * Sun direction in the body and in the reference frame, for the next
+ * solves. Unit vectors. Any task.
+ */
+void questSetSun(const float body[3], const float ref[3], float weight)
+{
+	UInt key = Hwi_disable();
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		quest.sun.body[i] = body[i];
+		quest.sun.ref[i] = ref[i];
+	}
+	quest.sun.weight = weight;
+	quest.sunStamp = Clock_getTicks();
+	quest.sunValid = true;
+	Hwi_restore(key);
+}
+
+/* Largest sin^2 of the angle between two of the pairs' vectors */
+static float questSpread(bool body)
+{
+	float best = 0.0f;
+	int i, j;
+
+	for (i = 0; i < quest.count; i++)
+	{
+		const float *u = body ? quest.pairs[i].body : quest.pairs[i].ref;
+		for (j = i + 1; j < quest.count; j++)
+		{
+			const float *v = body ? quest.pairs[j].body : quest.pairs[j].ref;
+			float c0 = u[1]*v[2] - u[2]*v[1];
+			float c1 = u[2]*v[0] - u[0]*v[2];
+			float c2 = u[0]*v[1] - u[1]*v[0];
+			float m = c0*c0 + c1*c1 + c2*c2;
+			if (m > best) best = m;
+		}
+	}
+	return best;
+}
+
+/*
+ * Solve for the pairs added since questReset(). q gets the attitude,
+ * reference to body. Returns false if the pairs do not fix it.
+ */
+bool questSolve(float q[4])
+{
+	float B[3][3], S[3][3], M[3][3], z[3], Sz[3], e[3], axis[3];
+	float sigma, kappa, delta, a, b, c, d, lambda, weights = 0.0f;
+	float best = 0.0f, n;
+	int i, j, k;
+
+	if ((quest.count < 2) || (questSpread(true) < QUEST_MIN_SINE * QUEST_MIN_SINE) ||
+		(questSpread(false) < QUEST_MIN_SINE * QUEST_MIN_SINE))
+	{
+		quest.failures++;
+		return false;
+	}
+
+	/* Attitude profile matrix B = sum w b r' */
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 3; j++) B[i][j] = 0.0f;
+	}
+	for (k = 0; k < quest.count; k++)
+	{
+		const QuestPair *p = &quest.pairs[k];
+		for (i = 0; i < 3; i++)
+		{
+			for (j = 0; j < 3; j++) B[i][j] += p->weight * p->body[i] * p->ref[j];
+		}
+		weights += p->weight;
+	}
+	/* Normalise, so lambda is close to one */
+	n = 1.0f / weights;
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 3; j++) B[i][j] *= n;
+	}
+
+	sigma = B[0][0] + B[1][1] + B[2][2];
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 3; j++) S[i][j] = B[i][j] + B[j][i];
+	}
+	z[0] = B[1][2] - B[2][1];
+	z[1] = B[2][0] - B[0][2];
+	z[2] = B[0][1] - B[1][0];
+
+	/* Characteristic polynomial of K, in the form that loses the least
+	 * to cancellation near the root:
+	 * (l^2 - a)(l^2 - b) - c (l - sigma) - d */
+	kappa = S[1][1]*S[2][2] - S[1][2]*S[2][1] + S[0][0]*S[2][2] - S[0][2]*S[2][0] +
+			S[0][0]*S[1][1] - S[0][1]*S[1][0];
+	delta = S[0][0] * (S[1][1]*S[2][2] - S[1][2]*S[2][1]) -
+			S[0][1] * (S[1][0]*S[2][2] - S[1][2]*S[2][0]) +
+			S[0][2] * (S[1][0]*S[2][1] - S[1][1]*S[2][0]);
+	for (i = 0; i < 3; i++) Sz[i] = S[i][0]*z[0] + S[i][1]*z[1] + S[i][2]*z[2];
+	a = sigma * sigma - kappa;
+	b = sigma * sigma + z[0]*z[0] + z[1]*z[1] + z[2]*z[2];
+	c = delta + z[0]*Sz[0] + z[1]*Sz[1] + z[2]*Sz[2];
+	d = Sz[0]*Sz[0] + Sz[1]*Sz[1] + Sz[2]*Sz[2];
+
+	lambda = 1.0f;
+	for (k = 0; k < QUEST_ITERATIONS; k++)
+	{
+		float l2 = lambda * lambda;
+		float f = (l2 - a) * (l2 - b) - c * (lambda - sigma) - d;
+		float df = 4.0f * l2 * lambda - 2.0f * (a + b) * lambda - c;
+		if (df != 0.0f)
+			lambda -= f / df;
+	}
+	quest.loss = (1.0f - lambda) * weights;
+
+	/* ESOQ2: M = (l - sigma)(S - (l + sigma) I) + z z', M e = 0 */
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			M[i][j] = (lambda - sigma) * S[i][j] + z[i] * z[j];
+			if (i == j)
+				M[i][j] -= (lambda - sigma) * (lambda + sigma);
+		}
+	}
+	/* The largest cross product of two rows is the best null vector */
+	for (k = 0; k < 3; k++)
+	{
+		const float *u = M[(k + 1) % 3], *v = M[(k + 2) % 3];
+		float m;
+
+		axis[0] = u[1]*v[2] - u[2]*v[1];
+		axis[1] = u[2]*v[0] - u[0]*v[2];
+		axis[2] = u[0]*v[1] - u[1]*v[0];
+		m = axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2];
+		if (m > best)
+		{
+			best = m;
+			for (i = 0; i < 3; i++) e[i] = axis[i];
+		}
+	}
+	/* With the pairs spread out M has rank two, this only catches a
+	 * numerical breakdown */
+	if (best <= 0.0f)
+	{
+		quest.failures++;
+		return false;
+	}
+
+	/* Davenport's quaternion is ((l - sigma) e, z'e) with the vector part
+	 * for the transposed matrix, so the vector part flips here */
+	q[0] = z[0]*e[0] + z[1]*e[1] + z[2]*e[2];
+	for (i = 0; i < 3; i++) q[1 + i] = -(lambda - sigma) * e[i];
+	n = q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3];
+	if (n <= 0.0f)
+	{
+		quest.failures++;
+		return false;
+	}
+	n = 1.0f / sqrtf(n);
+	if (q[0] < 0.0f)
+		n = -n;
+	for (i = 0; i < 4; i++) q[i] *= n;
+	quest.solves++;
+	return true;
+}
+
+/*
+ * Attitude from a mag reading, straight down if down is not NULL, and the
+ * sun vector if questSetSun() gave one within QUEST_SUN_MAX_AGE. mag and
+ * down are unit vectors in the body, mag in the mounting signs of
+ * Attitude_Filter.h. q gets the attitude, reference (NED) to body.
+ * Returns false, and clears questValid, if the pairs do not fix it.
+ */
+bool questAttitude(const float mag[3], const float *down, float q[4])
+{
+	static const float ned[3] = {0.0f, 0.0f, 1.0f};
+	uint32_t start;
+	bool valid;
+	UInt key;
+	int i;
+
+	if (magModel.updates == 0)
+		magModelInit();
+	cycleCounterInit();
+	start = cycleCount();
+	questReset();
+	questAddPair(mag, magModel.unit, QUEST_MAG_WEIGHT);
+	if (down != NULL)
+		questAddPair(down, ned, QUEST_ACCEL_WEIGHT);
+	key = Hwi_disable();
+	if (quest.sunValid && (Clock_getTicks() - quest.sunStamp < QUEST_SUN_MAX_AGE))
+		questAddPair(quest.sun.body, quest.sun.ref, quest.sun.weight);
+	Hwi_restore(key);
+
+	valid = questSolve(q);
+	quest.cycles = cycleCount() - start;
+	if (quest.cycles > quest.cyclesMax)
+		quest.cyclesMax = quest.cycles;
+
+	key = Hwi_disable();
+	questValid = valid;
+	if (valid)
+	{
+		for (i = 0; i < 4; i++) questQuat[i] = (int16_t)lrintf(q[i] * Q14_ONE);
+	}
+	Hwi_restore(key);
+	return valid;
+}
+
+#endif /* TASKS_IMU_QUEST_H_ */
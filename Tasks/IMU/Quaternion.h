@@ -0,0 +1,174 @@
+/*
+ * Quaternion.h
+ *
+ *  Attitude quaternions in Q14, scalar first: q = (w, x, y, z). q stands
+ *  for the same rotation as the direction cosine matrix it came from, so
+ *  A v = q v q*. q and -q are the same attitude; dcmToQuatQ14() returns
+ *  the one with w >= 0.
+ *
+ *  quatPack() squeezes a quaternion into three 16-bit words (6 bytes) for
+ *  telemetry, using the "smallest three" encoding:
+ *
+ *    - The largest component is dropped and rebuilt from the unit norm.
+ *      q is negated first if needed, so the dropped one is positive.
+ *    - The other three lie in [-1/sqrt(2), 1/sqrt(2)]. Each is stored in
+ *      the upper 15 bits of its word, signed, with +-16383 = +-1/sqrt(2).
+ *    - The low bits of words 0 and 1 hold the index (0..3) of the dropped
+ *      component, high bit first. The low bit of word 2 is set when the
+ *      attitude is valid.
+ *
+ *  A step of one in the 15-bit field is 4.3e-5, below one Q14 LSB, so the
+ *  round trip adds little to the Q14 rounding. tools/quat_codec.py
+ *  implements the same format on the host, and tools/host/quat_test checks
+ *  these functions: within 2 LSB per component through pack and unpack.
+ */
+
+#ifndef TASKS_IMU_QUATERNION_H_
+#define TASKS_IMU_QUATERNION_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "Fixed_Math.h"
+
+/* Packed field = component * sqrt(2) * 16383, Q16 factors from Q14 and back */
+#define QUAT_PACK_MAX		16383
+#define QUAT_PACK_SCALE		92676
+#define QUAT_UNPACK_SCALE	46344
+
+/*
+ * Shepperd's method. Picks the largest of 4w^2, 4x^2, 4y^2 and 4z^2 from
+ * the diagonal, and the matching row of products 4 q_k q_j from the off
+ * diagonal terms. That row is q scaled by 4 q_k, so it only needs to be
+ * normalised. Never divides by a small component. dcm is Q14, row major.
+ * Returns false if the matrix is too far from a rotation to give one.
+ */
+bool dcmToQuatQ14(const int16_t dcm[9], int16_t q[4])
+{
+	const int32_t tr = (int32_t)dcm[0] + dcm[4] + dcm[8];
+	int32_t p[4];
+	int32_t d[4];
+	int i, k = 0;
+
+	d[0] = Q14_ONE + tr;
+	d[1] = Q14_ONE + 2 * (int32_t)dcm[0] - tr;
+	d[2] = Q14_ONE + 2 * (int32_t)dcm[4] - tr;
+	d[3] = Q14_ONE + 2 * (int32_t)dcm[8] - tr;
+	for (i = 1; i < 4; i++)
+	{
+		if (d[i] > d[k]) k = i;
+	}
+	if (d[k] <= 0)
+		return false;
+
+	switch (k)
+	{
+	case 0:
+		p[0] = d[0];
+		p[1] = (int32_t)dcm[7] - dcm[5];
+		p[2] = (int32_t)dcm[2] - dcm[6];
+		p[3] = (int32_t)dcm[3] - dcm[1];
+		break;
+	case 1:
+		p[0] = (int32_t)dcm[7] - dcm[5];
+		p[1] = d[1];
+		p[2] = (int32_t)dcm[1] + dcm[3];
+		p[3] = (int32_t)dcm[2] + dcm[6];
+		break;
+	case 2:
+		p[0] = (int32_t)dcm[2] - dcm[6];
+		p[1] = (int32_t)dcm[1] + dcm[3];
+		p[2] = d[2];
+		p[3] = (int32_t)dcm[5] + dcm[7];
+		break;
+	default:
+		p[0] = (int32_t)dcm[3] - dcm[1];
+		p[1] = (int32_t)dcm[2] + dcm[6];
+		p[2] = (int32_t)dcm[5] + dcm[7];
+		p[3] = d[3];
+		break;
+	}
+	if (p[0] < 0)
+	{
+		for (i = 0; i < 4; i++) p[i] = -p[i];
+	}
+	return normalizeQuatQ14(p, q);
+}
+
+/* Direction cosine matrix of a unit Q14 quaternion, Q14, row major */
+void quatToDcmQ14(const int16_t q[4], int16_t dcm[9])
+{
+	const int32_t ww = (int32_t)q[0] * q[0], xx = (int32_t)q[1] * q[1];
+	const int32_t yy = (int32_t)q[2] * q[2], zz = (int32_t)q[3] * q[3];
+	const int32_t wx = (int32_t)q[0] * q[1], wy = (int32_t)q[0] * q[2];
+	const int32_t wz = (int32_t)q[0] * q[3], xy = (int32_t)q[1] * q[2];
+	const int32_t xz = (int32_t)q[1] * q[3], yz = (int32_t)q[2] * q[3];
+	int32_t e[9];
+	int i;
+
+	/* Q28 */
+	e[0] = ww + xx - yy - zz;
+	e[1] = 2 * (xy - wz);
+	e[2] = 2 * (xz + wy);
+	e[3] = 2 * (xy + wz);
+	e[4] = ww - xx + yy - zz;
+	e[5] = 2 * (yz - wx);
+	e[6] = 2 * (xz - wy);
+	e[7] = 2 * (yz + wx);
+	e[8] = ww - xx - yy + zz;
+	for (i = 0; i < 9; i++)
+		dcm[i] = (int16_t)((e[i] + (1L << 13)) >> 14);
+}
+
+/* Smallest-three encoding, see the top of this file */
+void quatPack(const int16_t q[4], bool valid, uint16_t words[3])
+{
+	int32_t sign = 1;
+	int i, j = 0, k = 0;
+
+	for (i = 1; i < 4; i++)
+	{
+		if (abs(q[i]) > abs(q[k])) k = i;
+	}
+	if (q[k] < 0)
+		sign = -1;
+
+	for (i = 0; i < 4; i++)
+	{
+		int32_t c;
+
+		if (i == k)
+			continue;
+		c = (sign * q[i] * QUAT_PACK_SCALE + (1L << 15)) >> 16;
+		if (c > QUAT_PACK_MAX) c = QUAT_PACK_MAX;
+		if (c < -QUAT_PACK_MAX) c = -QUAT_PACK_MAX;
+		words[j++] = (uint16_t)(c * 2);
+	}
+	words[0] |= (k >> 1) & 1;
+	words[1] |= k & 1;
+	words[2] |= valid ? 1 : 0;
+}
+
+/* Inverse of quatPack(). Returns the valid bit. */
+bool quatUnpack(const uint16_t words[3], int16_t q[4])
+{
+	const int k = ((words[0] & 1) << 1) | (words[1] & 1);
+	int32_t sum = 0;
+	int i, j = 0;
+
+	for (i = 0; i < 4; i++)
+	{
+		int32_t c;
+
+		if (i == k)
+			continue;
+		c = (int16_t)words[j++] >> 1;
+		q[i] = (int16_t)((c * QUAT_UNPACK_SCALE + (1L << 15)) >> 16);
+		sum += (int32_t)q[i] * q[i];
+	}
+	sum = (1L << 28) - sum;
+	q[k] = (int16_t)((sum > 0) ? isqrt32((uint32_t)sum) : 0);
+	return (words[2] & 1) != 0;
+}
+
+#endif /* TASKS_IMU_QUATERNION_H_ */
@@ -3,130 +3,238 @@
  *
  *  Created on: Sep 6, 2017
  *      Author: hunteradams
+ *
+ *  TRIAD attitude from one accel and one mag reading. The body triad is
+ *  (a, a x m, a x (a x m)), normalised, with a pointing down (minus the
+ *  accel, as calcAccel() gives it) and m in the mounting signs of
+ *  Attitude_Filter.h. The reference triad is built the same way from
+ *  straight down and the modelled field (Mag_Model.h), so the direction
+ *  cosine matrix, the sum of the outer products of the matching triad
+ *  vectors, takes local North-East-Down to the body, as in MEKF.h.
+ *
+ *  The reference triad only depends on the reference vectors. It is cached
+ *  and rebuilt when the field model moves (magModelSetPosition()).
+ *  computeAttitude() is the single-precision path. computeAttitudeQ14()
+ *  does the body side with integer math and a fixed-point reciprocal
+ *  square root, and returns the matrix in Q14. Its elements stay within
+ *  TRIAD_Q14_TOLERANCE (5e-4) of the float path while the down and field
+ *  lines are more than 10 degrees apart; tools/host/triad_bench checks
+ *  this over random attitudes and positions. TRIAD is ill-conditioned as
+ *  the lines approach parallel, so both paths reject pairs (body or
+ *  reference) closer than TRIAD_MIN_SINE as degenerate rather than return
+ *  a matrix several degrees off.
+ *
+ *  Nothing in the IMU task solves TRIAD any more: QUEST.h uses every
+ *  vector pair with its weight, and aligns the MEKF. These functions stay
+ *  for the host harnesses (tools/host/triad_bench, quest_bench). The host
+ *  has an FPU, so its timings say nothing about the soft-float Cortex-M3.
+ *  With TRIAD_BENCHMARK set, the IMU task times both paths once at
+ *  start-up with the DWT counter and logs LOG_TRIAD_CYCLES.
  */
 
 #ifndef TASKS_IMU_TRIAD_H_
 #define TASKS_IMU_TRIAD_H_
 
-//#include "LSM9DS1.h"
+#include <math.h>
+#include "../../Peripherals/Cycle_Counter.h"
+#include "../Log.h"
+#include "LSM9DS1.h"
+#include "Fixed_Math.h"
+#include "Attitude_Filter.h"
+#include "Mag_Model.h"
+
+/* Largest |fixed - float| element beyond 10 degrees, Q14 LSB */
+#define TRIAD_Q14_TOLERANCE	8
+/* Down and field lines closer than this are degenerate, sin(5 degrees) */
+#define TRIAD_MIN_SINE		0.0872f
+#define TRIAD_MIN_SINE_Q14	1428
+/* 1 times both paths at start-up on the target, see triadBenchmark() */
+#define TRIAD_BENCHMARK		0
+#define TRIAD_BENCH_SOLVES	64
+
+typedef struct TriadReference
+{
+	uint32_t modelUpdates;	// magModel.updates the triad was built from
+	float r1[3], r2[3], r3[3];
+	int16_t r1Q14[3], r2Q14[3], r3Q14[3];
+	bool valid;				// False if the field is vertical
+	uint32_t rebuilds;
+} TriadReference;
+
+TriadReference triadRef;
 
-float crossProductX(float u1, float u2, float u3,
-		            float v1, float v2, float v3)
+void crossProduct(const float u[3], const float v[3], float out[3])
 {
-	return u2*v3-u3*v2;
+	out[0] = u[1]*v[2] - u[2]*v[1];
+	out[1] = u[2]*v[0] - u[0]*v[2];
+	out[2] = u[0]*v[1] - u[1]*v[0];
 }
 
-float crossProductY(float u1, float u2, float u3,
-					float v1, float v2, float v3)
+/* Scale v to unit length, false if it is (close to) zero */
+bool vectorNormalize(float v[3])
 {
-	return u3*v1-u1*v3;
+	float n = sqrtf(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+
+	if (n < 1e-12f)
+		return false;
+	n = 1.0f / n;
+	v[0] *= n;
+	v[1] *= n;
+	v[2] *= n;
+	return true;
 }
 
-float crossProductZ(float u1, float u2, float u3,
-					float v1, float v2, float v3)
+/* Both triads are built the same way. False if a and m are within
+ * TRIAD_MIN_SINE of parallel. */
+static bool buildTriad(const float a[3], const float m[3],
+		float t1[3], float t2[3], float t3[3])
 {
-	return u1*v2-u2*v1;
+	const float m2 = m[0]*m[0] + m[1]*m[1] + m[2]*m[2];
+	int i;
+
+	for (i = 0; i < 3; i++) t1[i] = a[i];
+	if (!vectorNormalize(t1))
+		return false;
+	crossProduct(t1, m, t2);
+	/* |t1 x m|^2 = sin^2 |m|^2 */
+	if (t2[0]*t2[0] + t2[1]*t2[1] + t2[2]*t2[2] < TRIAD_MIN_SINE * TRIAD_MIN_SINE * m2)
+		return false;
+	if (!vectorNormalize(t2))
+		return false;
+	crossProduct(t1, t2, t3);
+	return vectorNormalize(t3);
 }
 
-float vectorMagnitude(float u1, float u2, float u3)
+/* Rebuild the reference triad if the field model moved */
+static void triadUpdateReference(void)
 {
-	return sqrt(u1*u1 + u2*u2 + u3*u3);
+	static const float down[3] = {0.0f, 0.0f, 1.0f};
+	int i;
+
+	if (magModel.updates == 0)
+		magModelInit();
+	if ((triadRef.rebuilds != 0) && (triadRef.modelUpdates == magModel.updates))
+		return;
+
+	triadRef.modelUpdates = magModel.updates;
+	triadRef.valid = buildTriad(down, magModel.unit,
+			triadRef.r1, triadRef.r2, triadRef.r3);
+	for (i = 0; i < 3; i++)
+	{
+		triadRef.r1Q14[i] = (int16_t)lrintf(triadRef.r1[i] * Q14_ONE);
+		triadRef.r2Q14[i] = (int16_t)lrintf(triadRef.r2[i] * Q14_ONE);
+		triadRef.r3Q14[i] = (int16_t)lrintf(triadRef.r3[i] * Q14_ONE);
+	}
+	triadRef.rebuilds++;
 }
 
+/*
+ * Single-precision TRIAD. buffer gets the direction cosine matrix, row
+ * major. Returns buffer, or NULL if either triad is degenerate.
+ */
 float* computeAttitude(int16_t mx, int16_t my, int16_t mz, int16_t ax, int16_t ay, int16_t az, float buffer[9])
 {
-	float mxf = calcMag(mx);
-	float myf = calcMag(my);
-	float mzf = calcMag(mz);
-	float axf = calcAccel(ax);
-	float ayf = calcAccel(ay);
-	float azf = calcAccel(az);
-
-	float asq = vectorMagnitude(axf, ayf, azf);
-
-	float axn = axf/asq;
-	float ayn = ayf/asq;
-	float azn = azf/asq;
-
-
-	float axm_x = crossProductX(axf, ayf, azf,
-								mxf, myf, mzf);
-	float axm_y = crossProductY(axf, ayf, azf,
-									mxf, myf, mzf);
-	float axm_z = crossProductZ(axf, ayf, azf,
-									mxf, myf, mzf);
-
-	float axm_sq = vectorMagnitude(axm_x, axm_y, axm_z);
-	float axm_xn = axm_x/axm_sq;
-	float axm_yn = axm_y/axm_sq;
-	float axm_zn = axm_z/axm_sq;
-
-
-	float anxaxm_n_x = crossProductX(axn, ayn, azn,
-									axm_xn, axm_yn, axm_zn);
-	float anxaxm_n_y = crossProductY(axn, ayn, azn,
-									axm_xn, axm_yn, axm_zn);
-	float anxaxm_n_z = crossProductZ(axn, ayn, azn,
-									axm_xn, axm_yn, axm_zn);
-
-	float anxaxm_sq = vectorMagnitude(anxaxm_n_x, anxaxm_n_y, anxaxm_n_z);
-
-	float anxaxm_nxn = anxaxm_n_x/anxaxm_sq;
-	float anxaxm_nyn = anxaxm_n_y/anxaxm_sq;
-	float anxaxm_nzn = anxaxm_n_z/anxaxm_sq;
-
-	float AXM_X = crossProductX(AXN, AYN, AZN,
-								MXN, MYN, MZN);
-	float AXM_Y = crossProductY(AXN, AYN, AZN,
-								MXN, MYN, MZN);
-	float AXM_Z = crossProductZ(AXN, AYN, AZN,
-								MXN, MYN, MZN);
-
-	float AXM_SQ = vectorMagnitude(AXM_X, AXM_Y, AXM_Z);
-	float AXM_XN = AXM_X/AXM_SQ;
-	float AXM_YN = AXM_Y/AXM_SQ;
-	float AXM_ZN = AXM_Z/AXM_SQ;
-
-	float ANXAXM_N_X = crossProductX(AXN, AYN, AZN,
-									AXM_XN, AXM_YN, AXM_ZN);
-	float ANXAXM_N_Y = crossProductY(AXN, AYN, AZN,
-										AXM_XN, AXM_YN, AXM_ZN);
-	float ANXAXM_N_Z = crossProductZ(AXN, AYN, AZN,
-										AXM_XN, AXM_YN, AXM_ZN);
-
-	float ANXAXM_SQ = vectorMagnitude(ANXAXM_N_X, ANXAXM_N_Y, ANXAXM_N_Z);
-
-	float ANXAXM_NXN = ANXAXM_N_X/ANXAXM_SQ;
-	float ANXAXM_NYN = ANXAXM_N_Y/ANXAXM_SQ;
-	float ANXAXM_NZN = ANXAXM_N_Z/ANXAXM_SQ;
-
-
-	float a11 = axn*AXN + anxaxm_nxn*ANXAXM_NXN + axm_xn*AXM_XN;
-	float a12 = axn*AYN + anxaxm_nxn*ANXAXM_NYN + axm_xn*AXM_YN;
-	float a13 = axn*AZN + anxaxm_nxn*ANXAXM_NZN + axm_xn*AXM_ZN;
-
-	float a21 = AXN*ayn + anxaxm_nyn*ANXAXM_NXN + axm_yn*AXM_XN;
-	float a22 = ayn*AYN + anxaxm_nyn*ANXAXM_NYN + axm_yn*AXM_YN;
-	float a23 = ayn*AZN + anxaxm_nyn*ANXAXM_NZN + axm_yn*AXM_ZN;
-
-	float a31 = AXN*azn + anxaxm_nzn*ANXAXM_NXN + axm_zn*AXM_XN;
-	float a32 = AYN*azn + anxaxm_nzn*ANXAXM_NYN + axm_zn*AXM_YN;
-	float a33 = azn*AZN + anxaxm_nzn*ANXAXM_NZN + axm_zn*AXM_ZN;
-
-	buffer[0]=a11;
-	buffer[1]=a12;
-	buffer[2]=a13;
-	buffer[3]=a21;
-	buffer[4]=a22;
-	buffer[5]=a23;
-	buffer[6]=a31;
-	buffer[7]=a32;
-	buffer[8]=a33;
+	const float a[3] = {calcAccel(ax), calcAccel(ay), calcAccel(az)};
+	const float m[3] = {IMU_ATT_MAG_SIGN_X * calcMag(mx), IMU_ATT_MAG_SIGN_Y * calcMag(my),
+			IMU_ATT_MAG_SIGN_Z * calcMag(mz)};
+	float b1[3], b2[3], b3[3];
+	int i, j;
+
+	triadUpdateReference();
+	if (!triadRef.valid || !buildTriad(a, m, b1, b2, b3))
+		return NULL;
+
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			buffer[3*i + j] = b1[i]*triadRef.r1[j] + b2[i]*triadRef.r2[j] +
+					b3[i]*triadRef.r3[j];
+		}
+	}
 	return buffer;
 
 //	Display_printf(display, 0, 0, "%f, %f, %f, %f, %f, %f, %f, %f, %f", a11, a12, a13, a21, a22, a23, a31, a32, a33);
 }
 
+/*
+ * Fixed-point TRIAD on raw readings, same sign conventions as
+ * computeAttitude(). buffer gets the matrix in Q14, row major. Returns
+ * false if either triad is degenerate.
+ */
+bool computeAttitudeQ14(int16_t mx, int16_t my, int16_t mz, int16_t ax, int16_t ay, int16_t az, int16_t buffer[9])
+{
+	/* Only directions matter, so the sensitivities drop out. calcAccel()
+	 * flips the accel sign, so do the same here. */
+	const int32_t a[3] = {-(int32_t)ax, -(int32_t)ay, -(int32_t)az};
+	const int32_t m[3] = {IMU_ATT_MAG_SIGN_X * mx, IMU_ATT_MAG_SIGN_Y * my,
+			IMU_ATT_MAG_SIGN_Z * mz};
+	int16_t b1[3], b2[3], b3[3], mn[3];
+	int32_t c[3];
+	uint32_t s2 = 0;
+	int i, j;
+
+	triadUpdateReference();
+	if (!triadRef.valid)
+		return false;
+	if (!normalizeQ14(a, b1) || !normalizeQ14(m, mn))
+		return false;
+	crossQ14(b1, mn, c);
+	/* |c| is the sine in Q28, compared squared in Q28 */
+	for (i = 0; i < 3; i++) s2 += (uint32_t)((c[i] >> 14) * (c[i] >> 14));
+	if (s2 < (uint32_t)TRIAD_MIN_SINE_Q14 * TRIAD_MIN_SINE_Q14)
+		return false;
+	if (!normalizeQ14(c, b2))
+		return false;
+	crossQ14(b1, b2, c);
+	if (!normalizeQ14(c, b3))
+		return false;
+
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			int32_t e = (int32_t)b1[i] * triadRef.r1Q14[j] +
+					(int32_t)b2[i] * triadRef.r2Q14[j] +
+					(int32_t)b3[i] * triadRef.r3Q14[j];
+			e = (e + (1 << 13)) >> 14;
+			if (e > INT16_MAX) e = INT16_MAX;
+			if (e < INT16_MIN) e = INT16_MIN;
+			buffer[3*i + j] = (int16_t)e;
+		}
+	}
+	return true;
+}
 
+#if TRIAD_BENCHMARK
+/*
+ * Time TRIAD_BENCH_SOLVES solves of each path with the DWT counter and log
+ * the mean cycles per solve. The readings are fixed (level, field 60
+ * degrees below the horizon); the cost hardly depends on them. Task
+ * context, it takes milliseconds.
+ */
+void triadBenchmark(void)
+{
+	static const int16_t mag[3] = {1786, 0, 3094};
+	static const int16_t accel[3] = {0, 0, -16384};
+	int16_t fixed[9];
+	float reference[9];
+	uint32_t start, cyclesFixed, cyclesFloat;
+	int n;
+
+	cycleCounterInit();
+	triadUpdateReference();
+	start = cycleCount();
+	for (n = 0; n < TRIAD_BENCH_SOLVES; n++)
+		computeAttitudeQ14(mag[0], mag[1], mag[2], accel[0], accel[1], accel[2], fixed);
+	cyclesFixed = cycleCount() - start;
+	start = cycleCount();
+	for (n = 0; n < TRIAD_BENCH_SOLVES; n++)
+		computeAttitude(mag[0], mag[1], mag[2], accel[0], accel[1], accel[2], reference);
+	cyclesFloat = cycleCount() - start;
+	LOG3(LOG_TRIAD_CYCLES, cyclesFixed / TRIAD_BENCH_SOLVES, cyclesFloat / TRIAD_BENCH_SOLVES,
+			TRIAD_BENCH_SOLVES);
+}
+#endif
 
 #endif /* TASKS_IMU_TRIAD_H_ */
@@ -0,0 +1,171 @@
+/*
+ * Log.h
+ *
+ *  Deferred binary logging. LOGn() stores a fixed-size record (record id,
+ *  timestamp and up to LOG_MAX_ARGS integers) in a RAM ring and returns.
+ *  No formatting or UART traffic happens in the caller, so a log costs
+ *  tens of cycles instead of a blocking Display_printf. The low-priority
+ *  drain task empties the ring over the display UART when nothing else
+ *  wants the CPU.
+ *
+ *  With LOG_DRAIN_BINARY the drain sends each record as one short hex
+ *  line, "@id stamp seq arg...", for tools/log_decode.py to turn back into
+ *  text using Log_Records.h. Otherwise the drain formats on the target.
+ *  When the ring is full, new records are dropped and counted. The count
+ *  is reported as a LOG_DROPPED record once there is room again.
+ *
+ *  Being the lowest priority task, the drain also runs the one background
+ *  job set with logSetBackground(), after each drain.
+ */
+
+#ifndef TASKS_LOG_H_
+#define TASKS_LOG_H_
+
+#include <ti/sysbios/BIOS.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/knl/Task.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include "../Peripherals/Display_Initialization.h"
+#include "Log_Records.h"
+
+/* Records held (power of two). The largest burst between two drains is
+ * the Task_Monitor.h report (2 per task + 2, 22 at TASK_MON_MAX_TASKS)
+ * landing with the governor's 3, a LOG_MEKF, LOG_ACCEL (at most one per
+ * drain period) and LOG_DROPPED: 28, so half the ring is slack. */
+#define LOG_RING_SIZE		64
+#define LOG_MAX_ARGS		3
+/* 1 sends records for the host decoder, 0 formats them on the target */
+#define LOG_DRAIN_BINARY	1
+/* The drain runs this often, Clock ticks */
+#define LOG_DRAIN_PERIOD	(100000 / Clock_tickPeriod)
+
+#define LOG_ID(id, argc, format)		id,
+typedef enum
+{
+	LOG_RECORDS(LOG_ID)
+	LOG_RECORD_COUNT
+} logRecord_type;
+#undef LOG_ID
+
+#if !LOG_DRAIN_BINARY
+#define LOG_FORMAT(id, argc, format)	format,
+static const char * const logFormats[LOG_RECORD_COUNT] = {
+	LOG_RECORDS(LOG_FORMAT)
+};
+#undef LOG_FORMAT
+#endif
+
+typedef struct LogRecord
+{
+	uint32_t stamp;			// Clock ticks
+	uint16_t seq;			// Gaps show dropped records
+	uint8_t id;
+	uint8_t argc;
+	int32_t args[LOG_MAX_ARGS];
+} LogRecord;
+
+static LogRecord logRing[LOG_RING_SIZE];
+static volatile uint16_t logHead;		// Next record to write
+static volatile uint16_t logTail;		// Next record to drain
+uint32_t logDropped;
+static uint32_t logDroppedReported;
+static void (*logBackground)(void);
+
+Task_Struct logTask;
+static uint8_t logTaskStack[512];
+
+/* Store one record. Any Task, Swi or Hwi context. */
+void logWrite(logRecord_type id, uint8_t argc, int32_t a0, int32_t a1, int32_t a2)
+{
+	UInt key = Hwi_disable();
+	uint16_t head = logHead;
+	LogRecord *record;
+
+	if ((uint16_t)(head - logTail) >= LOG_RING_SIZE)
+	{
+		logDropped++;
+		Hwi_restore(key);
+		return;
+	}
+	logHead = head + 1;
+	record = &logRing[head & (LOG_RING_SIZE - 1)];
+	record->stamp = Clock_getTicks();
+	record->seq = head;
+	record->id = id;
+	record->argc = argc;
+	record->args[0] = a0;
+	record->args[1] = a1;
+	record->args[2] = a2;
+	Hwi_restore(key);
+}
+
+#define LOG0(id)			logWrite((id), 0, 0, 0, 0)
+#define LOG1(id, a)			logWrite((id), 1, (a), 0, 0)
+#define LOG2(id, a, b)		logWrite((id), 2, (a), (b), 0)
+#define LOG3(id, a, b, c)	logWrite((id), 3, (a), (b), (c))
+
+static void logEmit(const LogRecord *record)
+{
+#if LOG_DRAIN_BINARY
+	Display_printf(display, 0, 0, "@%x %x %x %x %x %x", record->id,
+			record->stamp, record->seq, record->args[0], record->args[1],
+			record->args[2]);
+#else
+	Display_printf(display, 0, 0, logFormats[record->id],
+			record->args[0], record->args[1], record->args[2]);
+#endif
+}
+
+/* Emit everything logged so far */
+void logDrain(void)
+{
+	LogRecord record;
+	UInt key;
+
+	while (logTail != logHead)
+	{
+		/* Copy out first, the slot is free once logTail moves */
+		key = Hwi_disable();
+		record = logRing[logTail & (LOG_RING_SIZE - 1)];
+		logTail++;
+		Hwi_restore(key);
+		logEmit(&record);
+	}
+	if (logDropped != logDroppedReported)
+	{
+		uint32_t dropped = logDropped;
+		LOG1(LOG_DROPPED, dropped - logDroppedReported);
+		logDroppedReported = dropped;
+	}
+}
+
+/* Work that can wait for every other task. Runs on the drain task's
+ * stack, so it has to fit there. */
+void logSetBackground(void (*fxn)(void))
+{
+	logBackground = fxn;
+}
+
+Void logTaskFunc(UArg arg0, UArg arg1)
+{
+	LOG0(LOG_BOOT);
+	while (1) {
+		logDrain();
+		if (logBackground != NULL)
+			logBackground();
+		Task_sleep(LOG_DRAIN_PERIOD);
+	}
+}
+
+void createLogTask()
+{
+	Task_Params task_params;
+	Task_Params_init(&task_params);
+	task_params.stackSize = 512;
+	task_params.priority = 1;
+	task_params.stack = &logTaskStack;
+	Task_construct(&logTask, logTaskFunc,
+					   &task_params, NULL);
+}
+
+#endif /* TASKS_LOG_H_ */
@@ -0,0 +1,32 @@
+/*
+ * Log_Records.h
+ *
+ *  The binary log record table. Each entry is
+ *
+ *      X(id, argument count, "format")
+ *
+ *  and the format takes that many %d/%x arguments. Only the id and the
+ *  arguments are logged. The drain task or tools/log_decode.py, which
+ *  reads this file, supplies the text. Append new records at the end, so
+ *  the ids of logs already captured keep their meaning.
+ */
+
+#ifndef TASKS_LOG_RECORDS_H_
+#define TASKS_LOG_RECORDS_H_
+
+#define LOG_RECORDS(X) \
+	X(LOG_BOOT,			0, "Boot") \
+	X(LOG_ACCEL,		3, "Accel X: %d Y: %d Z: %d") \
+	X(LOG_GYRO,			3, "Gyro X: %d Y: %d Z: %d") \
+	X(LOG_MAG,			3, "Magnetometer X: %d Y: %d Z: %d") \
+	X(LOG_TEMPERATURE,	1, "Temperature: %x") \
+	X(LOG_DROPPED,		1, "Log dropped %d records") \
+	X(LOG_TASK_STACK,	3, "Task %x stack %d of %d bytes") \
+	X(LOG_TASK_CPU,		2, "Task %x CPU %d/1000") \
+	X(LOG_CPU_IDLE,		1, "Idle %d/1000") \
+	X(LOG_HWI_STACK,	2, "Hwi stack %d of %d bytes") \
+	X(LOG_MEKF,			3, "MEKF sigma %d urad, update %d cycles, max %d") \
+	X(LOG_GOVERNOR,		3, "Governor profile %d: %d/1000, entered %d times") \
+	X(LOG_TRIAD_CYCLES,	3, "TRIAD cycles/solve Q14 %d float %d over %d solves")
+
+#endif /* TASKS_LOG_RECORDS_H_ */
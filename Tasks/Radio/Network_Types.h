@@ -15,9 +15,14 @@
 
 typedef enum
 {
-	BEACON = 0x00
+	BEACON = 0x00,
+	/* Position for the field model: sender, then big-endian int16 latitude
+	 * and longitude in 0.01 degrees and uint16 altitude in km */
+	POSITION = 0x01
 } message_type;
 
+#define POSITION_PAYLOAD_LENGTH	8
+
 
 
 
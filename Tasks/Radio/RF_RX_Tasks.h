@@ -12,6 +12,8 @@
 #include <ti/sysbios/knl/Task.h>
 #include "../../Peripherals/Pin_Initialization.h"
 #include "../Semaphore_Initialization.h"
+#include "../Bus_Arbiter.h"
+#include "../IMU/Mag_Model.h"
 
 Task_Struct rxRestartTask;
 Task_Struct rxBeaconTask;
@@ -41,6 +43,15 @@ void rxDoneCb(EasyLink_RxPacket * rxPacket, EasyLink_Status status)
         if (globalPacket.payload[0] == BEACON){
         		Semaphore_post(rxBeaconSemaphoreHandle);
         }
+        else if ((globalPacket.payload[0] == POSITION) &&
+        		(globalPacket.len >= POSITION_PAYLOAD_LENGTH)){
+        		/* The IMU task applies it between frames */
+        		const uint8_t *p = globalPacket.payload;
+        		magModelPost((int16_t)((p[2] << 8) | p[3]) * 0.01f,
+        				(int16_t)((p[4] << 8) | p[5]) * 0.01f,
+        				(float)(uint16_t)((p[6] << 8) | p[7]));
+        		Semaphore_post(rxRestartSemaphoreHandle);
+        }
         else {
         		Semaphore_post(rxRestartSemaphoreHandle);
         }
@@ -67,7 +78,9 @@ Void rxRestartFunc(UArg arg0, UArg arg1)
 {
     while(1) {
     		Semaphore_pend(rxRestartSemaphoreHandle, BIOS_WAIT_FOREVER);
+    		arbiterEnter(RESOURCE_RADIO);
     		EasyLink_receiveAsync(rxDoneCb, 0);
+    		arbiterLeave(RESOURCE_RADIO);
     }
 }
 
@@ -12,8 +12,10 @@
 #include <ti/sysbios/knl/Task.h>
 #include "../../Peripherals/Pin_Initialization.h"
 #include "../Semaphore_Initialization.h"
+#include "../Bus_Arbiter.h"
 #include "../IMU/LSM9DS1.h"
-//#include "TRIAD.h"
+#include "../IMU/Attitude_Filter.h"
+#include "../IMU/MEKF.h"
 
 Task_Struct txDataTask;
 
@@ -49,7 +51,7 @@ Void txDataTaskFunc(UArg arg0, UArg arg1)
 	uint16_t counter = 0x00;
 	while(1) {
 		Semaphore_pend(txDataSemaphoreHandle, BIOS_WAIT_FOREVER);
-		Semaphore_pend(batonSemaphoreHandle, BIOS_WAIT_FOREVER);
+		arbiterEnter(RESOURCE_RADIO);
 
 		if(goodToGo){
 
@@ -59,14 +61,25 @@ Void txDataTaskFunc(UArg arg0, UArg arg1)
 //			txPacket.payload[0] = BEACON;
 //			txPacket.payload[1] = PERSONAL_ADDRESS;
 
+			/* Latest attitude, the MEKF's once it has one, else the
+			 * complementary filter's. Both are NED to body. With the counter
+			 * it fills the 8-byte payload the ground station expects. */
+			uint16_t attitude[3];
+			UInt key = Hwi_disable();
+			const uint16_t *packed = mekfValid ? mekfQuatPacked : attitudePacked;
+			attitude[0] = packed[0];
+			attitude[1] = packed[1];
+			attitude[2] = packed[2];
+			Hwi_restore(key);
+
 			txPacket.payload[0] = (counter>>8)&0xff;
 			txPacket.payload[1] = counter&0xff;
-			txPacket.payload[2] = upperPart(ax);
-			txPacket.payload[3] = lowerPart(ax);
-			txPacket.payload[4] = upperPart(ay);
-			txPacket.payload[5] = lowerPart(ay);
-			txPacket.payload[6] = upperPart(az);
-			txPacket.payload[7] = lowerPart(az);
+			txPacket.payload[2] = upperPart(attitude[0]);
+			txPacket.payload[3] = lowerPart(attitude[0]);
+			txPacket.payload[4] = upperPart(attitude[1]);
+			txPacket.payload[5] = lowerPart(attitude[1]);
+			txPacket.payload[6] = upperPart(attitude[2]);
+			txPacket.payload[7] = lowerPart(attitude[2]);
 
 			if (counter > 0xfffe){
 				counter = 0;
@@ -99,7 +112,7 @@ Void txDataTaskFunc(UArg arg0, UArg arg1)
 			}
 			Semaphore_post(rxRestartSemaphoreHandle);
 		}
-		Semaphore_post(batonSemaphoreHandle);
+		arbiterLeave(RESOURCE_RADIO);
 	}
 }
 
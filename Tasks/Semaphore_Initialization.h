@@ -9,17 +9,18 @@
 #define TASKS_SEMAPHORE_INITIALIZATION_H_
 
 #include <ti/sysbios/knl/Semaphore.h>
+#include <ti/sysbios/knl/Event.h>
 
-/* Semaphore structs */
-
-static Semaphore_Struct magSemaphore;
-static Semaphore_Handle magSemaphoreHandle;
+/* IMU acquisition events, one per source serviced by the IMU task */
+#define IMU_EVENT_XG		Event_Id_00		// Gyro/accel frames read (or FIFO threshold)
+#define IMU_EVENT_MAG		Event_Id_01		// Mag data ready
+#define IMU_EVENT_WAKE		Event_Id_02		// Motion while the gyro sleeps
+#define IMU_EVENT_ALL		(IMU_EVENT_XG | IMU_EVENT_MAG | IMU_EVENT_WAKE)
 
-static Semaphore_Struct gyroSemaphore;
-static Semaphore_Handle gyroSemaphoreHandle;
+static Event_Struct imuEvent;
+static Event_Handle imuEventHandle;
 
-static Semaphore_Struct accelSemaphore;
-static Semaphore_Handle accelSemaphoreHandle;
+/* Semaphore structs */
 
 static Semaphore_Struct txDataSemaphore;
 static Semaphore_Handle txDataSemaphoreHandle;
@@ -33,8 +34,6 @@ static Semaphore_Handle rxBeaconSemaphoreHandle;
 static Semaphore_Struct readSemaphore;
 static Semaphore_Handle readSemaphoreHandle;
 
-static Semaphore_Struct batonSemaphore;
-static Semaphore_Handle batonSemaphoreHandle;
 
 void semaphoreSetup()
 {
@@ -45,15 +44,6 @@ void semaphoreSetup()
 
 	semparams.mode = Semaphore_Mode_BINARY_PRIORITY;
 
-    Semaphore_construct(&magSemaphore, 0, &semparams);
-    magSemaphoreHandle = Semaphore_handle(&magSemaphore);
-
-    Semaphore_construct(&gyroSemaphore, 0, &semparams);
-    gyroSemaphoreHandle = Semaphore_handle(&gyroSemaphore);
-
-    Semaphore_construct(&accelSemaphore, 0, &semparams);
-    accelSemaphoreHandle = Semaphore_handle(&accelSemaphore);
-
 	Semaphore_construct(&txDataSemaphore, 0, &semparams);
 	txDataSemaphoreHandle = Semaphore_handle(&txDataSemaphore);
 
@@ -66,8 +56,10 @@ void semaphoreSetup()
 	Semaphore_construct(&readSemaphore, 0, &semparams);
 	readSemaphoreHandle = Semaphore_handle(&readSemaphore);
 
-    Semaphore_construct(&batonSemaphore, 1, &semparams);
-    batonSemaphoreHandle = Semaphore_handle(&batonSemaphore);
+    Event_Params eventparams;
+    Event_Params_init(&eventparams);
+    Event_construct(&imuEvent, &eventparams);
+    imuEventHandle = Event_handle(&imuEvent);
 }
 
 
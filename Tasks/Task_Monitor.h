@@ -0,0 +1,196 @@
+/*
+ * Task_Monitor.h
+ *
+ *  Stack and CPU usage per task.
+ *
+ *  The kernel paints every task stack at construction (Task.initStackFlag
+ *  in hello.cfg). Task_stat() then finds the deepest point each stack has
+ *  reached, and Hwi_getStackInfo() does the same for the interrupt stack.
+ *  CPU time comes from the Task switch hook, which charges the time since
+ *  the last switch to the task being switched out. Time in the all-blocked
+ *  (idle/sleep) loop is bracketed by two Idle functions either side of
+ *  Power_idleFunc and charged to idle; the interval also ends at the next
+ *  switch. A task readied while the CPU sleeps may be the one that blocked,
+ *  in which case there is no switch, so the exit function is what stops
+ *  its run time being counted as idle. Hwi and Swi time is charged to the
+ *  task they interrupted.
+ *
+ *  Every TASK_MON_REPORT_PERIOD a Clock function logs one LOG_TASK_STACK
+ *  and one LOG_TASK_CPU record per task, plus the idle share and the
+ *  interrupt stack peak. Tasks are identified by their handle, the address
+ *  of the Task_Struct, which tools/log_decode.py --map turns back into the
+ *  symbol name. The hook set and the Idle functions are registered in
+ *  hello.cfg, which keeps the kernel out of ROM for them.
+ */
+
+#ifndef TASKS_TASK_MONITOR_H_
+#define TASKS_TASK_MONITOR_H_
+
+#include <xdc/std.h>
+#include <xdc/runtime/Error.h>
+#include <xdc/runtime/Timestamp.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/knl/Task.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include "Log.h"
+
+/* Tasks tracked, the ones beyond are not counted */
+#define TASK_MON_MAX_TASKS		10
+#define TASK_MON_REPORT_PERIOD	(10000000 / Clock_tickPeriod)
+
+/* One report must fit the log ring with room for everything else */
+#if (2 * TASK_MON_MAX_TASKS + 2) > (LOG_RING_SIZE / 2)
+#error "Task_Monitor.h: a report would fill the log ring, raise LOG_RING_SIZE"
+#endif
+
+typedef struct TaskMonSlot
+{
+	Task_Handle task;
+	uint32_t time;			// Timestamp counts run in this window
+} TaskMonSlot;
+
+static TaskMonSlot taskMonSlots[TASK_MON_MAX_TASKS];
+static uint8_t taskMonCount;
+static Int taskMonHookId;
+static uint32_t taskMonLastSwitch;
+static uint32_t taskMonIdleTime;
+static uint32_t taskMonWindowStart;
+static bool taskMonIdle;
+
+static Clock_Struct taskMonClock;
+
+/* Task hooks, see Task.addHookSet in hello.cfg */
+Void taskMonRegister(Int hookSetId)
+{
+	taskMonHookId = hookSetId;
+}
+
+Void taskMonCreate(Task_Handle task, Error_Block *eb)
+{
+	if (taskMonCount < TASK_MON_MAX_TASKS)
+	{
+		taskMonSlots[taskMonCount].task = task;
+		taskMonSlots[taskMonCount].time = 0;
+		Task_setHookContext(task, taskMonHookId, &taskMonSlots[taskMonCount]);
+		taskMonCount++;
+	}
+}
+
+Void taskMonSwitch(Task_Handle prev, Task_Handle next)
+{
+	uint32_t now = Timestamp_get32();
+	uint32_t delta = now - taskMonLastSwitch;
+	TaskMonSlot *slot;
+
+	taskMonLastSwitch = now;
+	if (taskMonIdle)
+	{
+		taskMonIdle = false;
+		taskMonIdleTime += delta;
+		return;
+	}
+	if (prev == NULL)
+		return;
+	slot = (TaskMonSlot *)Task_getHookContext(prev, taskMonHookId);
+	if (slot != NULL)
+		slot->time += delta;
+}
+
+/* Idle function ahead of Power_idleFunc: every task is blocked */
+Void taskMonIdleFxn(void)
+{
+	UInt key;
+
+	if (taskMonIdle)
+		return;
+	key = Hwi_disable();
+	taskMonSwitch(Task_self(), NULL);
+	taskMonIdle = true;
+	Hwi_restore(key);
+}
+
+/* Idle function after Power_idleFunc: the CPU is awake again */
+Void taskMonIdleExit(void)
+{
+	UInt key = Hwi_disable();
+	uint32_t now = Timestamp_get32();
+
+	if (taskMonIdle)
+	{
+		taskMonIdle = false;
+		taskMonIdleTime += now - taskMonLastSwitch;
+		taskMonLastSwitch = now;
+	}
+	Hwi_restore(key);
+}
+
+/* Log the window just ended and start a new one. Clock (Swi) context. */
+static Void taskMonReport(UArg arg)
+{
+	Task_Stat stat;
+	Hwi_StackInfo hwiStack;
+	uint32_t now, window;
+	uint8_t i;
+	UInt key;
+
+	/* Charge the running task up to now, so the window adds up */
+	key = Hwi_disable();
+	now = Timestamp_get32();
+	if (taskMonIdle)
+	{
+		taskMonIdleTime += now - taskMonLastSwitch;
+		taskMonLastSwitch = now;
+	}
+	else
+	{
+		taskMonSwitch(Task_self(), NULL);
+	}
+	window = now - taskMonWindowStart;
+	taskMonWindowStart = now;
+	Hwi_restore(key);
+	if (window == 0)
+		return;
+
+	for (i = 0; i < taskMonCount; i++)
+	{
+		uint32_t time;
+
+		key = Hwi_disable();
+		time = taskMonSlots[i].time;
+		taskMonSlots[i].time = 0;
+		Hwi_restore(key);
+
+		Task_stat(taskMonSlots[i].task, &stat);
+		LOG3(LOG_TASK_STACK, (uint32_t)(uintptr_t)taskMonSlots[i].task, stat.used, stat.stackSize);
+		LOG2(LOG_TASK_CPU, (uint32_t)(uintptr_t)taskMonSlots[i].task,
+			 (uint32_t)(((uint64_t)time * 1000) / window));
+	}
+
+	key = Hwi_disable();
+	now = taskMonIdleTime;
+	taskMonIdleTime = 0;
+	Hwi_restore(key);
+	LOG1(LOG_CPU_IDLE, (uint32_t)(((uint64_t)now * 1000) / window));
+
+	Hwi_getStackInfo(&hwiStack, TRUE);
+	LOG2(LOG_HWI_STACK, hwiStack.hwiStackPeak, hwiStack.hwiStackSize);
+}
+
+/* Start the periodic report. Call before BIOS_start(). */
+void taskMonSetup(void)
+{
+	Clock_Params clkParams;
+	Clock_Params_init(&clkParams);
+
+	taskMonLastSwitch = Timestamp_get32();
+	taskMonWindowStart = taskMonLastSwitch;
+	taskMonIdleTime = 0;
+	taskMonIdle = false;
+
+	clkParams.period = TASK_MON_REPORT_PERIOD;
+	clkParams.startFlag = TRUE;
+	Clock_construct(&taskMonClock, (Clock_FuncPtr)taskMonReport,
+					TASK_MON_REPORT_PERIOD, &clkParams);
+}
+
+#endif /* TASKS_TASK_MONITOR_H_ */
@@ -37,8 +37,11 @@
 #include "Tasks/IMU/IMU_Tasks.h"
 #include <Tasks/Semaphore_Initialization.h>
 #include <Tasks/Shared_Resources.h>
+#include <Tasks/Bus_Arbiter.h>
 #include <Tasks/ADC_Tasks.h>
 #include <Tasks/PWM_Tasks.h>
+#include <Tasks/Log.h>
+#include <Tasks/Task_Monitor.h>
 
 /*
  *  ======== main ========
@@ -61,17 +64,18 @@ int main(void)
     wdtSetup();
     clockSetup();
 	semaphoreSetup();
+	arbiterSetup();
+	taskMonSetup();
 	pinSetup();
 
 	/* Construct tasks */
-    createMagTask();
-    createGyroTask();
-    createAccelTask();
+    createIMUTask();
 //    createGPSTask();
     createADCTask();
     createRFRXTasks();
     createRFTXTasks();
     createPWMTask();
+    createLogTask();
 
     /* Start kernel. */
     BIOS_start();
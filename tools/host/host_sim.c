@@ -0,0 +1,460 @@
+/*
+ * host_sim.c
+ *
+ *  Event queue and the TI-RTOS kernel calls the IMU code uses, on top of
+ *  simulated time. See host_sim.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ti/sysbios/BIOS.h>
+#include <ti/sysbios/hal/Hwi.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <ti/sysbios/knl/Event.h>
+#include <ti/sysbios/knl/Semaphore.h>
+#include <ti/sysbios/knl/Task.h>
+#include <xdc/runtime/Timestamp.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "host_sim.h"
+
+UInt32 Clock_tickPeriod = 10;
+
+typedef struct HostEvent
+{
+	uint64_t at;
+	uint64_t seq;
+	HostEventFxn fxn;
+	void *arg;
+	bool used;
+} HostEvent;
+
+static HostEvent hostEvents[HOST_SIM_EVENTS];
+static uint64_t hostNow;
+static uint64_t hostSeq;
+
+static uint64_t ticksToNs(UInt32 ticks)
+{
+	return (uint64_t)ticks * Clock_tickPeriod * 1000;
+}
+
+void hostSimReset(void)
+{
+	int i;
+
+	for (i = 0; i < HOST_SIM_EVENTS; i++) hostEvents[i].used = false;
+	hostNow = 0;
+	hostSeq = 0;
+}
+
+uint64_t hostNowNs(void)
+{
+	return hostNow;
+}
+
+void hostSchedule(uint64_t atNs, HostEventFxn fxn, void *arg)
+{
+	int i;
+
+	for (i = 0; i < HOST_SIM_EVENTS; i++)
+	{
+		if (!hostEvents[i].used)
+		{
+			hostEvents[i].at = (atNs < hostNow) ? hostNow : atNs;
+			hostEvents[i].seq = hostSeq++;
+			hostEvents[i].fxn = fxn;
+			hostEvents[i].arg = arg;
+			hostEvents[i].used = true;
+			return;
+		}
+	}
+	fprintf(stderr, "host_sim: event queue full\n");
+	abort();
+}
+
+static int hostEarliest(void)
+{
+	int i, best = -1;
+
+	for (i = 0; i < HOST_SIM_EVENTS; i++)
+	{
+		if (!hostEvents[i].used)
+			continue;
+		if ((best < 0) || (hostEvents[i].at < hostEvents[best].at) ||
+			((hostEvents[i].at == hostEvents[best].at) &&
+			 (hostEvents[i].seq < hostEvents[best].seq)))
+			best = i;
+	}
+	return best;
+}
+
+bool hostNextEvent(uint64_t *atNs)
+{
+	int i = hostEarliest();
+
+	if (i < 0)
+		return false;
+	*atNs = hostEvents[i].at;
+	return true;
+}
+
+bool hostStep(void)
+{
+	int i = hostEarliest();
+	HostEvent event;
+
+	if (i < 0)
+		return false;
+	event = hostEvents[i];
+	hostEvents[i].used = false;
+	hostNow = event.at;
+	event.fxn(event.arg);
+	return true;
+}
+
+void hostRunUntil(uint64_t atNs)
+{
+	uint64_t next;
+
+	while (hostNextEvent(&next) && (next <= atNs))
+		hostStep();
+	if (atNs > hostNow)
+		hostNow = atNs;
+}
+
+uint64_t hostCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return hostWallNs();
+#endif
+}
+
+/* Peripherals/Cycle_Counter.h under CYCLE_COUNTER_HOST */
+void cycleCounterInit(void)
+{
+}
+
+uint32_t cycleCount(void)
+{
+	return (uint32_t)hostCycles();
+}
+
+uint64_t hostWallNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/* ===============================================================
+ * =================== Kernel ====================================
+ * ===============================================================
+ */
+void BIOS_start(void)
+{
+}
+
+Bool Hwi_getStackInfo(Hwi_StackInfo *info, Bool computeStackDepth)
+{
+	(void)computeStackDepth;
+	info->hwiStackPeak = 0;
+	info->hwiStackSize = 0;
+	info->hwiStackBase = NULL;
+	return FALSE;
+}
+
+UInt32 Timestamp_get32(void)
+{
+	return (UInt32)(hostNow * (HOST_TIMESTAMP_HZ / 1000000) / 1000);
+}
+
+void Timestamp_getFreq(Types_FreqHz *freq)
+{
+	freq->hi = 0;
+	freq->lo = HOST_TIMESTAMP_HZ;
+}
+
+UInt32 Clock_getTicks(void)
+{
+	return (UInt32)(hostNow / ticksToNs(1));
+}
+
+void Clock_Params_init(Clock_Params *params)
+{
+	params->period = 0;
+	params->startFlag = FALSE;
+	params->arg = 0;
+}
+
+static void clockFire(void *arg)
+{
+	Clock_Struct *clock = (Clock_Struct *)arg;
+
+	if (!clock->active)
+		return;
+	if (clock->period)
+		hostSchedule(hostNow + ticksToNs(clock->period), clockFire, clock);
+	else
+		clock->active = FALSE;
+	clock->fxn(clock->arg);
+}
+
+void Clock_construct(Clock_Struct *clock, Clock_FuncPtr fxn, UInt32 timeout,
+		const Clock_Params *params)
+{
+	clock->fxn = fxn;
+	clock->timeout = timeout;
+	clock->period = params ? params->period : 0;
+	clock->arg = params ? params->arg : 0;
+	clock->active = FALSE;
+	if (params && params->startFlag)
+		Clock_start(clock);
+}
+
+/* A restart while the old expiry is pending fires twice, as the
+ * harnesses never do that it is not handled */
+void Clock_start(Clock_Handle clock)
+{
+	clock->active = TRUE;
+	hostSchedule(hostNow + ticksToNs(clock->timeout), clockFire, clock);
+}
+
+void Clock_stop(Clock_Handle clock)
+{
+	clock->active = FALSE;
+}
+
+void Clock_setPeriod(Clock_Handle clock, UInt32 period)
+{
+	clock->period = period;
+}
+
+void Clock_setTimeout(Clock_Handle clock, UInt32 timeout)
+{
+	clock->timeout = timeout;
+}
+
+void Semaphore_Params_init(Semaphore_Params *params)
+{
+	params->mode = Semaphore_Mode_COUNTING;
+}
+
+void Semaphore_construct(Semaphore_Struct *sem, Int count, const Semaphore_Params *params)
+{
+	sem->count = count;
+	sem->mode = params ? params->mode : Semaphore_Mode_COUNTING;
+}
+
+/* Run events until posted or the timeout passes */
+static bool hostWait(bool (*ready)(void *), void *arg, UInt32 timeout)
+{
+	uint64_t deadline = hostNow + ticksToNs(timeout);
+	uint64_t next;
+
+	while (!ready(arg))
+	{
+		if (timeout == BIOS_NO_WAIT)
+			return false;
+		if (!hostNextEvent(&next))
+		{
+			if (timeout == BIOS_WAIT_FOREVER)
+			{
+				fprintf(stderr, "host_sim: pend forever with nothing pending\n");
+				abort();
+			}
+			hostNow = deadline;
+			return false;
+		}
+		if ((timeout != BIOS_WAIT_FOREVER) && (next > deadline))
+		{
+			hostNow = deadline;
+			return false;
+		}
+		hostStep();
+	}
+	return true;
+}
+
+static bool semaphoreReady(void *arg)
+{
+	return ((Semaphore_Struct *)arg)->count > 0;
+}
+
+Bool Semaphore_pend(Semaphore_Handle sem, UInt32 timeout)
+{
+	if (!hostWait(semaphoreReady, sem, timeout))
+		return FALSE;
+	sem->count--;
+	return TRUE;
+}
+
+void Semaphore_post(Semaphore_Handle sem)
+{
+	if ((sem->mode == Semaphore_Mode_BINARY) || (sem->mode == Semaphore_Mode_BINARY_PRIORITY))
+		sem->count = 1;
+	else
+		sem->count++;
+}
+
+typedef struct EventWait
+{
+	Event_Handle event;
+	UInt andMask, orMask;
+} EventWait;
+
+static bool eventReady(void *arg)
+{
+	EventWait *wait = (EventWait *)arg;
+	UInt posted = wait->event->posted;
+
+	return ((wait->andMask != 0) && ((posted & wait->andMask) == wait->andMask)) ||
+		(posted & wait->orMask);
+}
+
+UInt Event_pend(Event_Handle event, UInt andMask, UInt orMask, UInt32 timeout)
+{
+	EventWait wait;
+	UInt matched;
+
+	wait.event = event;
+	wait.andMask = andMask;
+	wait.orMask = orMask;
+	if (!hostWait(eventReady, &wait, timeout))
+		return 0;
+	matched = event->posted & (andMask | orMask);
+	event->posted &= ~matched;
+	return matched;
+}
+
+void Event_post(Event_Handle event, UInt eventMask)
+{
+	event->posted |= eventMask;
+}
+
+static Task_Struct hostTask;
+
+void Task_Params_init(Task_Params *params)
+{
+	params->stackSize = 0;
+	params->priority = 1;
+	params->stack = NULL;
+	params->arg0 = 0;
+	params->arg1 = 0;
+	params->env = NULL;
+}
+
+void Task_construct(Task_Struct *task, Task_FuncPtr fxn, const Task_Params *params,
+		void *eb)
+{
+	(void)eb;
+	task->fxn = fxn;
+	task->params = *params;
+	task->hookContext = NULL;
+}
+
+void Task_sleep(UInt32 ticks)
+{
+	hostRunUntil(hostNow + ticksToNs(ticks));
+}
+
+Task_Handle Task_self(void)
+{
+	return &hostTask;
+}
+
+void Task_stat(Task_Handle task, Task_Stat *stat)
+{
+	stat->priority = task->params.priority;
+	stat->stack = task->params.stack;
+	stat->stackSize = task->params.stackSize;
+	stat->stackHeap = NULL;
+	stat->env = task->params.env;
+	stat->mode = Task_Mode_READY;
+	stat->sp = NULL;
+	stat->used = 0;
+}
+
+void *Task_getHookContext(Task_Handle task, Int id)
+{
+	(void)id;
+	return task->hookContext;
+}
+
+void Task_setHookContext(Task_Handle task, Int id, void *context)
+{
+	(void)id;
+	task->hookContext = context;
+}
+
+/* ===============================================================
+ * =================== Pins ======================================
+ * ===============================================================
+ */
+#define HOST_PINS	32
+
+static PIN_State *hostPinState;
+static PIN_IntCb hostPinCb;
+static PIN_Config hostPinIrq[HOST_PINS];
+static uint32_t hostPinOut[HOST_PINS];
+
+PIN_Handle PIN_open(PIN_State *state, const PIN_Config pinList[])
+{
+	int i;
+
+	for (i = 0; pinList[i] != PIN_TERMINATE; i++)
+	{
+		PIN_Id pin = PIN_ID(pinList[i]);
+		if (pin < HOST_PINS)
+			hostPinIrq[pin] = pinList[i] & (3u << 16);
+	}
+	hostPinState = state;
+	return state;
+}
+
+int PIN_registerIntCb(PIN_Handle handle, PIN_IntCb callbackFxn)
+{
+	(void)handle;
+	hostPinCb = callbackFxn;
+	return 0;
+}
+
+int PIN_setInterrupt(PIN_Handle handle, PIN_Config pinCfg)
+{
+	PIN_Id pin = PIN_ID(pinCfg);
+
+	(void)handle;
+	if (pin < HOST_PINS)
+		hostPinIrq[pin] = pinCfg & (3u << 16);
+	return 0;
+}
+
+int PIN_setOutputValue(PIN_Handle handle, PIN_Id pinId, uint32_t val)
+{
+	(void)handle;
+	if (pinId < HOST_PINS)
+		hostPinOut[pinId] = val;
+	return 0;
+}
+
+uint32_t PIN_getOutputValue(PIN_Id pinId)
+{
+	return (pinId < HOST_PINS) ? hostPinOut[pinId] : 0;
+}
+
+uint32_t PIN_getInputValue(PIN_Id pinId)
+{
+	(void)pinId;
+	return 0;
+}
+
+void hostPinEdge(PIN_Id pin)
+{
+	if ((pin < HOST_PINS) && hostPinIrq[pin] && hostPinCb)
+		hostPinCb(hostPinState, pin);
+}
@@ -0,0 +1,51 @@
+/*
+ * host_sim.h
+ *
+ *  Simulated time for running the firmware headers on a Linux host. There
+ *  is one thread: the harness plays the task, and interrupt-like work
+ *  (pin edges, I2C completions, Clock functions) runs from a timed event
+ *  queue whenever the task blocks, sleeps or calls hostRunUntil(). So a
+ *  run is deterministic and does not depend on the speed of the host.
+ *
+ *  Clock ticks are hostNowNs() / (Clock_tickPeriod * 1000) and Timestamp
+ *  counts at HOST_TIMESTAMP_HZ, as on the target.
+ */
+
+#ifndef TOOLS_HOST_HOST_SIM_H_
+#define TOOLS_HOST_HOST_SIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <ti/drivers/PIN.h>
+
+/* Timed events pending at once */
+#define HOST_SIM_EVENTS		64
+
+typedef void (*HostEventFxn)(void *arg);
+
+/* Back to time zero, with no events pending */
+void hostSimReset(void);
+
+uint64_t hostNowNs(void);
+
+/* Run fxn(arg) at atNs, in posting order for equal times */
+void hostSchedule(uint64_t atNs, HostEventFxn fxn, void *arg);
+
+/* Run the earliest event, moving time to it. False if none is pending. */
+bool hostStep(void);
+
+/* Time of the earliest event, false if none is pending */
+bool hostNextEvent(uint64_t *atNs);
+
+/* Run every event up to atNs, then move time to atNs */
+void hostRunUntil(uint64_t atNs);
+
+/* Raise a pin edge, as a device model's interrupt line would */
+void hostPinEdge(PIN_Id pin);
+
+/* Host time for benchmarks: TSC counts on x86, else nanoseconds */
+uint64_t hostCycles(void);
+/* Wall-clock nanoseconds */
+uint64_t hostWallNs(void);
+
+#endif /* TOOLS_HOST_HOST_SIM_H_ */
@@ -0,0 +1,186 @@
+/*
+ * i2c_bus.c
+ *
+ *  Host I2C driver on the bus model, see i2c_bus.h.
+ */
+
+#include <string.h>
+#include <ti/drivers/I2C.h>
+
+#include "host_sim.h"
+#include "i2c_bus.h"
+
+struct I2C_Config
+{
+	I2C_Params params;
+	bool open;
+	bool busy;
+	I2C_Transaction *transaction;
+};
+
+HostI2CStats hostI2CStats;
+uint32_t hostI2COverheadNs = 10000;
+
+static struct I2C_Config hostI2C;
+static HostI2CDevice *hostI2CDevices;
+
+void hostI2CReset(void)
+{
+	hostI2CDevices = NULL;
+	memset(&hostI2CStats, 0, sizeof(hostI2CStats));
+	hostI2C.busy = false;
+}
+
+void hostI2CAttach(HostI2CDevice *dev)
+{
+	dev->next = hostI2CDevices;
+	hostI2CDevices = dev;
+}
+
+static HostI2CDevice *hostI2CFind(uint8_t address)
+{
+	HostI2CDevice *dev;
+
+	for (dev = hostI2CDevices; dev; dev = dev->next)
+	{
+		if (dev->address == address)
+			return dev;
+	}
+	return NULL;
+}
+
+static uint32_t hostI2CBitNs(void)
+{
+	return (hostI2C.params.bitRate == I2C_100kHz) ? 10000 : 2500;
+}
+
+uint64_t hostI2CDurationNs(size_t writeCount, size_t readCount)
+{
+	uint64_t bits = 2 + 9 * (1 + writeCount);
+
+	if (readCount)
+		bits += 1 + 9 * (1 + readCount);
+	return bits * hostI2CBitNs() + hostI2COverheadNs;
+}
+
+/* Carry out a transaction on the devices, true if every byte was ACKed */
+static bool hostI2CExecute(I2C_Transaction *t)
+{
+	HostI2CDevice *dev = hostI2CFind(t->slaveAddress);
+	bool ok;
+
+	hostI2CStats.transfers++;
+	if (!dev)
+	{
+		hostI2CStats.nacks++;
+		hostI2CStats.busyNs += hostI2CDurationNs(0, 0);
+		return false;
+	}
+	hostI2CStats.busyNs += hostI2CDurationNs(t->writeCount, t->readCount);
+	ok = true;
+	if (t->writeCount)
+		ok = dev->write(dev->ctx, (const uint8_t *)t->writeBuf, t->writeCount);
+	if (ok && t->readCount)
+		ok = dev->read(dev->ctx, (uint8_t *)t->readBuf, t->readCount);
+	if (ok)
+		hostI2CStats.bytes += t->writeCount + t->readCount;
+	else
+		hostI2CStats.nacks++;
+	return ok;
+}
+
+static void hostI2CComplete(void *arg)
+{
+	struct I2C_Config *bus = (struct I2C_Config *)arg;
+	I2C_Transaction *t = bus->transaction;
+	bool ok = hostI2CExecute(t);
+
+	bus->busy = false;
+	bus->params.transferCallbackFxn(bus, t, ok);
+}
+
+void I2C_init(void)
+{
+}
+
+void I2C_Params_init(I2C_Params *params)
+{
+	params->transferMode = I2C_MODE_BLOCKING;
+	params->transferCallbackFxn = NULL;
+	params->bitRate = I2C_100kHz;
+	params->custom = NULL;
+}
+
+I2C_Handle I2C_open(uint_least8_t index, I2C_Params *params)
+{
+	(void)index;
+	if (hostI2C.open)
+		return NULL;
+	hostI2C.params = *params;
+	hostI2C.open = true;
+	hostI2C.busy = false;
+	return &hostI2C;
+}
+
+void I2C_close(I2C_Handle handle)
+{
+	handle->open = false;
+}
+
+bool I2C_transfer(I2C_Handle handle, I2C_Transaction *transaction)
+{
+	uint64_t duration = hostI2CDurationNs(transaction->writeCount, transaction->readCount);
+
+	if (handle->busy)
+	{
+		hostI2CStats.refused++;
+		return false;
+	}
+	if (handle->params.transferMode == I2C_MODE_CALLBACK)
+	{
+		handle->busy = true;
+		handle->transaction = transaction;
+		hostSchedule(hostNowNs() + duration, hostI2CComplete, handle);
+		return true;
+	}
+	handle->busy = true;
+	hostRunUntil(hostNowNs() + duration);
+	handle->busy = false;
+	return hostI2CExecute(transaction);
+}
+
+/* ===============================================================
+ * =================== Register file =============================
+ * ===============================================================
+ */
+static bool regFileWrite(void *ctx, const uint8_t *data, size_t count)
+{
+	HostRegFile *file = (HostRegFile *)ctx;
+	size_t i;
+
+	file->pointer = data[0] & 0x7F;
+	for (i = 1; i < count; i++)
+		file->regs[file->pointer++] = data[i];
+	return true;
+}
+
+static bool regFileRead(void *ctx, uint8_t *data, size_t count)
+{
+	HostRegFile *file = (HostRegFile *)ctx;
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		data[i] = file->regs[file->pointer++];
+	return true;
+}
+
+void hostRegFileInit(HostRegFile *file, uint8_t address)
+{
+	memset(file->regs, 0, sizeof(file->regs));
+	file->pointer = 0;
+	file->dev.address = address;
+	file->dev.write = regFileWrite;
+	file->dev.read = regFileRead;
+	file->dev.ctx = file;
+	hostI2CAttach(&file->dev);
+}
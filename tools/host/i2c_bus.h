@@ -0,0 +1,66 @@
+/*
+ * i2c_bus.h
+ *
+ *  I2C bus model behind the host I2C driver. A transfer takes
+ *
+ *    START + address + write bytes [+ repeated START + address + read
+ *    bytes] + STOP
+ *
+ *  at 9 SCL periods per byte and one per START/STOP, plus
+ *  hostI2COverheadNs of driver set-up. The device is accessed when the
+ *  transfer completes. In callback mode the completion runs from the
+ *  event loop; I2C_transfer() refuses a second transfer while one is in
+ *  flight. An address with no device attached is NACKed.
+ */
+
+#ifndef TOOLS_HOST_I2C_BUS_H_
+#define TOOLS_HOST_I2C_BUS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct HostI2CDevice
+{
+	uint8_t address;
+	/* Write phase, data[0] is the register address. False NACKs. */
+	bool (*write)(void *ctx, const uint8_t *data, size_t count);
+	/* Read phase, from the register pointer left by the write */
+	bool (*read)(void *ctx, uint8_t *data, size_t count);
+	void *ctx;
+	struct HostI2CDevice *next;
+} HostI2CDevice;
+
+typedef struct HostI2CStats
+{
+	uint32_t transfers;
+	uint32_t nacks;
+	uint32_t refused;			// I2C_transfer() while busy
+	uint64_t bytes;				// Data bytes, both directions
+	uint64_t busyNs;			// Bus time of all transfers
+} HostI2CStats;
+
+extern HostI2CStats hostI2CStats;
+/* Driver set-up and completion Swi per transfer, added to the bus time */
+extern uint32_t hostI2COverheadNs;
+
+/* Detach every device and clear the statistics */
+void hostI2CReset(void);
+void hostI2CAttach(HostI2CDevice *dev);
+/* Bus time of a transfer at the open bit rate */
+uint64_t hostI2CDurationNs(size_t writeCount, size_t readCount);
+
+/*
+ * Plain 256-byte register file. The first byte written sets the register
+ * pointer (bit 7 masked), which then increments on every byte.
+ */
+typedef struct HostRegFile
+{
+	HostI2CDevice dev;
+	uint8_t regs[256];
+	uint8_t pointer;
+} HostRegFile;
+
+void hostRegFileInit(HostRegFile *file, uint8_t address);
+
+#endif /* TOOLS_HOST_I2C_BUS_H_ */
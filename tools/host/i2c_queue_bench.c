@@ -0,0 +1,166 @@
+/*
+ * i2c_queue_bench.c
+ *
+ *  Throughput and latency of Tasks/IMU/I2C_Queue.h on the simulated
+ *  400 kHz bus, against a plain register file at the XG address.
+ *
+ *    blocking   one i2cQueueTransfer() after another, i.e. the old
+ *               blocking driver with the queue as a pass-through
+ *    drdy       952 Hz data-ready edges post the 12-byte gyro/accel burst
+ *               from interrupt context. Every fifth edge also wakes a
+ *               task that writes a register.
+ *    burst      edges post 12 bursts at once, more than the queue holds.
+ *               Interrupt posts overflow and are counted; the task's
+ *               writes wait for space and must all succeed.
+ *
+ *  Latency is from the post to the completion callback, in simulated
+ *  time. "host ns" is the wall-clock cost per transfer of the queue plus
+ *  the bus model, for spotting regressions in the queue code only.
+ *
+ *    make -C tools/host run
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#include "host_sim.h"
+#include "i2c_bus.h"
+#include "Tasks/IMU/I2C_Queue.h"
+
+#define XG_ADDRESS		0x6B
+#define OUT_X_L_G		0x18
+#define BURST_BYTES		12
+#define DRDY_PERIOD_NS	1050420		/* 952 Hz */
+#define WRITE_EDGES		5
+#define RUN_NS			2000000000ull
+
+typedef struct Latency
+{
+	uint64_t posted[I2C_QUEUE_SIZE];
+	uint64_t sum, max;
+	uint32_t count;
+} Latency;
+
+static HostRegFile xg;
+static Latency latency;
+static uint8_t rxBuffer[I2C_QUEUE_SIZE][BURST_BYTES];
+static uint8_t slot;
+static int burstReads = 1;
+static uint32_t isrPosted, isrRefused, edges;
+static Semaphore_Struct writeSemStruct;
+
+static void burstDone(bool status, UArg arg)
+{
+	uint64_t t = hostNowNs() - latency.posted[arg];
+
+	(void)status;
+	latency.sum += t;
+	if (t > latency.max) latency.max = t;
+	latency.count++;
+}
+
+/* Pin interrupt: queue the gyro/accel burst */
+static void drdyEdge(void *arg)
+{
+	uint8_t tx = OUT_X_L_G | 0x80;
+	int i;
+
+	for (i = 0; i < burstReads; i++)
+	{
+		uint8_t s = slot++ & (I2C_QUEUE_SIZE - 1);
+		latency.posted[s] = hostNowNs();
+		if (i2cQueuePost(XG_ADDRESS, &tx, 1, rxBuffer[s], BURST_BYTES, burstDone, s))
+			isrPosted++;
+		else
+			isrRefused++;
+	}
+	if (++edges % WRITE_EDGES == 0)
+		Semaphore_post(Semaphore_handle(&writeSemStruct));
+	hostSchedule(hostNowNs() + DRDY_PERIOD_NS, drdyEdge, arg);
+}
+
+static void setup(void)
+{
+	hostSimReset();
+	hostI2CReset();
+	hostRegFileInit(&xg, XG_ADDRESS);
+	if (i2c) I2C_close(i2c);
+	i2cQueueOpen();
+	i2cQueueCompleted = i2cQueueFailed = i2cQueueOverflows = 0;
+	i2cQueueMaxDepth = 0;
+	latency.sum = latency.max = 0;
+	latency.count = 0;
+	isrPosted = isrRefused = edges = 0;
+	Semaphore_construct(&writeSemStruct, 0, NULL);
+}
+
+static void report(const char *name, uint64_t wallNs)
+{
+	double seconds = hostNowNs() * 1e-9;
+	uint32_t transfers = i2cQueueCompleted + i2cQueueFailed;
+
+	printf("%-9s %7.0f xfer/s  load %5.1f%%  latency mean %6.1f max %6.1f us  "
+			"depth %u  overflows %lu  host %4.0f ns/xfer\n",
+			name, transfers / seconds, i2cQueueLoad() * 100.0 / 1024,
+			latency.count ? latency.sum / 1e3 / latency.count : 0.0, latency.max / 1e3,
+			i2cQueueMaxDepth, (unsigned long)i2cQueueOverflows,
+			transfers ? (double)wallNs / transfers : 0.0);
+}
+
+int main(void)
+{
+	uint8_t tx = OUT_X_L_G | 0x80;
+	uint8_t frame[BURST_BYTES];
+	uint8_t reg[2] = {0x10, 0};
+	uint32_t writes, writeFailures;
+	uint64_t wall;
+	int failures = 0;
+	int i;
+
+	/* Blocking reads back to back */
+	setup();
+	wall = hostWallNs();
+	for (i = 0; i < 2000; i++)
+	{
+		uint64_t t = hostNowNs();
+		if (!i2cQueueTransfer(XG_ADDRESS, &tx, 1, frame, BURST_BYTES))
+			failures++;
+		t = hostNowNs() - t;
+		latency.sum += t;
+		if (t > latency.max) latency.max = t;
+		latency.count++;
+	}
+	report("blocking", hostWallNs() - wall);
+
+	/* Data-ready reads from interrupt context, task writes in between */
+	for (burstReads = 1; burstReads <= 12; burstReads += 11)
+	{
+		setup();
+		writes = writeFailures = 0;
+		hostSchedule(0, drdyEdge, NULL);
+		wall = hostWallNs();
+		while (hostNowNs() < RUN_NS)
+		{
+			reg[1]++;
+			if (!i2cQueueTransfer(XG_ADDRESS, reg, 2, NULL, 0))
+				writeFailures++;
+			writes++;
+			if (xg.regs[0x10] != reg[1])
+				writeFailures++;
+			/* Runs right after the edge, when the queue is fullest */
+			Semaphore_pend(Semaphore_handle(&writeSemStruct), BIOS_WAIT_FOREVER);
+		}
+		report((burstReads == 1) ? "drdy" : "burst", hostWallNs() - wall);
+		printf("          isr posts %lu refused %lu, task writes %lu failed %lu\n",
+				(unsigned long)isrPosted, (unsigned long)isrRefused,
+				(unsigned long)writes, (unsigned long)writeFailures);
+		failures += writeFailures;
+		if ((burstReads == 1) && isrRefused)
+			failures++;
+	}
+
+	if (failures)
+		printf("FAILED: %d\n", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,253 @@
+/*
+ * interleave_bench.c
+ *
+ *  Two LSM9DS1s on one simulated 400 kHz bus (LSM9DS1_DEVICE_COUNT 2),
+ *  register files at the SA-high and SA-low addresses. Compares the
+ *  gyro/accel read schedules at each gyro ODR:
+ *
+ *    interleaved  the data-ready interrupt queues both 12-byte bursts with
+ *                 readGyroAccelAllAsync() and the task wakes on the event
+ *                 posted after the second one
+ *    sequential   the interrupt wakes the task, which selects each device
+ *                 in turn and calls the blocking readGyroAccel()
+ *
+ *  In both the task spends a fixed time on each wake-up (the fusion that
+ *  follows the read, 300 and 700 us) and reads the two magnetometers at 20 Hz. Interrupts
+ *  run during that work, edges that arrive while the task is busy
+ *  coalesce. Task wake-up is instantaneous in the simulation, so the
+ *  sequential figures are a lower bound for that schedule.
+ *
+ *    skew      time between the two devices' data phases on the bus
+ *    delay     latest data-ready edge to the end of device 0's read, i.e.
+ *              how late the sample is taken after the edge; 355 us is the
+ *              12-byte burst itself
+ *    frames    published by device 0 over edges
+ *
+ *  Before the runs both devices are brought up with LSM9DS1begin(); the
+ *  boot figures must be per device and each ring must hold its own
+ *  device's samples, otherwise the run fails.
+ *
+ *    make -C tools/host run
+ */
+
+#define LSM9DS1_DEVICE_COUNT	2
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host_sim.h"
+#include "i2c_bus.h"
+#include "Tasks/IMU/LSM9DS1.h"
+
+#define XG_EVENT		Event_Id_00
+#define MAG_RATE_HZ		20
+#define RUN_NS			1000000000ull
+
+typedef enum { INTERLEAVED, SEQUENTIAL } Schedule;
+
+static const char *scheduleNames[] = {"interleaved", "sequential"};
+
+static HostRegFile xgFiles[LSM9DS1_DEVICE_COUNT], mFiles[LSM9DS1_DEVICE_COUNT];
+static uint64_t edgeNs, periodNs, dataNs;
+static uint64_t delaySum, delayMax, skewSum;
+static uint32_t reads;
+static uint32_t edges;
+static Schedule schedule;
+static Event_Struct xgEventStruct;
+static Semaphore_Struct edgeSemStruct;
+
+/*
+ * xg register file read, noting when the output registers go out. Like the
+ * chip, the pointer rolls over from OUT_Z_H_G to OUT_X_L_XL.
+ */
+static bool xgRead(void *ctx, uint8_t *data, size_t count)
+{
+	HostRegFile *file = (HostRegFile *)ctx;
+
+	if ((file->pointer == OUT_X_L_G) && (file == &xgFiles[0]))
+	{
+		uint64_t delay = hostNowNs() - edgeNs;
+		delaySum += delay;
+		if (delay > delayMax) delayMax = delay;
+		dataNs = hostNowNs();
+		reads++;
+	}
+	else if (file->pointer == OUT_X_L_G)
+	{
+		skewSum += hostNowNs() - dataNs;
+	}
+	for (; count; count--)
+	{
+		*data++ = file->regs[file->pointer++];
+		if (file->pointer == OUT_Z_H_G + 1)
+			file->pointer = OUT_X_L_XL;
+	}
+	return true;
+}
+
+static void drdyEdge(void *arg)
+{
+	edgeNs = hostNowNs();
+	edges++;
+	if (schedule == INTERLEAVED)
+		readGyroAccelAllAsync(Event_handle(&xgEventStruct), XG_EVENT);
+	else
+		Semaphore_post(Semaphore_handle(&edgeSemStruct));
+	hostSchedule(edgeNs + periodNs, drdyEdge, arg);
+}
+
+static void attachDevices(void)
+{
+	int i, k;
+
+	hostI2CReset();
+	for (i = 0; i < LSM9DS1_DEVICE_COUNT; i++)
+	{
+		hostRegFileInit(&xgFiles[i], LSM9DS1_AG_ADDR(i == 0));
+		hostRegFileInit(&mFiles[i], LSM9DS1_M_ADDR(i == 0));
+		xgFiles[i].dev.read = xgRead;
+		xgFiles[i].regs[WHO_AM_I_XG] = WHO_AM_I_AG_RSP;
+		mFiles[i].regs[WHO_AM_I_M] = WHO_AM_I_M_RSP;
+		/* Each device reads back its own index in every axis */
+		for (k = 0; k < 6; k += 2)
+		{
+			xgFiles[i].regs[OUT_X_L_G + k] = 0x10 * (i + 1) + k;
+			xgFiles[i].regs[OUT_X_L_XL + k] = 0x10 * (i + 1) + 6 + k;
+		}
+		for (k = 0; k < 6; k += 2)
+			mFiles[i].regs[OUT_X_L_M + k] = 0x40 * (i + 1) + k;
+	}
+}
+
+/* Bring both devices up, true if the boot figures and rings are per device */
+static bool boot(void)
+{
+	IMU_Frame frame;
+	bool ok = true;
+	int i;
+
+	hostSimReset();
+	attachDevices();
+	I2C_init();
+	initI2C();
+	Event_construct(&xgEventStruct, NULL);
+	for (i = 0; i < LSM9DS1_DEVICE_COUNT; i++)
+	{
+		LSM9DS1init(&imuDevices[i], i);
+		hostRunUntil(hostNowNs() + 1000000);	// Stagger the two boots
+		if (LSM9DS1begin() == 0)
+			ok = false;
+	}
+	readGyroAccelAllAsync(Event_handle(&xgEventStruct), XG_EVENT);
+	Event_pend(Event_handle(&xgEventStruct), 0, XG_EVENT, BIOS_WAIT_FOREVER);
+
+	printf("device  address  boot transfers  boot time us  ring ax\n");
+	for (i = 0; i < LSM9DS1_DEVICE_COUNT; i++)
+	{
+		LSM9DS1_Device *dev = &imuDevices[i];
+		int16_t expected = 0x10 * (i + 1) + 6;
+
+		imuRingLatest(dev->ring, &frame);
+		printf("%6d     0x%02X  %14lu  %12.1f  %7d\n", i, dev->xgAddress,
+				(unsigned long)dev->bootTransfers, dev->bootTime * 1e6 / HOST_TIMESTAMP_HZ,
+				frame.xg[3]);
+		if (!dev->present || (dev->bootTransfers == 0) || (dev->bootTime == 0) ||
+			(frame.xg[3] != expected))
+			ok = false;
+	}
+	/* Device 1 started later, so a shared figure would make these equal */
+	if (imuDevices[0].bootTime == imuDevices[1].bootTime)
+		ok = false;
+	return ok;
+}
+
+static void run(Schedule s, uint8_t odr, uint32_t workUs)
+{
+	uint32_t magEdges, head;
+	uint32_t dropped = 0;
+	Semaphore_Params semParams;
+	int i;
+
+	hostSimReset();
+	I2C_close(i2c);
+	initI2C();
+	Event_construct(&xgEventStruct, NULL);
+	Semaphore_Params_init(&semParams);
+	semParams.mode = Semaphore_Mode_BINARY;
+	Semaphore_construct(&edgeSemStruct, 0, &semParams);
+	for (i = 0; i < LSM9DS1_DEVICE_COUNT; i++)
+	{
+		imuDevices[i].settings.gyro.sampleRate = odr;
+		imuDevices[i].xgAsyncDropped = 0;
+	}
+	periodNs = (uint64_t)gyroODRPeriodUs[odr] * 1000;
+	magEdges = 1000000 / gyroODRPeriodUs[odr] / MAG_RATE_HZ;
+	if (magEdges == 0) magEdges = 1;
+	schedule = s;
+	edges = reads = 0;
+	delaySum = delayMax = skewSum = 0;
+	head = imuDevices[0].ring->head;
+	i2cQueueStatsReset();
+	hostSchedule(0, drdyEdge, NULL);
+
+	while (hostNowNs() < RUN_NS)
+	{
+		if (s == INTERLEAVED)
+		{
+			Event_pend(Event_handle(&xgEventStruct), 0, XG_EVENT, BIOS_WAIT_FOREVER);
+		}
+		else
+		{
+			Semaphore_pend(Semaphore_handle(&edgeSemStruct), BIOS_WAIT_FOREVER);
+			for (i = 0; i < LSM9DS1_DEVICE_COUNT; i++)
+			{
+				LSM9DS1select(&imuDevices[i]);
+				readGyroAccel();
+			}
+		}
+		hostRunUntil(hostNowNs() + workUs * 1000ull);
+
+		if (edges % magEdges == 0)
+		{
+			for (i = 0; i < LSM9DS1_DEVICE_COUNT; i++)
+			{
+				LSM9DS1select(&imuDevices[i]);
+				readMag();
+			}
+		}
+	}
+	for (i = 0; i < LSM9DS1_DEVICE_COUNT; i++)
+		dropped += imuDevices[i].xgAsyncDropped;
+
+	printf("%-11s %4.0f Hz  work %3lu us  skew %5.1f us  delay mean %6.1f max %6.1f us  "
+			"load %5.1f%%  frames %4lu/%-4lu dropped %lu\n",
+			scheduleNames[s], 1e9 / periodNs, (unsigned long)workUs,
+			skewSum / 1e3 / reads,
+			delaySum / 1e3 / reads, delayMax / 1e3, i2cQueueLoad() * 100.0 / 1024,
+			(unsigned long)(imuDevices[0].ring->head - head), (unsigned long)edges,
+			(unsigned long)dropped);
+}
+
+int main(void)
+{
+	static const uint32_t workUs[] = {300, 700};
+	uint8_t odr;
+	int failures = 0;
+	int w;
+
+	if (!boot())
+	{
+		printf("FAILED: boot figures or rings shared between devices\n");
+		failures++;
+	}
+	printf("\n");
+	for (w = 0; w < 2; w++)
+	{
+		for (odr = 3; odr <= 6; odr++)
+		{
+			run(INTERLEAVED, odr, workUs[w]);
+			run(SEQUENTIAL, odr, workUs[w]);
+		}
+	}
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,540 @@
+/*
+ * lsm9ds1_sim.c
+ *
+ *  LSM9DS1 register model, see lsm9ds1_sim.h. Register numbers and bit
+ *  positions follow the LSM9DS1 datasheet (DocID025715).
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "host_sim.h"
+#include "lsm9ds1_sim.h"
+#include "Tasks/IMU/LSM9DS1_Registers.h"
+
+/* Status bits, STATUS_REG_0/STATUS_REG_1 and STATUS_REG_M */
+#define XLDA		(1 << 0)
+#define GDA			(1 << 1)
+#define TDA			(1 << 2)
+#define ZYXDA		(1 << 3)
+#define ZYXOR		(1 << 7)
+
+/* INT1_CTRL/INT2_CTRL sources */
+#define INT_DRDY_XL_BIT		(1 << 0)
+#define INT_DRDY_G_BIT		(1 << 1)
+#define INT2_DRDY_TEMP_BIT	(1 << 2)
+#define INT_FTH_BIT			(1 << 3)
+#define INT_OVR_BIT			(1 << 4)
+#define INT_FSS5_BIT		(1 << 5)
+
+/* FIFO_CTRL FMODE */
+#define FMODE_BYPASS		0
+#define FMODE_FIFO			1
+#define FMODE_CONT_TO_FIFO	3
+#define FMODE_BYPASS_TO_CONT	4
+#define FMODE_CONT			6
+
+static const double gyroODRHz[8] = {0, 14.9, 59.5, 119, 238, 476, 952, 0};
+static const double accelODRHz[8] = {0, 10, 50, 119, 238, 476, 952, 0};
+static const double magODRHz[8] = {0.625, 1.25, 2.5, 5, 10, 20, 40, 80};
+
+/* Sensitivity per LSB by FS code, dps, g and gauss */
+static const double gyroLSB[4] = {0.00875, 0.0175, 0.00875, 0.07};
+static const double accelLSB[4] = {0.000061, 0.000732, 0.000122, 0.000244};
+static const double magLSB[4] = {0.00014, 0.00029, 0.00043, 0.00058};
+
+static void xgSample(void *arg);
+static void mSample(void *arg);
+
+/* ===============================================================
+ * =================== Helpers ===================================
+ * ===============================================================
+ */
+static double gaussian(LSM9DS1Sim *sim)
+{
+	double u1, u2;
+
+	do
+	{
+		sim->rng ^= sim->rng << 13;
+		sim->rng ^= sim->rng >> 7;
+		sim->rng ^= sim->rng << 17;
+		u1 = (sim->rng >> 11) * (1.0 / 9007199254740992.0);
+		sim->rng ^= sim->rng << 13;
+		sim->rng ^= sim->rng >> 7;
+		sim->rng ^= sim->rng << 17;
+		u2 = (sim->rng >> 11) * (1.0 / 9007199254740992.0);
+	} while (u1 <= 0);
+	return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+static int16_t saturate(double v)
+{
+	v = floor(v + 0.5);
+	if (v > 32767) return 32767;
+	if (v < -32768) return -32768;
+	return (int16_t)v;
+}
+
+static bool gyroOn(const LSM9DS1Sim *sim)
+{
+	return (sim->xgRegs[CTRL_REG1_G] >> 5) != 0;
+}
+
+static bool fifoActive(const LSM9DS1Sim *sim)
+{
+	return (sim->xgRegs[CTRL_REG9] & (1 << 1)) && ((sim->xgRegs[FIFO_CTRL] >> 5) != FMODE_BYPASS);
+}
+
+static uint8_t fifoThreshold(const LSM9DS1Sim *sim)
+{
+	return sim->xgRegs[FIFO_CTRL] & 0x1F;
+}
+
+static uint8_t fifoSource(const LSM9DS1Sim *sim)
+{
+	uint8_t src = sim->fifoCount & 0x3F;
+
+	if (sim->fifoCount >= fifoThreshold(sim)) src |= (1 << 7);
+	if (sim->fifoOverrun) src |= (1 << 6);
+	return src;
+}
+
+double lsm9ds1SimXgRate(const LSM9DS1Sim *sim)
+{
+	// With the gyro on, the accelerometer runs at the gyro ODR
+	if (gyroOn(sim))
+		return gyroODRHz[sim->xgRegs[CTRL_REG1_G] >> 5];
+	return accelODRHz[sim->xgRegs[CTRL_REG6_XL] >> 5];
+}
+
+double lsm9ds1SimMagRate(const LSM9DS1Sim *sim)
+{
+	if ((sim->mRegs[CTRL_REG3_M] & 0x03) >= 2)
+		return 0;
+	return magODRHz[(sim->mRegs[CTRL_REG1_M] >> 2) & 0x07];
+}
+
+void lsm9ds1SimExpected(const LSM9DS1Sim *sim, int16_t xg[6], int16_t mag[3])
+{
+	double gLSB = gyroLSB[(sim->xgRegs[CTRL_REG1_G] >> 3) & 0x03];
+	double aLSB = accelLSB[(sim->xgRegs[CTRL_REG6_XL] >> 3) & 0x03];
+	double mLSB = magLSB[(sim->mRegs[CTRL_REG2_M] >> 5) & 0x03];
+	int i, j;
+
+	for (i = 0; i < 3; i++)
+	{
+		double b = sim->magHardIron[i];
+		int16_t offset = (int16_t)(sim->mRegs[OFFSET_X_REG_L_M + 2 * i] |
+				(sim->mRegs[OFFSET_X_REG_H_M + 2 * i] << 8));
+
+		xg[i] = saturate(sim->rate[i] / gLSB);
+		xg[3 + i] = saturate(sim->accel[i] / aLSB);
+		for (j = 0; j < 3; j++)
+			b += sim->magSoftIron[i][j] * sim->field[j];
+		mag[i] = saturate(b / mLSB - offset);
+	}
+}
+
+/* ===============================================================
+ * =================== Interrupt lines ===========================
+ * ===============================================================
+ */
+static void pinEdge(void *arg)
+{
+	hostPinEdge((PIN_Id)(uintptr_t)arg);
+}
+
+/* Drive a line, raising the pin on a rising edge as seen by the MCU */
+static void driveLine(bool *level, bool active, bool activeLow, PIN_Id pin)
+{
+	bool rising = activeLow ? (*level && !active) : (!*level && active);
+
+	*level = active;
+	if (rising && (pin != LSM9DS1_SIM_NO_PIN))
+		hostSchedule(hostNowNs(), pinEdge, (void *)(uintptr_t)pin);
+}
+
+static bool xgLineActive(const LSM9DS1Sim *sim, uint8_t ctrl, bool int2)
+{
+	uint8_t status = sim->xgRegs[STATUS_REG_1];
+	bool active = false;
+
+	if ((ctrl & INT_DRDY_XL_BIT) && (status & XLDA)) active = true;
+	if ((ctrl & INT_DRDY_G_BIT) && (status & GDA)) active = true;
+	if (int2 && (ctrl & INT2_DRDY_TEMP_BIT) && (status & TDA)) active = true;
+	if (fifoActive(sim))
+	{
+		if ((ctrl & INT_FTH_BIT) && (sim->fifoCount >= fifoThreshold(sim))) active = true;
+		if ((ctrl & INT_OVR_BIT) && sim->fifoOverrun) active = true;
+		if ((ctrl & INT_FSS5_BIT) && (sim->fifoCount >= LSM9DS1_SIM_FIFO_DEPTH)) active = true;
+	}
+	return active;
+}
+
+static void updateLines(LSM9DS1Sim *sim)
+{
+	bool activeLow = (sim->xgRegs[CTRL_REG8] & (1 << 5)) != 0;
+
+	driveLine(&sim->int1Level, xgLineActive(sim, sim->xgRegs[INT1_CTRL], false),
+			activeLow, sim->int1Pin);
+	driveLine(&sim->int2Level, xgLineActive(sim, sim->xgRegs[INT2_CTRL], true),
+			activeLow, sim->int2Pin);
+	driveLine(&sim->drdyMLevel, (sim->mRegs[STATUS_REG_M] & ZYXDA) != 0, false,
+			sim->drdyMPin);
+}
+
+/* ===============================================================
+ * =================== Sampling ==================================
+ * ===============================================================
+ */
+/* Restart the sample clocks if the programmed rates changed */
+static void scheduleSamples(LSM9DS1Sim *sim)
+{
+	double xgRate = lsm9ds1SimXgRate(sim);
+	double mRate = lsm9ds1SimMagRate(sim);
+
+	if (xgRate != sim->xgRateHz)
+	{
+		sim->xgRateHz = xgRate;
+		sim->xgNextNs = 0;
+		if (xgRate > 0)
+		{
+			sim->xgNextNs = hostNowNs() + (uint64_t)(1e9 / xgRate);
+			hostSchedule(sim->xgNextNs, xgSample, sim);
+		}
+	}
+	if (mRate != sim->mRateHz)
+	{
+		sim->mRateHz = mRate;
+		sim->mNextNs = 0;
+		if (mRate > 0)
+		{
+			sim->mNextNs = hostNowNs() + (uint64_t)(1e9 / mRate);
+			hostSchedule(sim->mNextNs, mSample, sim);
+		}
+	}
+}
+
+static void fifoPush(LSM9DS1Sim *sim, const int16_t *frame)
+{
+	uint8_t mode = sim->xgRegs[FIFO_CTRL] >> 5;
+
+	if (sim->fifoCount == LSM9DS1_SIM_FIFO_DEPTH)
+	{
+		sim->fifoOverrun = true;
+		sim->xgOverruns++;
+		// FIFO mode stops collecting, the continuous modes drop the oldest
+		if (mode == FMODE_FIFO)
+			return;
+		sim->fifoHead = (sim->fifoHead + 1) % LSM9DS1_SIM_FIFO_DEPTH;
+		sim->fifoCount--;
+	}
+	memcpy(sim->fifo[(sim->fifoHead + sim->fifoCount) % LSM9DS1_SIM_FIFO_DEPTH], frame,
+			sizeof(sim->fifo[0]));
+	sim->fifoCount++;
+}
+
+static void xgSample(void *arg)
+{
+	LSM9DS1Sim *sim = (LSM9DS1Sim *)arg;
+	int16_t expected[6], mag[3];
+	int16_t temp;
+	uint8_t mode = sim->xgRegs[FIFO_CTRL] >> 5;
+	int i;
+
+	if ((hostNowNs() != sim->xgNextNs) || (sim->xgRateHz <= 0))
+		return;
+	sim->xgNextNs = hostNowNs() + (uint64_t)(1e9 / sim->xgRateHz);
+	hostSchedule(sim->xgNextNs, xgSample, sim);
+
+	if (sim->onSample) sim->onSample(sim, false);
+	lsm9ds1SimExpected(sim, expected, mag);
+	for (i = 0; i < 6; i++)
+	{
+		if ((i < 3) && !gyroOn(sim))
+			continue;
+		sim->out[i] = saturate(expected[i] + sim->xgNoise * gaussian(sim));
+	}
+	temp = saturate((sim->tempC - 25) * 16);
+	sim->xgRegs[OUT_TEMP_L] = temp & 0xFF;
+	sim->xgRegs[OUT_TEMP_H] = (temp >> 8) & 0xFF;
+
+	if (fifoActive(sim) && (mode != FMODE_BYPASS_TO_CONT))
+		fifoPush(sim, sim->out);
+	else if (sim->xgRegs[STATUS_REG_1] & XLDA)
+		sim->xgMissed++;
+
+	sim->xgRegs[STATUS_REG_1] |= XLDA | TDA | (gyroOn(sim) ? GDA : 0);
+	sim->xgRegs[STATUS_REG_0] = sim->xgRegs[STATUS_REG_1];
+	sim->xgSamples++;
+	updateLines(sim);
+}
+
+static void mSample(void *arg)
+{
+	LSM9DS1Sim *sim = (LSM9DS1Sim *)arg;
+	int16_t xg[6], expected[3];
+	int i;
+
+	if ((hostNowNs() != sim->mNextNs) || (sim->mRateHz <= 0))
+		return;
+	if ((sim->mRegs[CTRL_REG3_M] & 0x03) == 0)
+	{
+		sim->mNextNs = hostNowNs() + (uint64_t)(1e9 / sim->mRateHz);
+		hostSchedule(sim->mNextNs, mSample, sim);
+	}
+	else
+	{
+		// Single conversion, then power-down
+		sim->mRegs[CTRL_REG3_M] |= 0x03;
+		sim->mRateHz = 0;
+		sim->mNextNs = 0;
+	}
+
+	if (sim->onSample) sim->onSample(sim, true);
+	lsm9ds1SimExpected(sim, xg, expected);
+	for (i = 0; i < 3; i++)
+		sim->mOut[i] = saturate(expected[i] + sim->magNoise * gaussian(sim));
+
+	if (sim->mRegs[STATUS_REG_M] & ZYXDA)
+	{
+		sim->mRegs[STATUS_REG_M] |= ZYXOR | 0x70;
+		sim->mMissed++;
+	}
+	sim->mRegs[STATUS_REG_M] |= ZYXDA | 0x07;
+	sim->mSamples++;
+	updateLines(sim);
+}
+
+/* ===============================================================
+ * =================== Accel/gyro registers ======================
+ * ===============================================================
+ */
+static bool xgWritable(uint8_t reg)
+{
+	return ((reg >= ACT_THS) && (reg <= INT2_CTRL)) ||
+		((reg >= CTRL_REG1_G) && (reg <= ORIENT_CFG_G)) ||
+		((reg >= CTRL_REG4) && (reg <= CTRL_REG10)) ||
+		(reg == FIFO_CTRL) ||
+		((reg >= INT_GEN_CFG_G) && (reg <= INT_GEN_DUR_G));
+}
+
+static void xgDefaults(LSM9DS1Sim *sim)
+{
+	memset(sim->xgRegs, 0, sizeof(sim->xgRegs));
+	sim->xgRegs[WHO_AM_I_XG] = WHO_AM_I_AG_RSP;
+	sim->xgRegs[CTRL_REG4] = 0x38;
+	sim->xgRegs[CTRL_REG5_XL] = 0x38;
+	sim->xgRegs[CTRL_REG8] = 0x04;
+	memset(sim->out, 0, sizeof(sim->out));
+	sim->fifoHead = sim->fifoCount = 0;
+	sim->fifoOverrun = false;
+}
+
+static void xgWriteReg(LSM9DS1Sim *sim, uint8_t reg, uint8_t value)
+{
+	if (!xgWritable(reg))
+		return;
+	if ((reg == CTRL_REG8) && (value & (1 << 0)))
+	{
+		xgDefaults(sim);
+		return;
+	}
+	sim->xgRegs[reg] = value & ((reg == CTRL_REG8) ? 0x7E : 0xFF);
+	// Bypass (or disabling the FIFO) empties it
+	if (((reg == FIFO_CTRL) || (reg == CTRL_REG9)) && !fifoActive(sim))
+	{
+		sim->fifoHead = sim->fifoCount = 0;
+		sim->fifoOverrun = false;
+	}
+}
+
+static uint8_t xgReadReg(LSM9DS1Sim *sim, uint8_t reg)
+{
+	const int16_t *frame = sim->out;
+
+	if (fifoActive(sim) && sim->fifoCount)
+		frame = sim->fifo[sim->fifoHead];
+	if ((reg >= OUT_X_L_G) && (reg <= OUT_Z_H_G))
+	{
+		sim->xgRegs[STATUS_REG_1] &= ~GDA;
+		return (frame[(reg - OUT_X_L_G) / 2] >> (8 * (reg & 1))) & 0xFF;
+	}
+	if ((reg >= OUT_X_L_XL) && (reg <= OUT_Z_H_XL))
+	{
+		sim->xgRegs[STATUS_REG_1] &= ~XLDA;
+		return (frame[3 + (reg - OUT_X_L_XL) / 2] >> (8 * (reg & 1))) & 0xFF;
+	}
+	if (reg == OUT_TEMP_H)
+		sim->xgRegs[STATUS_REG_1] &= ~TDA;
+	if ((reg == STATUS_REG_0) || (reg == STATUS_REG_1))
+		return sim->xgRegs[STATUS_REG_1];
+	if (reg == FIFO_SRC)
+		return fifoSource(sim);
+	return sim->xgRegs[reg];
+}
+
+/* Register pointer after reg, with the output rollover of a burst */
+static uint8_t xgAdvance(LSM9DS1Sim *sim, uint8_t reg)
+{
+	if (!(sim->xgRegs[CTRL_REG8] & (1 << 2)))
+		return reg;
+	if (gyroOn(sim) && (reg == OUT_Z_H_G))
+		return OUT_X_L_XL;
+	if (reg == OUT_Z_H_XL)
+	{
+		// A whole frame was read, the next one moves into the outputs
+		if (fifoActive(sim) && sim->fifoCount)
+		{
+			sim->fifoHead = (sim->fifoHead + 1) % LSM9DS1_SIM_FIFO_DEPTH;
+			sim->fifoCount--;
+			sim->fifoOverrun = false;
+		}
+		if (gyroOn(sim))
+			return OUT_X_L_G;
+	}
+	return (reg + 1) & 0x7F;
+}
+
+static bool xgWrite(void *ctx, const uint8_t *data, size_t count)
+{
+	LSM9DS1Sim *sim = (LSM9DS1Sim *)ctx;
+	size_t i;
+
+	sim->xgPointer = data[0] & 0x7F;
+	for (i = 1; i < count; i++)
+	{
+		xgWriteReg(sim, sim->xgPointer, data[i]);
+		if (sim->xgRegs[CTRL_REG8] & (1 << 2))
+			sim->xgPointer = (sim->xgPointer + 1) & 0x7F;
+	}
+	scheduleSamples(sim);
+	updateLines(sim);
+	return true;
+}
+
+static bool xgRead(void *ctx, uint8_t *data, size_t count)
+{
+	LSM9DS1Sim *sim = (LSM9DS1Sim *)ctx;
+	size_t i;
+
+	for (i = 0; i < count; i++)
+	{
+		data[i] = xgReadReg(sim, sim->xgPointer);
+		sim->xgPointer = xgAdvance(sim, sim->xgPointer);
+	}
+	updateLines(sim);
+	return true;
+}
+
+/* ===============================================================
+ * =================== Magnetometer registers ====================
+ * ===============================================================
+ */
+static bool mWritable(uint8_t reg)
+{
+	return ((reg >= OFFSET_X_REG_L_M) && (reg <= OFFSET_Z_REG_H_M)) ||
+		((reg >= CTRL_REG1_M) && (reg <= CTRL_REG5_M)) ||
+		(reg == INT_CFG_M) || (reg == INT_THS_L_M) || (reg == INT_THS_H_M);
+}
+
+static void mDefaults(LSM9DS1Sim *sim)
+{
+	memset(sim->mRegs, 0, sizeof(sim->mRegs));
+	sim->mRegs[WHO_AM_I_M] = WHO_AM_I_M_RSP;
+	sim->mRegs[CTRL_REG1_M] = 0x10;
+	sim->mRegs[CTRL_REG3_M] = 0x03;
+	sim->mRegs[INT_CFG_M] = 0x08;
+	memset(sim->mOut, 0, sizeof(sim->mOut));
+}
+
+static void mWriteReg(LSM9DS1Sim *sim, uint8_t reg, uint8_t value)
+{
+	if (!mWritable(reg))
+		return;
+	if ((reg == CTRL_REG2_M) && (value & (1 << 2)))
+	{
+		mDefaults(sim);
+		return;
+	}
+	sim->mRegs[reg] = value & ((reg == CTRL_REG2_M) ? 0x60 : 0xFF);
+	// A new single-conversion request restarts the conversion clock
+	if ((reg == CTRL_REG3_M) && ((value & 0x03) == 1))
+		sim->mRateHz = 0;
+}
+
+static uint8_t mReadReg(LSM9DS1Sim *sim, uint8_t reg)
+{
+	if ((reg >= OUT_X_L_M) && (reg <= OUT_Z_H_M))
+	{
+		sim->mRegs[STATUS_REG_M] = 0;
+		return (sim->mOut[(reg - OUT_X_L_M) / 2] >> (8 * (reg & 1))) & 0xFF;
+	}
+	return sim->mRegs[reg];
+}
+
+static bool mWrite(void *ctx, const uint8_t *data, size_t count)
+{
+	LSM9DS1Sim *sim = (LSM9DS1Sim *)ctx;
+	size_t i;
+
+	sim->mPointer = data[0] & 0x7F;
+	sim->mIncrement = (data[0] & 0x80) != 0;
+	for (i = 1; i < count; i++)
+	{
+		mWriteReg(sim, sim->mPointer, data[i]);
+		if (sim->mIncrement)
+			sim->mPointer = (sim->mPointer + 1) & 0x7F;
+	}
+	scheduleSamples(sim);
+	updateLines(sim);
+	return true;
+}
+
+static bool mRead(void *ctx, uint8_t *data, size_t count)
+{
+	LSM9DS1Sim *sim = (LSM9DS1Sim *)ctx;
+	size_t i;
+
+	for (i = 0; i < count; i++)
+	{
+		data[i] = mReadReg(sim, sim->mPointer);
+		if (sim->mIncrement)
+			sim->mPointer = (sim->mPointer + 1) & 0x7F;
+	}
+	updateLines(sim);
+	return true;
+}
+
+/* ===============================================================
+ * =================== Set-up ====================================
+ * ===============================================================
+ */
+void lsm9ds1SimInit(LSM9DS1Sim *sim, bool saHigh)
+{
+	int i;
+
+	memset(sim, 0, sizeof(*sim));
+	xgDefaults(sim);
+	mDefaults(sim);
+	sim->accel[2] = 1.0;
+	sim->field[0] = 0.5;
+	sim->tempC = 25;
+	for (i = 0; i < 3; i++)
+		sim->magSoftIron[i][i] = 1.0;
+	sim->rng = 0x9E3779B97F4A7C15ull;
+	sim->int1Pin = sim->int2Pin = sim->drdyMPin = LSM9DS1_SIM_NO_PIN;
+
+	sim->xg.address = saHigh ? 0x6B : 0x6A;
+	sim->xg.write = xgWrite;
+	sim->xg.read = xgRead;
+	sim->xg.ctx = sim;
+	hostI2CAttach(&sim->xg);
+	sim->m.address = saHigh ? 0x1E : 0x1C;
+	sim->m.write = mWrite;
+	sim->m.read = mRead;
+	sim->m.ctx = sim;
+	hostI2CAttach(&sim->m);
+}
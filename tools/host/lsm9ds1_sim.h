@@ -0,0 +1,99 @@
+/*
+ * lsm9ds1_sim.h
+ *
+ *  LSM9DS1 model on the host I2C bus: the accel/gyro and the magnetometer
+ *  as two devices, sampling at the ODR programmed into their control
+ *  registers on simulated time.
+ *
+ *    - WHO_AM_I, power-on defaults, SW_RESET/SOFT_RST, writes to read-only
+ *      registers ignored
+ *    - auto-increment per CTRL_REG8 IF_ADD_INC on the accel/gyro and per
+ *      sub-address bit 7 on the magnetometer; with the gyro on, a burst
+ *      from OUT_X_L_G rolls over from OUT_Z_H_G to OUT_X_L_XL and from
+ *      OUT_Z_H_XL back to OUT_X_L_G
+ *    - STATUS_REG GDA/XLDA and STATUS_REG_M ZYXDA/ZYXOR, cleared by
+ *      reading the output registers
+ *    - 32-frame FIFO in bypass, FIFO, continuous-to-FIFO and continuous
+ *      modes (the trigger of the two trigger modes never fires), FIFO_SRC
+ *      with FTH, OVRN and FSS; reading the outputs pops a frame
+ *    - INT1_A/G and INT2_A/G as level lines carrying DRDY, FTH, OVR and
+ *      FSS5, DRDY_M; each rising edge is raised on the pin given here
+ *    - OUT_TEMP at 16 LSB/C, 25 C reading zero
+ *    - magnetometer OFFSET_*_REG_M subtracted from the output, continuous
+ *      and single conversion modes
+ *
+ *  The harness sets the physical inputs (rate, acceleration, field,
+ *  temperature), the magnetometer's hard and soft iron and Gaussian noise
+ *  on every channel. onSample, if set, runs before each conversion so the
+ *  inputs can follow a trajectory. Not modelled: the interrupt generators,
+ *  activity/inactivity and gyro sleep, BDU, the FIFO triggers and filter
+ *  settling.
+ */
+
+#ifndef TOOLS_HOST_LSM9DS1_SIM_H_
+#define TOOLS_HOST_LSM9DS1_SIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <ti/drivers/PIN.h>
+
+#include "i2c_bus.h"
+
+/* Interrupt line not wired to a pin */
+#define LSM9DS1_SIM_NO_PIN		0xFF
+#define LSM9DS1_SIM_FIFO_DEPTH	32
+
+typedef struct LSM9DS1Sim
+{
+	HostI2CDevice xg, m;
+	uint8_t xgRegs[128], mRegs[128];
+	uint8_t xgPointer, mPointer;
+	bool mIncrement;
+
+	/* Physical inputs */
+	double rate[3];					// Angular rate, dps
+	double accel[3];				// Specific force, g
+	double field[3];				// Magnetic field, gauss
+	double tempC;
+	double magHardIron[3];			// Added to the field reading, gauss
+	double magSoftIron[3][3];		// Applied to the field before the hard iron
+	double xgNoise, magNoise;		// Output noise, LSB rms
+	void (*onSample)(struct LSM9DS1Sim *sim, bool mag);
+	void *user;
+
+	/* Interrupt wiring, LSM9DS1_SIM_NO_PIN if not connected */
+	PIN_Id int1Pin, int2Pin, drdyMPin;
+
+	/* Conversion state */
+	int16_t out[6];					// Latest gx..az
+	int16_t fifo[LSM9DS1_SIM_FIFO_DEPTH][6];
+	uint8_t fifoHead, fifoCount;
+	bool fifoOverrun;
+	int16_t mOut[3];
+	bool int1Level, int2Level, drdyMLevel;
+	uint64_t xgNextNs, mNextNs;		// Sample events at other times are stale
+	double xgRateHz, mRateHz;		// Rates the events were scheduled at
+	uint64_t rng;
+
+	/* Statistics */
+	uint32_t xgSamples, mSamples;
+	uint32_t xgOverruns;			// Frames lost or overwritten in the FIFO
+	uint32_t xgMissed;				// Samples replaced before the outputs were read
+	uint32_t mMissed;
+} LSM9DS1Sim;
+
+/*
+ * Power-on state, attached to the bus at the SA0/SA1-high addresses or
+ * the low ones. Inputs: level and still, 25 C, 0.5 gauss along x, no
+ * noise, identity soft iron, no pins wired.
+ */
+void lsm9ds1SimInit(LSM9DS1Sim *sim, bool saHigh);
+
+/* Raw output the current inputs convert to, before noise */
+void lsm9ds1SimExpected(const LSM9DS1Sim *sim, int16_t xg[6], int16_t mag[3]);
+
+/* Output data rates the control registers select, 0 if powered down */
+double lsm9ds1SimXgRate(const LSM9DS1Sim *sim);
+double lsm9ds1SimMagRate(const LSM9DS1Sim *sim);
+
+#endif /* TOOLS_HOST_LSM9DS1_SIM_H_ */
@@ -0,0 +1,388 @@
+/*
+ * lsm9ds1_test.c
+ *
+ *  Runs the LSM9DS1 driver against the register model in lsm9ds1_sim.c,
+ *  wired like the board: XG INT1 on IOID_1, XG INT2 on DIO12, DRDY_M on
+ *  IOID_14. The pin callback does what pinCallback() does.
+ *
+ *    boot      LSM9DS1begin() finds the device, the register shadows
+ *              match the chip and the chip runs at the configured rates
+ *    drdy      INT2 data-ready queues the gyro/accel burst, DRDY_M wakes
+ *              the task for the mag. Every sample the chip produced must
+ *              land in the ring with the right values and stamps, and
+ *              none may be overwritten unread.
+ *    fifo      INT2 FIFO threshold, the task drains with readFIFOFrames()
+ *    overrun   FIFO and continuous modes left unserviced: FIFO_SRC must
+ *              report the overrun and a full FIFO, and one drain must
+ *              clear it
+ *    magcal    hard iron larger than the field (origin outside the
+ *              ellipsoid), soft iron and noise, the board turning. The
+ *              solve must find the centre, and after calibrateMag(true)
+ *              loads the sensor offsets the field magnitude must be flat.
+ *
+ *  Each run reports bus utilisation: transfers and payload bytes per
+ *  second and the busy fraction from the queue's own accounting.
+ *
+ *    make -C tools/host run
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "host_sim.h"
+#include "i2c_bus.h"
+#include "lsm9ds1_sim.h"
+#include "Tasks/IMU/LSM9DS1.h"
+
+#define XG_EVENT		Event_Id_00
+#define MAG_EVENT		Event_Id_01
+#define RUN_NS			2000000000ull
+#define FIFO_LEVEL		16
+
+/* Magnetometer calibration case, gauss */
+#define FIELD_GAUSS		0.5
+#define CENTER_TOL_LSB	25
+#define RADIUS_TOL		0.03
+
+static LSM9DS1Sim sim;
+static PIN_State pinState;
+static Event_Struct eventStruct;
+static bool fifoMode;
+static volatile uint32_t xgIntTick;
+static int failures;
+
+static PIN_Config pinTable[] = {
+	IOID_14 | PIN_INPUT_EN | PIN_PULLDOWN | PIN_IRQ_POSEDGE,
+	CC1310_LAUNCHXL_DIO12 | PIN_INPUT_EN | PIN_PULLDOWN | PIN_IRQ_POSEDGE,
+	IOID_1 | PIN_INPUT_EN | PIN_PULLDOWN | PIN_IRQ_POSEDGE,
+	PIN_TERMINATE
+};
+
+static void pinCallback(PIN_Handle handle, PIN_Id pinId)
+{
+	(void)handle;
+	switch (pinId)
+	{
+	case CC1310_LAUNCHXL_DIO12:
+		xgIntTick = Clock_getTicks();
+		if (fifoMode)
+			Event_post(Event_handle(&eventStruct), XG_EVENT);
+		else
+			readGyroAccelAllAsync(Event_handle(&eventStruct), XG_EVENT);
+		break;
+	case IOID_14:
+		Event_post(Event_handle(&eventStruct), MAG_EVENT);
+		break;
+	default:
+		break;
+	}
+}
+
+static void check(bool ok, const char *what)
+{
+	if (!ok)
+	{
+		printf("  FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+/* Fresh bus, chip and driver; returns LSM9DS1begin()'s WHO_AM_I pair */
+static uint16_t setup(void)
+{
+	hostSimReset();
+	hostI2CReset();
+	lsm9ds1SimInit(&sim, true);
+	sim.int1Pin = IOID_1;
+	sim.int2Pin = CC1310_LAUNCHXL_DIO12;
+	sim.drdyMPin = IOID_14;
+	PIN_registerIntCb(PIN_open(&pinState, pinTable), pinCallback);
+	Event_construct(&eventStruct, NULL);
+	fifoMode = false;
+
+	I2C_init();
+	if (i2c) I2C_close(i2c);
+	LSM9DS1init(&imuDevices[0], 0);
+	initI2C();
+	return LSM9DS1begin();
+}
+
+typedef struct BusWindow
+{
+	uint64_t startNs;
+	uint32_t transfers;
+	uint64_t bytes;
+} BusWindow;
+
+static void busStart(BusWindow *w)
+{
+	w->startNs = hostNowNs();
+	w->transfers = hostI2CStats.transfers;
+	w->bytes = hostI2CStats.bytes;
+	i2cQueueStatsReset();
+}
+
+static void busReport(const BusWindow *w)
+{
+	double seconds = (hostNowNs() - w->startNs) * 1e-9;
+
+	printf("  bus %6.0f xfer/s %7.0f B/s  load %5.1f%%\n",
+			(hostI2CStats.transfers - w->transfers) / seconds,
+			(hostI2CStats.bytes - w->bytes) / seconds, i2cQueueLoad() * 100.0 / 1024);
+}
+
+/* Frames checked against the chip as the task consumes them */
+static IMU_RingReader reader;
+static uint32_t frames, badValues, badStamps;
+static IMU_Frame lastFrame;
+
+static void framesStart(void)
+{
+	imuRingReaderInit(imu->ring, &reader);
+	frames = badValues = badStamps = 0;
+}
+
+/* Every new frame matches the chip's output, at gyro ODR spacing */
+static void framesDrain(void)
+{
+	int16_t expected[6], mag[3];
+	IMU_Frame frame;
+	uint32_t period = gyroPeriodTicks();
+	int i;
+
+	lsm9ds1SimExpected(&sim, expected, mag);
+	while (imuRingRead(imu->ring, &reader, &frame))
+	{
+		for (i = 0; i < 6; i++)
+		{
+			if (frame.xg[i] != expected[i]) badValues++;
+		}
+		if (frames && ((uint32_t)(frame.stamp - lastFrame.stamp) + 1 > period + 2))
+			badStamps++;
+		lastFrame = frame;
+		frames++;
+	}
+}
+
+static void framesReport(uint32_t pending)
+{
+	printf("  gyro/accel: %lu frames, %lu chip samples, %lu wrong values, %lu bad stamps, "
+			"%lu missed, %lu fifo overruns\n", (unsigned long)frames,
+			(unsigned long)sim.xgSamples, (unsigned long)badValues, (unsigned long)badStamps,
+			(unsigned long)sim.xgMissed, (unsigned long)sim.xgOverruns);
+	check(badValues == 0, "frame values differ from the chip");
+	check(badStamps == 0, "frame stamps off the ODR grid");
+	check(reader.dropped == 0, "ring reader dropped frames");
+	// One sample may still be on the bus or below the FIFO threshold
+	check(frames + pending + 1 >= sim.xgSamples, "frames missing from the ring");
+}
+
+/* Task loop until untilNs: mag on MAG_EVENT, FIFO drain on XG_EVENT */
+static uint32_t runTask(uint64_t untilNs)
+{
+	uint32_t wakes = 0;
+
+	while (hostNowNs() < untilNs)
+	{
+		UInt32 ticks = (UInt32)((untilNs - hostNowNs()) / (Clock_tickPeriod * 1000)) + 1;
+		UInt events = Event_pend(Event_handle(&eventStruct), 0, XG_EVENT | MAG_EVENT, ticks);
+
+		if (events & MAG_EVENT)
+			readMag();
+		if ((events & XG_EVENT) && fifoMode)
+		{
+			readFIFOFrames(FIFO_LEVEL, xgIntTick);
+			// Frames that landed during the burst may hold FTH high
+			if (getFIFOSamples() >= FIFO_LEVEL)
+				Event_post(Event_handle(&eventStruct), XG_EVENT);
+		}
+		if (events) wakes++;
+		framesDrain();
+	}
+	return wakes;
+}
+
+static void testBoot(void)
+{
+	uint16_t who;
+	uint8_t b, r;
+	bool shadowOk = true;
+
+	printf("boot\n");
+	who = setup();
+	printf("  WHO_AM_I 0x%04X, %lu transfers, %lu bytes, %.2f ms\n", who,
+			(unsigned long)imu->bootTransfers, (unsigned long)hostI2CStats.bytes,
+			hostNowNs() * 1e-6);
+	check(who == ((WHO_AM_I_AG_RSP << 8) | WHO_AM_I_M_RSP), "WHO_AM_I");
+	check(imu->present, "device not present");
+
+	for (b = 0; b < sizeof(xgShadowBlocks) / sizeof(xgShadowBlocks[0]); b++)
+		for (r = xgShadowBlocks[b].first; r < xgShadowBlocks[b].first + xgShadowBlocks[b].count; r++)
+			if (imu->xgShadow[r] != sim.xgRegs[r]) shadowOk = false;
+	for (b = 0; b < sizeof(mShadowBlocks) / sizeof(mShadowBlocks[0]); b++)
+		for (r = mShadowBlocks[b].first; r < mShadowBlocks[b].first + mShadowBlocks[b].count; r++)
+			if (imu->mShadow[r] != sim.mRegs[r]) shadowOk = false;
+	check(shadowOk, "register shadows differ from the chip");
+	check(imu->xgShadowValid && imu->mShadowValid, "shadows invalid");
+
+	printf("  chip runs gyro/accel at %.1f Hz, mag at %.3g Hz\n",
+			lsm9ds1SimXgRate(&sim), lsm9ds1SimMagRate(&sim));
+	check(lsm9ds1SimXgRate(&sim) > 0, "gyro/accel not running");
+	check(gyroODRPeriodUs[imu->settings.gyro.sampleRate] ==
+			(uint32_t)(1e6 / lsm9ds1SimXgRate(&sim)), "gyro ODR differs from settings");
+	check(lsm9ds1SimMagRate(&sim) > 0, "mag not running");
+}
+
+static void testDrdy(uint8_t odr)
+{
+	BusWindow bus;
+	int16_t expected[6], mag[3];
+
+	printf("drdy, gyro ODR %u\n", odr);
+	setup();
+	sim.rate[0] = 10; sim.rate[1] = -20; sim.rate[2] = 30;
+	sim.accel[0] = 0.1; sim.accel[1] = -0.2; sim.accel[2] = 0.97;
+	setGyroODR(odr);
+	framesStart();
+	busStart(&bus);
+	// As imuTaskFunc: route data-ready last, the first edge reads the first frame
+	configInt(XG_INT2, INT_DRDY_XL, INT_ACTIVE_HIGH, INT_PUSH_PULL);
+	runTask(hostNowNs() + RUN_NS);
+	framesReport(0);
+	check(sim.xgMissed == 0, "samples overwritten before they were read");
+
+	lsm9ds1SimExpected(&sim, expected, mag);
+	printf("  mag: %lu samples, %lu missed, last (%d %d %d) chip (%d %d %d)\n",
+			(unsigned long)sim.mSamples, (unsigned long)sim.mMissed,
+			imu->mx, imu->my, imu->mz, mag[0], mag[1], mag[2]);
+	check((imu->mx == mag[0]) && (imu->my == mag[1]) && (imu->mz == mag[2]),
+			"mag reading differs from the chip");
+	check(sim.mMissed == 0, "mag samples overwritten before they were read");
+	busReport(&bus);
+}
+
+static void testFifo(void)
+{
+	BusWindow bus;
+
+	printf("fifo, gyro ODR 6, threshold %u\n", FIFO_LEVEL);
+	setup();
+	setGyroODR(6);
+	framesStart();
+	fifoMode = true;
+	busStart(&bus);
+	configFIFOMode(FIFO_LEVEL);
+	runTask(hostNowNs() + RUN_NS);
+	framesReport(sim.fifoCount);
+	check(sim.xgOverruns == 0, "FIFO overran");
+	busReport(&bus);
+}
+
+static void testOverrun(void)
+{
+	uint8_t src;
+	uint8_t drained;
+
+	printf("overrun\n");
+	setup();
+	setGyroODR(6);
+	enableFIFO(true);
+	setFIFO(FIFO_CONT, FIFO_LEVEL);
+	hostRunUntil(hostNowNs() + 100000000);
+	src = xgReadByte(FIFO_SRC);
+	printf("  continuous: FIFO_SRC 0x%02X, %lu overwritten\n", src,
+			(unsigned long)sim.xgOverruns);
+	check(src == 0xE0, "continuous FIFO not full with FTH and OVRN");
+	drained = readFIFOFrames(FIFO_LEVEL, Clock_getTicks());
+	src = xgReadByte(FIFO_SRC);
+	printf("  after one drain: %u frames, FIFO_SRC 0x%02X\n", drained, src);
+	check(drained == LSM9DS1_SIM_FIFO_DEPTH, "drain did not read a full FIFO");
+	check(!(src & (1 << 6)), "OVRN still set after the drain");
+
+	setFIFO(FIFO_OFF, 0);
+	setFIFO(FIFO_THS, 0x1F);
+	hostRunUntil(hostNowNs() + 100000000);
+	src = xgReadByte(FIFO_SRC);
+	printf("  FIFO mode: FIFO_SRC 0x%02X\n", src);
+	check((src & 0x3F) == LSM9DS1_SIM_FIFO_DEPTH, "FIFO mode not stopped when full");
+}
+
+/* Board turning about two axes at incommensurate rates */
+static void turnBoard(LSM9DS1Sim *s, bool mag)
+{
+	double t = hostNowNs() * 1e-9;
+	double theta = 0.37 * t, phi = 0.23 * t + 0.5;
+
+	s->field[0] = FIELD_GAUSS * cos(theta) * cos(phi);
+	s->field[1] = FIELD_GAUSS * sin(theta) * cos(phi);
+	s->field[2] = FIELD_GAUSS * sin(phi);
+	(void)mag;
+}
+
+static void testMagCal(void)
+{
+	static const double hardIron[3] = {1.3, -1.0, 0.7};
+	double center[3], radius, maxErr = 0;
+	BusWindow bus;
+	bool solved;
+	int i;
+
+	printf("magcal, hard iron (%.1f %.1f %.1f) G on a %.1f G field\n",
+			hardIron[0], hardIron[1], hardIron[2], FIELD_GAUSS);
+	setup();
+	for (i = 0; i < 3; i++)
+	{
+		sim.magHardIron[i] = hardIron[i];
+		center[i] = hardIron[i] / (imu->mRes);
+	}
+	sim.magSoftIron[0][0] = 1.08; sim.magSoftIron[1][1] = 0.95; sim.magSoftIron[2][2] = 0.97;
+	sim.magSoftIron[0][1] = sim.magSoftIron[1][0] = 0.03;
+	sim.magNoise = 15;
+	sim.onSample = turnBoard;
+	setMagODR(7);
+	busStart(&bus);
+	runTask(hostNowNs() + 25000000000ull);
+	solved = calibrateMag(true);
+	printf("  %lu samples, solve %s, centre (%d %d %d) true (%.0f %.0f %.0f), radius %.0f\n",
+			(unsigned long)imu->magCal.samples, solved ? "ok" : "rejected",
+			imu->magCal.center[0], imu->magCal.center[1], imu->magCal.center[2],
+			center[0], center[1], center[2], imu->magCal.radius);
+	check(solved, "ellipsoid fit rejected");
+	for (i = 0; i < 3; i++)
+		check(fabs(imu->magCal.center[i] - center[i]) < CENTER_TOL_LSB, "centre off");
+
+	// The sensor now subtracts the offset; the corrected field must be a sphere
+	radius = imu->magCal.radius;
+	for (i = 0; i < 400; i++)
+	{
+		double m;
+		Event_pend(Event_handle(&eventStruct), 0, MAG_EVENT, BIOS_WAIT_FOREVER);
+		readMag();
+		m = sqrt((double)imu->mx * imu->mx + (double)imu->my * imu->my +
+				(double)imu->mz * imu->mz);
+		if (fabs(m - radius) / radius > maxErr) maxErr = fabs(m - radius) / radius;
+	}
+	printf("  offsets loaded (%d %d %d), worst |m| error %.2f%%\n",
+			(int16_t)(sim.mRegs[OFFSET_X_REG_L_M] | (sim.mRegs[OFFSET_X_REG_H_M] << 8)),
+			(int16_t)(sim.mRegs[OFFSET_Y_REG_L_M] | (sim.mRegs[OFFSET_Y_REG_H_M] << 8)),
+			(int16_t)(sim.mRegs[OFFSET_Z_REG_L_M] | (sim.mRegs[OFFSET_Z_REG_H_M] << 8)),
+			maxErr * 100);
+	check(maxErr < RADIUS_TOL, "corrected field magnitude not flat");
+	busReport(&bus);
+}
+
+int main(void)
+{
+	testBoot();
+	testDrdy(LSM9DS1_GYRO_ODR);
+	if (LSM9DS1_GYRO_ODR != 6)
+		testDrdy(6);
+	testFifo();
+	testOverrun();
+	testMagCal();
+
+	if (failures)
+		printf("FAILED: %d\n", failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
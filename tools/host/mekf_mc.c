@@ -0,0 +1,394 @@
+/*
+ * mekf_mc.c
+ *
+ *  Monte Carlo runs of the MEKF (MEKF.h) on simulated IMU frames, with the
+ *  complementary filter (Attitude_Filter.h) fed the same frames for
+ *  comparison.
+ *
+ *  Each run draws a true attitude, a slow tumble (up to 3 dps about a
+ *  random axis) and a gyro bias (up to 0.5 dps per axis). Frames go into
+ *  imuRing at the configured gyro ODR with white rate noise at the
+ *  LSM9DS1's 0.008 dps/sqrt(Hz), and the mag updates at 20 Hz (or every
+ *  frame if that is slower) with 5 mgauss noise on a 0.5 gauss field. Both filters run after every four frames,
+ *  as the IMU task does after a FIFO batch.
+ *
+ *    ground      accel reads gravity (2 mg noise) and passes
+ *                imuAccelIsGravity(); both filters start cold
+ *    orbit       imuBiasGravity is 0 so the accel is never used, and the
+ *                field model follows a 500 km, 51.6 degree orbit. Both
+ *                filters start 10 degrees off with the bias unknown, as
+ *                after a hand-over from an alignment with a second vector.
+ *    orbit cold  the same from a cold start, i.e. the mag alone. The angle
+ *                about the field is a guess after alignment and neither
+ *                filter recovers it within the run, so neither may mark
+ *                its output valid. No rms bound.
+ *
+ *  In orbit the gyro rate is taken to be relative to local NED, i.e. the
+ *  slow rotation of the reference frame, which the filters do not model,
+ *  is left out.
+ *
+ *  Reported per scenario: attitude error (rms over runs and worst) at the
+ *  end and over the last quarter, over the outputs marked valid, and how
+ *  many runs end valid (the complementary filter never does in orbit, it
+ *  has no gravity pair). Then the MEKF's own 1-sigma at the end, its
+ *  final bias error, and host cycles per frame (both filters, all work)
+ *  and per MEKF update. Every scenario fails if a run ends with the MEKF
+ *  marked valid and its error more than three times its reported sigma. A
+ *  scenario with a bound also fails if the final rms error exceeds it or
+ *  fewer than minValid runs end valid.
+ *  The host has an FPU, so the cycle counts are far below the Cortex-M3's
+ *  soft-float figures; the ratio between the two filters and between
+ *  frame and update steps is what carries over.
+ *
+ *    make -C tools/host run
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "host_sim.h"
+#include "Tasks/IMU/MEKF.h"
+#include "Tasks/IMU/Attitude_Filter.h"
+
+#define RUNS				20
+#define BATCH_FRAMES		4
+#define MAG_RATE_HZ			20
+#define FIELD_GAUSS			0.5
+#define MAG_NOISE_GAUSS		0.005
+#define ACCEL_NOISE_G		0.002
+#define GYRO_ARW_DPS		0.008			// dps/sqrt(Hz)
+#define MAX_RATE_DPS		3.0
+#define MAX_BIAS_DPS		0.5
+#define ORBIT_PERIOD_S		5677.0			// 500 km
+#define ORBIT_INCLINATION	51.6
+#define DEG					(M_PI / 180.0)
+#define COLD				(-1.0)
+
+typedef struct Scenario
+{
+	const char *name;
+	bool gravity;
+	double seconds;
+	double startDeg;		// Initial error, COLD to let the filters align
+	double boundDeg;		// MEKF final rms error, 0 if not checked
+	int minValid;			// Runs that must end valid, with a bound
+} Scenario;
+
+static const Scenario scenarios[] = {
+	{"ground", true, 120.0, COLD, 1.0, RUNS},
+	{"orbit", false, 6000.0, 10.0, 3.0, RUNS * 3 / 4},
+	{"orbit cold", false, 6000.0, COLD, 0.0, 0},
+};
+
+/* Errors of outputs marked valid only */
+typedef struct Stats
+{
+	double finalSq, finalMax;
+	uint32_t finalCount;
+	double tailSq;
+	uint32_t tailCount;
+} Stats;
+
+static uint64_t rng;
+
+static double uniform(void)
+{
+	rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+	return ((rng >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double gauss(void)
+{
+	return sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+}
+
+/* v' = A(q) v, reference to body as in Quaternion.h */
+static void rotate(const double q[4], const double v[3], double out[3])
+{
+	double t[3];
+
+	t[0] = 2.0 * (q[2] * v[2] - q[3] * v[1]);
+	t[1] = 2.0 * (q[3] * v[0] - q[1] * v[2]);
+	t[2] = 2.0 * (q[1] * v[1] - q[2] * v[0]);
+	out[0] = v[0] + q[0] * t[0] + q[2] * t[2] - q[3] * t[1];
+	out[1] = v[1] + q[0] * t[1] + q[3] * t[0] - q[1] * t[2];
+	out[2] = v[2] + q[0] * t[2] + q[1] * t[1] - q[2] * t[0];
+}
+
+/* Body rate w for dt: q = exp(-1/2 (0, w) dt) q, as MEKF.h moves it */
+static void propagate(double q[4], const double w[3], double dt)
+{
+	double n = sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+	double h = 0.5 * n * dt, c = cos(h), s = (n > 0) ? sin(h) / n : 0;
+	double u[3], r[4];
+	int i;
+
+	for (i = 0; i < 3; i++) u[i] = -s * w[i];
+	r[0] = c * q[0] - u[0] * q[1] - u[1] * q[2] - u[2] * q[3];
+	r[1] = c * q[1] + q[0] * u[0] + u[1] * q[3] - u[2] * q[2];
+	r[2] = c * q[2] + q[0] * u[1] + u[2] * q[1] - u[0] * q[3];
+	r[3] = c * q[3] + q[0] * u[2] + u[0] * q[2] - u[1] * q[1];
+	n = sqrt(r[0] * r[0] + r[1] * r[1] + r[2] * r[2] + r[3] * r[3]);
+	for (i = 0; i < 4; i++) q[i] = r[i] / n;
+}
+
+/* Rotation between the truth and a Q14 estimate, degrees */
+static double errorDeg(const double q[4], const int16_t est[4])
+{
+	double dot = fabs(q[0] * est[0] + q[1] * est[1] + q[2] * est[2] + q[3] * est[3]) / Q14_ONE;
+
+	return 2.0 * acos(fmin(1.0, dot)) / DEG;
+}
+
+static void unitRandom(double v[3])
+{
+	double n = 0;
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		v[i] = gauss();
+		n += v[i] * v[i];
+	}
+	n = sqrt(n);
+	for (i = 0; i < 3; i++) v[i] /= n;
+}
+
+/* Sub-satellite point after t seconds */
+static void orbitPosition(double t, double phase, float *lat, float *lon)
+{
+	double u = phase + 2.0 * M_PI * t / ORBIT_PERIOD_S;
+	double i = ORBIT_INCLINATION * DEG;
+
+	*lat = (float)(asin(sin(i) * sin(u)) / DEG);
+	*lon = (float)(atan2(cos(i) * sin(u), cos(u)) / DEG);
+}
+
+/* Start both filters at q turned by angle about a random axis */
+static void startAt(const double q[4], double angle)
+{
+	double axis[3], d[4], e[4];
+	int i, j;
+
+	unitRandom(axis);
+	d[0] = cos(angle / 2);
+	for (i = 0; i < 3; i++) d[1 + i] = sin(angle / 2) * axis[i];
+	/* e = d q */
+	e[0] = d[0] * q[0] - d[1] * q[1] - d[2] * q[2] - d[3] * q[3];
+	e[1] = d[0] * q[1] + d[1] * q[0] + d[2] * q[3] - d[3] * q[2];
+	e[2] = d[0] * q[2] + d[2] * q[0] + d[3] * q[1] - d[1] * q[3];
+	e[3] = d[0] * q[3] + d[3] * q[0] + d[1] * q[2] - d[2] * q[1];
+
+	mekfInit();
+	attFilterInit();
+	for (i = 0; i < 4; i++)
+	{
+		mekf.q[i] = (float)e[i];
+		attFilter.q[i] = (int32_t)lrint(e[i] * Q30_ONE);
+	}
+	for (i = 0; i < 6; i++)
+	{
+		for (j = 0; j < 6; j++) mekf.P[i][j] = 0.0f;
+	}
+	for (i = 0; i < 3; i++)
+	{
+		mekf.P[i][i] = (float)(angle * angle);
+		mekf.P[3 + i][3 + i] = IMU_MEKF_INIT_BIAS_SIGMA * IMU_MEKF_INIT_BIAS_SIGMA;
+	}
+	mekf.aligned = true;
+	mekf.magOnly = false;
+	mekfSetSigma();
+	mekf.lastUpdate = 0;
+	attFilter.started = true;
+	attFilter.lastCorrection = 0;
+}
+
+static void accumulate(Stats *s, bool valid, double err, bool last)
+{
+	if (!valid)
+		return;
+	if (last)
+	{
+		s->finalSq += err * err;
+		if (err > s->finalMax) s->finalMax = err;
+		s->finalCount++;
+	}
+	s->tailSq += err * err;
+	s->tailCount++;
+}
+
+static double rms(double sq, uint32_t count)
+{
+	return count ? sqrt(sq / count) : 0.0;
+}
+
+static bool runScenario(const Scenario *sc)
+{
+	const double radPerLsb = imu->gRes * DEG;
+	const double dt = gyroPeriodTicks() * Clock_tickPeriod * 1e-6;
+	const uint32_t period = gyroPeriodTicks();
+	const uint32_t frames = (uint32_t)(sc->seconds / dt);
+	const uint32_t magRound = (uint32_t)(1.0 / (MAG_RATE_HZ * dt) + 0.5);
+	const uint32_t magEvery = magRound ? magRound : 1;
+	Stats mekfStats = {0}, attStats = {0};
+	double sigmaSq = 0, biasSq = 0;
+	uint64_t mekfCycles = 0, attCycles = 0, updateCycles = 0;
+	uint32_t updates = 0, batches = 0, overconfident = 0;
+	int run;
+
+	for (run = 0; run < RUNS; run++)
+	{
+		double q[4], w[3], bias[3], axis[3], phase = 2.0 * M_PI * uniform();
+		double rate = MAX_RATE_DPS * DEG * uniform();
+		double gyroSigma = GYRO_ARW_DPS * DEG / sqrt(dt);
+		int16_t mag[3] = {0, 0, 0};
+		float lat, lon;
+		uint32_t n;
+		int i;
+
+		q[0] = gauss(); q[1] = gauss(); q[2] = gauss(); q[3] = gauss();
+		{
+			double norm = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+			for (i = 0; i < 4; i++) q[i] /= norm;
+		}
+		unitRandom(axis);
+		for (i = 0; i < 3; i++)
+		{
+			w[i] = rate * axis[i];
+			bias[i] = MAX_BIAS_DPS * DEG * (2.0 * uniform() - 1.0);
+		}
+
+		orbitPosition(0.0, phase, &lat, &lon);
+		magModelSetPosition(lat, lon, 500.0f);
+		imuRingInit(&imuRing);
+		imuBiasGravity = sc->gravity ? (int32_t)lrint(1.0 / imu->aRes) : 0;
+		mekf.ready = false;
+		attFilter.ready = false;
+		if (sc->startDeg != COLD)
+			startAt(q, sc->startDeg * DEG);
+
+		for (n = 1; n <= frames; n++)
+		{
+			int16_t (*slot)[6];
+			uint8_t count = 1;
+			double body[3], down[3] = {0.0, 0.0, 1.0};
+
+			propagate(q, w, dt);
+			if (!sc->gravity && (n % (uint32_t)(1.0 / dt) == 0))
+			{
+				orbitPosition(n * dt, phase, &lat, &lon);
+				magModelSetPosition(lat, lon, 500.0f);
+			}
+
+			slot = imuRingReserve(&imuRing, &count);
+			for (i = 0; i < 3; i++)
+				slot[0][i] = (int16_t)lrint((w[i] + bias[i] + gyroSigma * gauss()) / radPerLsb);
+			rotate(q, down, body);
+			for (i = 0; i < 3; i++)
+			{
+				/* calcAccel() gives minus the reading */
+				double a = sc->gravity ? -body[i] + ACCEL_NOISE_G * gauss() : ACCEL_NOISE_G * gauss();
+				slot[0][3 + i] = (int16_t)lrint(a / imu->aRes);
+			}
+			if (n % magEvery == 0)
+			{
+				const double field[3] = {magModel.unit[0], magModel.unit[1], magModel.unit[2]};
+				const int signs[3] = {IMU_ATT_MAG_SIGN_X, IMU_ATT_MAG_SIGN_Y, IMU_ATT_MAG_SIGN_Z};
+
+				rotate(q, field, body);
+				for (i = 0; i < 3; i++)
+					mag[i] = (int16_t)lrint(signs[i] * (body[i] * FIELD_GAUSS +
+							MAG_NOISE_GAUSS * gauss()) / imu->mRes);
+			}
+			imuRingCommit(&imuRing, 1, n * period, period, mag);
+
+			if (n % BATCH_FRAMES == 0)
+			{
+				uint32_t before = mekf.updates;
+				uint64_t t = hostCycles();
+
+				mekfRun();
+				mekfCycles += hostCycles() - t;
+				if (mekf.updates != before)
+				{
+					updateCycles += mekf.cycles;
+					updates++;
+				}
+				t = hostCycles();
+				attFilterRun();
+				attCycles += hostCycles() - t;
+				batches++;
+
+				if (n > frames * 3 / 4)
+				{
+					bool last = (n + BATCH_FRAMES > frames);
+					accumulate(&mekfStats, mekfValid, errorDeg(q, mekfQuat), last);
+					accumulate(&attStats, attitudeValid, errorDeg(q, attitudeQuat), last);
+				}
+			}
+		}
+		if (mekfValid && (errorDeg(q, mekfQuat) > 3.0 * mekf.sigma * 1e-6 / DEG))
+		{
+			overconfident++;
+			printf("  run %d: %.3f deg off, sigma %.3f deg\n", run, errorDeg(q, mekfQuat),
+					mekf.sigma * 1e-6 / DEG);
+		}
+		sigmaSq += (mekf.sigma * 1e-6 / DEG) * (mekf.sigma * 1e-6 / DEG);
+		for (i = 0; i < 3; i++)
+			biasSq += (mekf.bias[i] - bias[i]) * (mekf.bias[i] - bias[i]) / (DEG * DEG);
+	}
+
+	{
+		double mekfRms = rms(mekfStats.finalSq, mekfStats.finalCount);
+		double sigma = sqrt(sigmaSq / RUNS);
+		double perFrame = 1.0 / ((double)batches * BATCH_FRAMES);
+		bool ok = (overconfident == 0) && ((sc->boundDeg == 0) ||
+				((mekfRms <= sc->boundDeg) && (mekfStats.finalCount >= sc->minValid)));
+
+		printf("%-10s %5.0f s  MEKF   final rms %7.3f max %7.3f  last quarter rms %7.3f deg  "
+				"sigma %7.3f deg  bias rms %6.4f dps\n",
+				sc->name, sc->seconds, mekfRms, mekfStats.finalMax,
+				rms(mekfStats.tailSq, mekfStats.tailCount), sigma, sqrt(biasSq / (3.0 * RUNS)));
+		printf("                    compl. final rms %7.3f max %7.3f  last quarter rms %7.3f deg\n",
+				rms(attStats.finalSq, attStats.finalCount), attStats.finalMax,
+				rms(attStats.tailSq, attStats.tailCount));
+		printf("                    valid at the end MEKF %u/%d compl. %u/%d, "
+				"MEKF beyond 3 sigma %u\n", mekfStats.finalCount, RUNS, attStats.finalCount, RUNS,
+				overconfident);
+		printf("                    cycles/frame MEKF %5.0f compl. %5.0f  cycles/update MEKF %6.0f\n",
+				mekfCycles * perFrame, attCycles * perFrame,
+				updates ? (double)updateCycles / updates : 0.0);
+		if (!ok)
+			printf("FAILED: %s MEKF rms %.3f deg, bound %.1f deg, %u/%d valid, "
+					"%u beyond 3 sigma\n", sc->name, mekfRms, sc->boundDeg,
+					mekfStats.finalCount, sc->minValid, overconfident);
+		return ok;
+	}
+}
+
+int main(void)
+{
+	int failures = 0;
+	size_t s;
+
+	LSM9DS1init(&imuDevices[0], 0);
+	calcgRes();
+	calcaRes();
+	calcmRes();
+	rng = 1;
+
+	{
+		const double dt = gyroPeriodTicks() * Clock_tickPeriod * 1e-6;
+		const uint32_t magEvery = (uint32_t)(1.0 / (MAG_RATE_HZ * dt) + 0.5);
+
+		printf("%d runs per scenario, gyro %.1f Hz, mag %.1f Hz\n", RUNS, 1.0 / dt,
+				1.0 / ((magEvery ? magEvery : 1) * dt));
+	}
+	for (s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++)
+	{
+		if (!runScenario(&scenarios[s]))
+			failures++;
+	}
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,165 @@
+/*
+ * quat_test.c
+ *
+ *  Round trips through the attitude telemetry path of Quaternion.h, the
+ *  firmware code itself rather than the Python copy in tools/quat_codec.py:
+ *
+ *    dcm       random attitudes (and the ties between the largest
+ *              components) as Q14 matrices into dcmToQuatQ14(). It must
+ *              succeed, return w >= 0, and stay within DCM_MAX_RAD of the
+ *              true attitude. quatToDcmQ14() of the result is compared
+ *              with the input matrix for scale.
+ *    pack      quatPack() then quatUnpack() of every quaternion from the
+ *              dcm step, once valid and once not. Each component must come
+ *              back within PACK_MAX_LSB (Q14) of the input, up to the sign
+ *              of the whole quaternion, with the valid bit intact.
+ *
+ *  The run fails on any breach.
+ *
+ *    make -C tools/host run
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "host_sim.h"
+#include "Tasks/IMU/Quaternion.h"
+
+#define ATTITUDES		200000
+/* Q14 rounding of the matrix alone is ~1e-4 rad */
+#define DCM_MAX_RAD		1e-3
+#define PACK_MAX_LSB	2
+
+static uint64_t rng;
+
+static double uniform(void)
+{
+	rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+	return ((rng >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double gauss(void)
+{
+	return sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+}
+
+/* Same matrix as quatToDcmQ14(), in double, rounded to Q14 */
+static void dcmFromQuat(const double q[4], int16_t dcm[9])
+{
+	const double w = q[0], x = q[1], y = q[2], z = q[3];
+	const double e[9] = {
+		w*w + x*x - y*y - z*z, 2*(x*y - w*z), 2*(x*z + w*y),
+		2*(x*y + w*z), w*w - x*x + y*y - z*z, 2*(y*z - w*x),
+		2*(x*z - w*y), 2*(y*z + w*x), w*w - x*x - y*y + z*z,
+	};
+	int i;
+
+	for (i = 0; i < 9; i++)
+		dcm[i] = (int16_t)lrint(e[i] * Q14_ONE);
+}
+
+/* Rotation between the truth and a Q14 quaternion, radians */
+static double errorRad(const double q[4], const int16_t est[4])
+{
+	double dot = 0, n = 0;
+	int i;
+
+	for (i = 0; i < 4; i++)
+	{
+		dot += q[i] * est[i];
+		n += (double)est[i] * est[i];
+	}
+	return 2.0 * acos(fmin(1.0, fabs(dot) / sqrt(n)));
+}
+
+/* Largest component difference, LSB, between q and the nearer of +-back */
+static int packError(const int16_t q[4], const int16_t back[4])
+{
+	int plus = 0, minus = 0, i;
+
+	for (i = 0; i < 4; i++)
+	{
+		int d = abs(q[i] - back[i]), s = abs(q[i] + back[i]);
+		if (d > plus) plus = d;
+		if (s > minus) minus = s;
+	}
+	return (plus < minus) ? plus : minus;
+}
+
+int main(void)
+{
+	const double h = sqrt(0.5);
+	const double edges[][4] = {
+		{1, 0, 0, 0}, {0, 0, 0, -1}, {h, h, 0, 0}, {0, h, -h, 0},
+		{0.5, -0.5, 0.5, -0.5}, {0.5, 0.5, 0.5, 0.5},
+	};
+	const int nEdges = sizeof(edges) / sizeof(edges[0]);
+	double worstDcm = 0;
+	int worstBack = 0, worstPack = 0, failures = 0, n, i;
+
+	rng = 1;
+	for (n = 0; n < ATTITUDES + nEdges; n++)
+	{
+		double q[4], norm = 0;
+		int16_t dcm[9], back[9], q14[4], unpacked[4];
+		uint16_t words[3];
+		bool valid;
+		double err;
+		int e;
+
+		for (i = 0; i < 4; i++)
+		{
+			q[i] = (n < nEdges) ? edges[n][i] : gauss();
+			norm += q[i] * q[i];
+		}
+		norm = sqrt(norm);
+		for (i = 0; i < 4; i++) q[i] /= norm;
+		dcmFromQuat(q, dcm);
+
+		if (!dcmToQuatQ14(dcm, q14) || (q14[0] < 0))
+		{
+			if (failures++ < 10)
+				printf("  FAILED: dcmToQuatQ14 of (%.4f %.4f %.4f %.4f)\n", q[0], q[1], q[2], q[3]);
+			continue;
+		}
+		err = errorRad(q, q14);
+		if (err > worstDcm) worstDcm = err;
+		if (err > DCM_MAX_RAD)
+		{
+			if (failures++ < 10)
+				printf("  FAILED: dcmToQuatQ14 %.2e rad off\n", err);
+		}
+		quatToDcmQ14(q14, back);
+		for (i = 0; i < 9; i++)
+		{
+			e = abs(back[i] - dcm[i]);
+			if (e > worstBack) worstBack = e;
+		}
+
+		for (i = 0; i < 2; i++)
+		{
+			quatPack(q14, i == 0, words);
+			valid = quatUnpack(words, unpacked);
+			e = packError(q14, unpacked);
+			if (e > worstPack) worstPack = e;
+			if ((e > PACK_MAX_LSB) || (valid != (i == 0)))
+			{
+				if (failures++ < 10)
+					printf("  FAILED: pack (%d %d %d %d) -> %04x %04x %04x, %d LSB, valid %d\n",
+							q14[0], q14[1], q14[2], q14[3], words[0], words[1], words[2], e, valid);
+			}
+		}
+	}
+
+	printf("%d attitudes\n", ATTITUDES + nEdges);
+	printf("dcmToQuatQ14  worst %.2e rad (%.4f deg), quatToDcmQ14 back %d LSB\n",
+			worstDcm, worstDcm * 180.0 / M_PI, worstBack);
+	printf("pack/unpack   worst %d LSB (limit %d)\n", worstPack, PACK_MAX_LSB);
+	if (failures)
+	{
+		printf("FAILED: %d\n", failures);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
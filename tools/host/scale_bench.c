@@ -0,0 +1,149 @@
+/*
+ * scale_bench.c
+ *
+ *  Checks the Q16 conversions in LSM9DS1.h against the exact product
+ *  raw * sensitivity for every int16 input at every full scale, and times
+ *  them against the float calc*() functions.
+ *
+ *  The error bound documented with calcGyroQ16() is 0.75 Q16 LSB; the run
+ *  fails if any input exceeds it. Times are host cycles per conversion
+ *  (TSC on x86). The host has an FPU, so the float column is far cheaper
+ *  here than the soft-float calls it compiles to on the Cortex-M3; the
+ *  Q16 column is the same integer multiply and shift on both.
+ *
+ *    make -C tools/host run
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "host_sim.h"
+#include "Tasks/IMU/LSM9DS1.h"
+
+#define BENCH_SAMPLES	4096
+#define BENCH_ROUNDS	64
+#define Q16_BOUND		0.75
+
+typedef enum { GYRO, ACCEL, MAG } Sensor;
+
+static const char *sensorNames[] = {"gyro", "accel", "mag"};
+
+static int16_t samples[BENCH_SAMPLES];
+static volatile float floatSink;
+static volatile int32_t q16Sink;
+
+static void setScale(Sensor sensor, uint16_t scale)
+{
+	switch (sensor)
+	{
+	case GYRO: imu->settings.gyro.scale = scale; calcgRes(); break;
+	case ACCEL: imu->settings.accel.scale = scale; calcaRes(); break;
+	case MAG: imu->settings.mag.scale = scale; calcmRes(); break;
+	}
+}
+
+static double sensitivity(Sensor sensor, uint16_t scale)
+{
+	switch (sensor)
+	{
+	case GYRO:
+		return (scale == 245) ? SENSITIVITY_GYROSCOPE_245 :
+			(scale == 500) ? SENSITIVITY_GYROSCOPE_500 : SENSITIVITY_GYROSCOPE_2000;
+	case ACCEL:
+		return (scale == 2) ? SENSITIVITY_ACCELEROMETER_2 :
+			(scale == 4) ? SENSITIVITY_ACCELEROMETER_4 :
+			(scale == 8) ? SENSITIVITY_ACCELEROMETER_8 : SENSITIVITY_ACCELEROMETER_16;
+	default:
+		return (scale == 4) ? SENSITIVITY_MAGNETOMETER_4 :
+			(scale == 8) ? SENSITIVITY_MAGNETOMETER_8 :
+			(scale == 12) ? SENSITIVITY_MAGNETOMETER_12 : SENSITIVITY_MAGNETOMETER_16;
+	}
+}
+
+static float convertFloat(Sensor sensor, int16_t raw)
+{
+	return (sensor == GYRO) ? calcGyro(raw) : (sensor == ACCEL) ? calcAccel(raw) : calcMag(raw);
+}
+
+static int32_t convertQ16(Sensor sensor, int16_t raw)
+{
+	return (sensor == GYRO) ? calcGyroQ16(raw) :
+		(sensor == ACCEL) ? calcAccelQ16(raw) : calcMagQ16(raw);
+}
+
+/* Fewest cycles per conversion over BENCH_ROUNDS passes */
+static double timeFloat(Sensor sensor)
+{
+	uint64_t best = ~0ull;
+	int r, i;
+
+	for (r = 0; r < BENCH_ROUNDS; r++)
+	{
+		uint64_t t = hostCycles();
+		for (i = 0; i < BENCH_SAMPLES; i++)
+			floatSink = convertFloat(sensor, samples[i]);
+		t = hostCycles() - t;
+		if (t < best) best = t;
+	}
+	return (double)best / BENCH_SAMPLES;
+}
+
+static double timeQ16(Sensor sensor)
+{
+	uint64_t best = ~0ull;
+	int r, i;
+
+	for (r = 0; r < BENCH_ROUNDS; r++)
+	{
+		uint64_t t = hostCycles();
+		for (i = 0; i < BENCH_SAMPLES; i++)
+			q16Sink = convertQ16(sensor, samples[i]);
+		t = hostCycles() - t;
+		if (t < best) best = t;
+	}
+	return (double)best / BENCH_SAMPLES;
+}
+
+int main(void)
+{
+	static const uint16_t scales[3][4] = {{245, 500, 2000, 0}, {2, 4, 8, 16}, {4, 8, 12, 16}};
+	int failures = 0;
+	int s, k, i;
+
+	LSM9DS1init(&imuDevices[0], 0);
+	srand(1);
+	for (i = 0; i < BENCH_SAMPLES; i++)
+		samples[i] = (int16_t)(rand() - RAND_MAX / 2);
+
+	printf("sensor  scale  max err Q16 LSB    cycles/conversion\n");
+	printf("                 Q16     float      Q16     float\n");
+	for (s = GYRO; s <= MAG; s++)
+	{
+		for (k = 0; (k < 4) && scales[s][k]; k++)
+		{
+			double sens = sensitivity((Sensor)s, scales[s][k]);
+			double sign = (s == ACCEL) ? -1.0 : 1.0;
+			double errQ16 = 0, errFloat = 0;
+			int32_t raw;
+
+			setScale((Sensor)s, scales[s][k]);
+			for (raw = -32768; raw <= 32767; raw++)
+			{
+				long double exact = sign * (long double)raw * sens * 65536.0L;
+				double e = fabs((double)(convertQ16((Sensor)s, (int16_t)raw) - exact));
+				double f = fabs((double)(convertFloat((Sensor)s, (int16_t)raw) * 65536.0L - exact));
+				if (e > errQ16) errQ16 = e;
+				if (f > errFloat) errFloat = f;
+			}
+			printf("%-6s %6u   %6.3f  %8.3f  %7.1f  %8.1f\n", sensorNames[s], scales[s][k],
+					errQ16, errFloat, timeQ16((Sensor)s), timeFloat((Sensor)s));
+			if (errQ16 > Q16_BOUND)
+				failures++;
+		}
+	}
+
+	if (failures)
+		printf("FAILED: %d scales over the %.2f LSB bound\n", failures, Q16_BOUND);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,16 @@
+/* Board names used by the IMU code, CC1310 LaunchPad numbering */
+#ifndef HOST_BOARD_H
+#define HOST_BOARD_H
+
+#include <xdc/std.h>
+
+#define Board_I2C0					0
+#define Board_PIN_LED0				6
+#define Board_PIN_LED1				7
+#define CC1310_LAUNCHXL_DIO12		12
+#define CC1310_LAUNCHXL_PIN_RLED	6
+#define CC1310_LAUNCHXL_PIN_GLED	7
+
+#define Board_initGeneral()
+
+#endif
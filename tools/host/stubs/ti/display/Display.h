@@ -0,0 +1,21 @@
+/* Display output goes to stdout */
+#ifndef HOST_TI_DISPLAY_DISPLAY_H
+#define HOST_TI_DISPLAY_DISPLAY_H
+
+#include <stdio.h>
+#include <xdc/std.h>
+
+typedef void *Display_Handle;
+
+#define Display_Type_UART	1
+
+static inline void Display_init(void) {}
+static inline Display_Handle Display_open(int type, void *params)
+{
+	(void)type;
+	(void)params;
+	return (Display_Handle)stdout;
+}
+#define Display_printf(handle, line, column, ...)	printf(__VA_ARGS__)
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * I2C driver API, served by the bus model in i2c_bus.c. Transfers take
+ * simulated time from the byte count and bit rate; callback mode completes
+ * from the event loop like the driver's Swi.
+ */
+#ifndef HOST_TI_DRIVERS_I2C_H
+#define HOST_TI_DRIVERS_I2C_H
+
+#include <xdc/std.h>
+
+typedef struct I2C_Config *I2C_Handle;
+
+typedef struct I2C_Transaction
+{
+	void *writeBuf;
+	size_t writeCount;
+	void *readBuf;
+	size_t readCount;
+	uint_least8_t slaveAddress;
+	void *arg;
+	void *nextPtr;
+} I2C_Transaction;
+
+typedef void (*I2C_CallbackFxn)(I2C_Handle handle, I2C_Transaction *transaction,
+		bool transferStatus);
+
+typedef enum
+{
+	I2C_MODE_BLOCKING,
+	I2C_MODE_CALLBACK
+} I2C_TransferMode;
+
+typedef enum
+{
+	I2C_100kHz = 0,
+	I2C_400kHz = 1
+} I2C_BitRate;
+
+typedef struct I2C_Params
+{
+	I2C_TransferMode transferMode;
+	I2C_CallbackFxn transferCallbackFxn;
+	I2C_BitRate bitRate;
+	void *custom;
+} I2C_Params;
+
+void I2C_init(void);
+void I2C_Params_init(I2C_Params *params);
+I2C_Handle I2C_open(uint_least8_t index, I2C_Params *params);
+void I2C_close(I2C_Handle handle);
+bool I2C_transfer(I2C_Handle handle, I2C_Transaction *transaction);
+
+#endif
@@ -0,0 +1,45 @@
+/* Pin interrupts are raised by the device models through hostPinEdge() */
+#ifndef HOST_TI_DRIVERS_PIN_H
+#define HOST_TI_DRIVERS_PIN_H
+
+#include <xdc/std.h>
+
+typedef uint32_t PIN_Config;
+typedef uint32_t PIN_Id;
+typedef struct PIN_State
+{
+	int unused;
+} PIN_State;
+typedef PIN_State *PIN_Handle;
+typedef void (*PIN_IntCb)(PIN_Handle handle, PIN_Id pinId);
+
+#define PIN_ID(x)				((x) & 0xFF)
+#define PIN_TERMINATE			0xFE
+#define PIN_INPUT_EN			(1u << 29)
+#define PIN_GPIO_OUTPUT_EN		(1u << 23)
+#define PIN_GPIO_LOW			0
+#define PIN_GPIO_HIGH			(1u << 22)
+#define PIN_PUSHPULL			0
+#define PIN_DRVSTR_MAX			0
+#define PIN_PULLDOWN			0
+#define PIN_PULLUP				0
+#define PIN_NOPULL				0
+#define PIN_IRQ_DIS				(0u << 16)
+#define PIN_IRQ_POSEDGE			(1u << 16)
+#define PIN_IRQ_NEGEDGE			(2u << 16)
+
+#define IOID_0		0
+#define IOID_1		1
+#define IOID_12		12
+#define IOID_13		13
+#define IOID_14		14
+#define IOID_15		15
+
+PIN_Handle PIN_open(PIN_State *state, const PIN_Config pinList[]);
+int PIN_registerIntCb(PIN_Handle handle, PIN_IntCb callbackFxn);
+int PIN_setInterrupt(PIN_Handle handle, PIN_Config pinCfg);
+int PIN_setOutputValue(PIN_Handle handle, PIN_Id pinId, uint32_t val);
+uint32_t PIN_getOutputValue(PIN_Id pinId);
+uint32_t PIN_getInputValue(PIN_Id pinId);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef HOST_TI_DRIVERS_PIN_PINCC26XX_H
+#define HOST_TI_DRIVERS_PIN_PINCC26XX_H
+
+#include <ti/drivers/PIN.h>
+
+#endif
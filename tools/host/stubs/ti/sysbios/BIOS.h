@@ -0,0 +1,11 @@
+#ifndef HOST_TI_SYSBIOS_BIOS_H
+#define HOST_TI_SYSBIOS_BIOS_H
+
+#include <xdc/std.h>
+
+#define BIOS_WAIT_FOREVER	(~(UInt32)0)
+#define BIOS_NO_WAIT		0
+
+void BIOS_start(void);
+
+#endif
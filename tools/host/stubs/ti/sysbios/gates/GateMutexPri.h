@@ -0,0 +1,28 @@
+#ifndef HOST_TI_SYSBIOS_GATES_GATEMUTEXPRI_H
+#define HOST_TI_SYSBIOS_GATES_GATEMUTEXPRI_H
+
+#include <xdc/std.h>
+
+typedef struct GateMutexPri_Params
+{
+	int unused;
+} GateMutexPri_Params;
+
+typedef struct GateMutexPri_Struct
+{
+	Int depth;
+} GateMutexPri_Struct;
+typedef GateMutexPri_Struct *GateMutexPri_Handle;
+
+static inline void GateMutexPri_Params_init(GateMutexPri_Params *params) { params->unused = 0; }
+static inline void GateMutexPri_construct(GateMutexPri_Struct *gate,
+		const GateMutexPri_Params *params)
+{
+	(void)params;
+	gate->depth = 0;
+}
+static inline GateMutexPri_Handle GateMutexPri_handle(GateMutexPri_Struct *gate) { return gate; }
+static inline IArg GateMutexPri_enter(GateMutexPri_Handle gate) { return gate->depth++; }
+static inline void GateMutexPri_leave(GateMutexPri_Handle gate, IArg key) { gate->depth = (Int)key; }
+
+#endif
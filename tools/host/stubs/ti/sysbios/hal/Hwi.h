@@ -0,0 +1,18 @@
+/* There is one thread of control on the host, so Hwi masking is a no-op */
+#ifndef HOST_TI_SYSBIOS_HAL_HWI_H
+#define HOST_TI_SYSBIOS_HAL_HWI_H
+
+#include <xdc/std.h>
+
+typedef struct Hwi_StackInfo
+{
+	size_t hwiStackPeak;
+	size_t hwiStackSize;
+	void *hwiStackBase;
+} Hwi_StackInfo;
+
+static inline UInt Hwi_disable(void) { return 0; }
+static inline void Hwi_restore(UInt key) { (void)key; }
+Bool Hwi_getStackInfo(Hwi_StackInfo *info, Bool computeStackDepth);
+
+#endif
@@ -0,0 +1,38 @@
+/* Clock ticks are simulated time / Clock_tickPeriod (10 us, as hello.cfg) */
+#ifndef HOST_TI_SYSBIOS_KNL_CLOCK_H
+#define HOST_TI_SYSBIOS_KNL_CLOCK_H
+
+#include <xdc/std.h>
+
+extern UInt32 Clock_tickPeriod;
+
+typedef void (*Clock_FuncPtr)(UArg arg);
+
+typedef struct Clock_Params
+{
+	UInt32 period;
+	Bool startFlag;
+	UArg arg;
+} Clock_Params;
+
+typedef struct Clock_Struct
+{
+	Clock_FuncPtr fxn;
+	UInt32 timeout;
+	UInt32 period;
+	UArg arg;
+	Bool active;
+} Clock_Struct;
+typedef Clock_Struct *Clock_Handle;
+
+UInt32 Clock_getTicks(void);
+void Clock_Params_init(Clock_Params *params);
+void Clock_construct(Clock_Struct *clock, Clock_FuncPtr fxn, UInt32 timeout,
+		const Clock_Params *params);
+static inline Clock_Handle Clock_handle(Clock_Struct *clock) { return clock; }
+void Clock_start(Clock_Handle clock);
+void Clock_stop(Clock_Handle clock);
+void Clock_setPeriod(Clock_Handle clock, UInt32 period);
+void Clock_setTimeout(Clock_Handle clock, UInt32 timeout);
+
+#endif
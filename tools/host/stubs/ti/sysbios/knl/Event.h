@@ -0,0 +1,37 @@
+#ifndef HOST_TI_SYSBIOS_KNL_EVENT_H
+#define HOST_TI_SYSBIOS_KNL_EVENT_H
+
+#include <xdc/std.h>
+
+#define Event_Id_NONE	0
+#define Event_Id_00		(1u << 0)
+#define Event_Id_01		(1u << 1)
+#define Event_Id_02		(1u << 2)
+#define Event_Id_03		(1u << 3)
+#define Event_Id_04		(1u << 4)
+#define Event_Id_05		(1u << 5)
+#define Event_Id_06		(1u << 6)
+#define Event_Id_07		(1u << 7)
+
+typedef struct Event_Params
+{
+	int unused;
+} Event_Params;
+
+typedef struct Event_Struct
+{
+	UInt posted;
+} Event_Struct;
+typedef Event_Struct *Event_Handle;
+
+static inline void Event_Params_init(Event_Params *params) { params->unused = 0; }
+static inline void Event_construct(Event_Struct *event, const Event_Params *params)
+{
+	(void)params;
+	event->posted = 0;
+}
+static inline Event_Handle Event_handle(Event_Struct *event) { return event; }
+UInt Event_pend(Event_Handle event, UInt andMask, UInt orMask, UInt32 timeout);
+void Event_post(Event_Handle event, UInt eventMask);
+
+#endif
@@ -0,0 +1,35 @@
+/* A pend runs simulated time forward until the semaphore is posted */
+#ifndef HOST_TI_SYSBIOS_KNL_SEMAPHORE_H
+#define HOST_TI_SYSBIOS_KNL_SEMAPHORE_H
+
+#include <xdc/std.h>
+
+typedef enum
+{
+	Semaphore_Mode_COUNTING,
+	Semaphore_Mode_BINARY,
+	Semaphore_Mode_COUNTING_PRIORITY,
+	Semaphore_Mode_BINARY_PRIORITY
+} Semaphore_Mode;
+
+typedef struct Semaphore_Params
+{
+	Semaphore_Mode mode;
+} Semaphore_Params;
+
+typedef struct Semaphore_Struct
+{
+	Int count;
+	Semaphore_Mode mode;
+} Semaphore_Struct;
+typedef Semaphore_Struct *Semaphore_Handle;
+
+void Semaphore_Params_init(Semaphore_Params *params);
+void Semaphore_construct(Semaphore_Struct *sem, Int count, const Semaphore_Params *params);
+static inline void Semaphore_destruct(Semaphore_Struct *sem) { (void)sem; }
+static inline Semaphore_Handle Semaphore_handle(Semaphore_Struct *sem) { return sem; }
+Bool Semaphore_pend(Semaphore_Handle sem, UInt32 timeout);
+void Semaphore_post(Semaphore_Handle sem);
+static inline Int Semaphore_getCount(Semaphore_Handle sem) { return sem->count; }
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef HOST_TI_SYSBIOS_KNL_SWI_H
+#define HOST_TI_SYSBIOS_KNL_SWI_H
+
+#include <xdc/std.h>
+
+static inline UInt Swi_disable(void) { return 0; }
+static inline void Swi_restore(UInt key) { (void)key; }
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * Tasks are not scheduled on the host. The harness runs one task body
+ * directly; Task_sleep() and blocking pends advance simulated time.
+ */
+#ifndef HOST_TI_SYSBIOS_KNL_TASK_H
+#define HOST_TI_SYSBIOS_KNL_TASK_H
+
+#include <xdc/std.h>
+
+typedef void (*Task_FuncPtr)(UArg arg0, UArg arg1);
+
+typedef enum
+{
+	Task_Mode_RUNNING,
+	Task_Mode_READY,
+	Task_Mode_BLOCKED,
+	Task_Mode_TERMINATED,
+	Task_Mode_INACTIVE
+} Task_Mode;
+
+typedef struct Task_Params
+{
+	size_t stackSize;
+	Int priority;
+	void *stack;
+	UArg arg0;
+	UArg arg1;
+	void *env;
+} Task_Params;
+
+typedef struct Task_Struct
+{
+	Task_FuncPtr fxn;
+	Task_Params params;
+	void *hookContext;
+} Task_Struct;
+typedef Task_Struct *Task_Handle;
+
+typedef struct Task_Stat
+{
+	Int priority;
+	void *stack;
+	size_t stackSize;
+	void *stackHeap;
+	void *env;
+	Task_Mode mode;
+	void *sp;
+	size_t used;
+} Task_Stat;
+
+void Task_Params_init(Task_Params *params);
+void Task_construct(Task_Struct *task, Task_FuncPtr fxn, const Task_Params *params,
+		void *eb);
+static inline Task_Handle Task_handle(Task_Struct *task) { return task; }
+void Task_sleep(UInt32 ticks);
+Task_Handle Task_self(void);
+void Task_stat(Task_Handle task, Task_Stat *stat);
+void *Task_getHookContext(Task_Handle task, Int id);
+void Task_setHookContext(Task_Handle task, Int id, void *context);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef HOST_XDC_RUNTIME_ERROR_H
+#define HOST_XDC_RUNTIME_ERROR_H
+
+#include <xdc/std.h>
+
+typedef struct Error_Block
+{
+	int code;
+} Error_Block;
+
+static inline void Error_init(Error_Block *eb) { eb->code = 0; }
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef HOST_XDC_RUNTIME_SYSTEM_H
+#define HOST_XDC_RUNTIME_SYSTEM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <xdc/std.h>
+
+#define System_printf	printf
+static inline void System_abort(const char *msg) { fputs(msg, stderr); abort(); }
+
+#endif
@@ -0,0 +1,12 @@
+/* Timestamp counts simulated time at HOST_TIMESTAMP_HZ */
+#ifndef HOST_XDC_RUNTIME_TIMESTAMP_H
+#define HOST_XDC_RUNTIME_TIMESTAMP_H
+
+#include <xdc/runtime/Types.h>
+
+#define HOST_TIMESTAMP_HZ	48000000
+
+UInt32 Timestamp_get32(void);
+void Timestamp_getFreq(Types_FreqHz *freq);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef HOST_XDC_RUNTIME_TYPES_H
+#define HOST_XDC_RUNTIME_TYPES_H
+
+#include <xdc/std.h>
+
+typedef struct Types_FreqHz
+{
+	UInt32 hi;
+	UInt32 lo;
+} Types_FreqHz;
+
+#endif
@@ -0,0 +1,25 @@
+/* Host stand-in for the XDC base types */
+#ifndef HOST_XDC_STD_H
+#define HOST_XDC_STD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef uintptr_t UArg;
+typedef intptr_t IArg;
+typedef int Int;
+typedef unsigned int UInt;
+typedef uint8_t UInt8;
+typedef uint16_t UInt16;
+typedef uint32_t UInt32;
+typedef int32_t Int32;
+typedef bool Bool;
+typedef char Char;
+typedef const char *String;
+#define Void void
+
+#define TRUE	1
+#define FALSE	0
+
+#endif
@@ -0,0 +1,265 @@
+/*
+ * triad_bench.c
+ *
+ *  Checks computeAttitudeQ14() against computeAttitude() over random
+ *  attitudes and positions, and times both.
+ *
+ *  Each solve takes a random position for the field model (so the angle
+ *  between the down and field lines runs from 0 to 90 degrees and the cached
+ *  reference triad is rebuilt) and a random attitude. The raw readings are
+ *  the reference vectors turned into the body and rounded to LSB, with
+ *  1 g and 0.5 gauss. Errors are the largest |fixed - float| element in
+ *  Q14 LSB, binned by that angle; the run fails if any solve beyond
+ *  10 degrees exceeds TRIAD_Q14_TOLERANCE. The attitude error of each path
+ *  against the true attitude is given too, and the run fails if an
+ *  accepted solve is more than MAX_ATTITUDE_DEG off: pairs closer than
+ *  TRIAD_MIN_SINE must come back degenerate instead.
+ *
+ *  Times are host cycles per solve (TSC on x86) with the reference triad
+ *  already cached. The host has an FPU, so the float column is far cheaper
+ *  here than the soft-float calls it compiles to on the Cortex-M3, and the
+ *  two columns cannot be compared. The target figures come from building
+ *  the firmware with TRIAD_BENCHMARK set (LOG_TRIAD_CYCLES, DWT counter).
+ *
+ *    make -C tools/host run
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "host_sim.h"
+#include "Tasks/IMU/TRIAD.h"
+
+#define SOLVES			200000
+#define BENCH_SOLVES	1024
+#define BENCH_ROUNDS	64
+#define FIELD_GAUSS		0.5
+#define BINS			4
+#define MAX_ATTITUDE_DEG	0.5
+
+static const double binEdges[BINS] = {0.0, 5.0, 10.0, 30.0};
+
+typedef struct Solve
+{
+	int16_t mag[3], accel[3];
+} Solve;
+
+static Solve bench[BENCH_SOLVES];
+static volatile float floatSink;
+static volatile int16_t q14Sink;
+
+static double uniform(void)
+{
+	return (rand() + 0.5) / ((double)RAND_MAX + 1.0);
+}
+
+/* Random rotation, reference to body */
+static void randomDcm(double R[9])
+{
+	double q[4], n = 0;
+	int i;
+
+	for (i = 0; i < 4; i++)
+	{
+		/* Box-Muller, so the quaternion is uniform on the sphere */
+		q[i] = sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+		n += q[i] * q[i];
+	}
+	n = 1.0 / sqrt(n);
+	for (i = 0; i < 4; i++) q[i] *= n;
+
+	R[0] = 1 - 2*(q[2]*q[2] + q[3]*q[3]);
+	R[1] = 2*(q[1]*q[2] + q[0]*q[3]);
+	R[2] = 2*(q[1]*q[3] - q[0]*q[2]);
+	R[3] = 2*(q[1]*q[2] - q[0]*q[3]);
+	R[4] = 1 - 2*(q[1]*q[1] + q[3]*q[3]);
+	R[5] = 2*(q[2]*q[3] + q[0]*q[1]);
+	R[6] = 2*(q[1]*q[3] + q[0]*q[2]);
+	R[7] = 2*(q[2]*q[3] - q[0]*q[1]);
+	R[8] = 1 - 2*(q[1]*q[1] + q[2]*q[2]);
+}
+
+/* Raw readings of the reference vectors seen through R */
+static void readings(const double R[9], Solve *s)
+{
+	static const int signs[3] = {IMU_ATT_MAG_SIGN_X, IMU_ATT_MAG_SIGN_Y, IMU_ATT_MAG_SIGN_Z};
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		double down = R[3*i + 2];
+		double field = R[3*i] * magModel.unit[0] + R[3*i + 1] * magModel.unit[1] +
+				R[3*i + 2] * magModel.unit[2];
+		/* calcAccel() gives minus the reading */
+		s->accel[i] = (int16_t)lrint(-down / imu->aRes);
+		s->mag[i] = (int16_t)lrint(signs[i] * field * FIELD_GAUSS / imu->mRes);
+	}
+}
+
+/*
+ * Rotation angle between an estimate and the truth, degrees. From both
+ * the skew part and the trace of est R', so an estimate that is not quite
+ * orthonormal is not charged for its scale error.
+ */
+static double attitudeError(const double R[9], const double est[9])
+{
+	double E[9], v[3];
+	int i, j, k;
+
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			E[3*i + j] = 0;
+			for (k = 0; k < 3; k++)
+				E[3*i + j] += est[3*i + k] * R[3*j + k];
+		}
+	}
+	v[0] = (E[7] - E[5]) / 2;
+	v[1] = (E[2] - E[6]) / 2;
+	v[2] = (E[3] - E[1]) / 2;
+	return atan2(sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]),
+			(E[0] + E[4] + E[8] - 1.0) / 2) * 180.0 / M_PI;
+}
+
+static double timeFloat(void)
+{
+	uint64_t best = ~0ull;
+	float buffer[9];
+	int r, i;
+
+	for (r = 0; r < BENCH_ROUNDS; r++)
+	{
+		uint64_t t = hostCycles();
+		for (i = 0; i < BENCH_SOLVES; i++)
+		{
+			const Solve *s = &bench[i];
+			computeAttitude(s->mag[0], s->mag[1], s->mag[2],
+					s->accel[0], s->accel[1], s->accel[2], buffer);
+			floatSink = buffer[0];
+		}
+		t = hostCycles() - t;
+		if (t < best) best = t;
+	}
+	return (double)best / BENCH_SOLVES;
+}
+
+static double timeQ14(void)
+{
+	uint64_t best = ~0ull;
+	int16_t buffer[9];
+	int r, i;
+
+	for (r = 0; r < BENCH_ROUNDS; r++)
+	{
+		uint64_t t = hostCycles();
+		for (i = 0; i < BENCH_SOLVES; i++)
+		{
+			const Solve *s = &bench[i];
+			computeAttitudeQ14(s->mag[0], s->mag[1], s->mag[2],
+					s->accel[0], s->accel[1], s->accel[2], buffer);
+			q14Sink = buffer[0];
+		}
+		t = hostCycles() - t;
+		if (t < best) best = t;
+	}
+	return (double)best / BENCH_SOLVES;
+}
+
+int main(void)
+{
+	int32_t binError[BINS] = {0};
+	double binFixedDeg[BINS] = {0}, binFloatDeg[BINS] = {0};
+	uint32_t binSolves[BINS] = {0}, binFailed[BINS] = {0};
+	uint32_t rebuilds;
+	int n, i, b;
+
+	LSM9DS1init(&imuDevices[0], 0);
+	calcaRes();
+	calcmRes();
+	srand(1);
+
+	for (n = 0; n < SOLVES; n++)
+	{
+		double R[9], fixedDcm[9], floatDcm[9], angle;
+		float reference[9];
+		int16_t q14[9];
+		int32_t err = 0;
+		Solve s;
+
+		magModelSetPosition((float)(asin(2.0 * uniform() - 1.0) * 180.0 / M_PI),
+				(float)(360.0 * uniform() - 180.0), (float)(300.0 + 300.0 * uniform()));
+		angle = acos(fabs(magModel.unit[2])) * 180.0 / M_PI;
+		randomDcm(R);
+		readings(R, &s);
+		for (b = BINS - 1; angle < binEdges[b]; b--)
+			;
+
+		if (!computeAttitudeQ14(s.mag[0], s.mag[1], s.mag[2],
+				s.accel[0], s.accel[1], s.accel[2], q14) ||
+			!computeAttitude(s.mag[0], s.mag[1], s.mag[2],
+				s.accel[0], s.accel[1], s.accel[2], reference))
+		{
+			binFailed[b]++;
+			continue;
+		}
+		for (i = 0; i < 9; i++)
+		{
+			int32_t e = abs(q14[i] - (int32_t)lrintf(reference[i] * Q14_ONE));
+			if (e > err) err = e;
+			fixedDcm[i] = q14[i] / (double)Q14_ONE;
+			floatDcm[i] = reference[i];
+		}
+
+		binSolves[b]++;
+		if (err > binError[b]) binError[b] = err;
+		binFixedDeg[b] = fmax(binFixedDeg[b], attitudeError(R, fixedDcm));
+		binFloatDeg[b] = fmax(binFloatDeg[b], attitudeError(R, floatDcm));
+	}
+	rebuilds = triadRef.rebuilds;
+
+	printf("down to field  solves  degenerate  max err Q14 LSB  max attitude err deg\n");
+	printf("                                                      Q14     float\n");
+	for (b = 0; b < BINS; b++)
+	{
+		char range[16];
+
+		if (b < BINS - 1)
+			snprintf(range, sizeof(range), "%2.0f-%2.0f deg", binEdges[b], binEdges[b + 1]);
+		else
+			snprintf(range, sizeof(range), "%2.0f-90 deg", binEdges[b]);
+		printf("%-13s  %6lu  %10lu  %15ld  %7.3f  %8.3f\n", range, (unsigned long)binSolves[b],
+				(unsigned long)binFailed[b], (long)binError[b], binFixedDeg[b], binFloatDeg[b]);
+	}
+	printf("reference rebuilds %lu\n", (unsigned long)rebuilds);
+
+	/* Timing at one position, so the reference stays cached */
+	magModelInit();
+	for (n = 0; n < BENCH_SOLVES; n++)
+	{
+		double R[9];
+
+		randomDcm(R);
+		readings(R, &bench[n]);
+	}
+	printf("host cycles/solve (FPU, not the Cortex-M3)  Q14 %7.1f  float %7.1f\n",
+			timeQ14(), timeFloat());
+
+	for (b = 0; b < BINS; b++)
+	{
+		if (fmax(binFixedDeg[b], binFloatDeg[b]) > MAX_ATTITUDE_DEG)
+		{
+			printf("FAILED: accepted solve %.3f deg off, limit %.1f\n",
+					fmax(binFixedDeg[b], binFloatDeg[b]), MAX_ATTITUDE_DEG);
+			return EXIT_FAILURE;
+		}
+		if ((binEdges[b] >= 10.0) && (binError[b] > TRIAD_Q14_TOLERANCE))
+		{
+			printf("FAILED: %ld LSB beyond 10 degrees, tolerance %d\n",
+					(long)binError[b], TRIAD_Q14_TOLERANCE);
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Turn the binary log lines sent by Tasks/Log.h back into text.
+
+The drain task sends one line per record:
+
+    @id stamp seq arg0 arg1 arg2        (all hex)
+
+The record formats are read from Tasks/Log_Records.h, so this script needs
+no update when records are added. Lines that are not log records are passed
+through unchanged.
+
+With --map, %x arguments that are the address of a global symbol in the
+linker map (task handles in LOG_TASK_STACK and LOG_TASK_CPU) are printed as
+the symbol name.
+
+    python3 tools/log_decode.py capture.txt
+    python3 tools/log_decode.py --map Debug/hello.map capture.txt
+    python3 -m serial.tools.miniterm /dev/ttyACM0 115200 | python3 tools/log_decode.py
+"""
+
+import argparse
+import os
+import re
+import sys
+
+RECORD_RE = re.compile(r'X\(\s*(\w+)\s*,\s*(\d+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)')
+LINE_RE = re.compile(r'@([0-9a-fA-F]+) ([0-9a-fA-F]+) ([0-9a-fA-F]+)'
+                     r' ([0-9a-fA-F]+) ([0-9a-fA-F]+) ([0-9a-fA-F]+)')
+
+# "address  name" lines of the TI linker map's global symbol tables
+SYMBOL_RE = re.compile(r'^\s*([0-9a-fA-F]{8})\s+(\w+)\s*$')
+
+# Clock.tickPeriod in microseconds (hello.cfg)
+TICK_US = 10
+
+
+def load_records(path):
+    """Return [(name, argc, format)] indexed by record id."""
+    with open(path) as f:
+        text = f.read()
+    return [(m.group(1), int(m.group(2)), m.group(3)) for m in RECORD_RE.finditer(text)]
+
+
+def load_symbols(path):
+    """Return {address: name} from a linker map."""
+    symbols = {}
+    with open(path) as f:
+        for line in f:
+            m = SYMBOL_RE.match(line)
+            if m:
+                symbols.setdefault(int(m.group(1), 16), m.group(2))
+    return symbols
+
+
+def signed32(value):
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def format_record(fmt, args, symbols=None):
+    # The formats use C %d/%x, which map directly onto Python's % operator
+    # once any length modifiers are dropped
+    fmt = re.sub(r'%l+([dxu])', r'%\1', fmt)
+    if symbols:
+        args = list(args)
+        convs = re.findall(r'%[dxu]', fmt)
+        for i, conv in enumerate(convs[:len(args)]):
+            if conv == '%x' and (args[i] & 0xffffffff) in symbols:
+                args[i] = symbols[args[i] & 0xffffffff]
+        it = iter(args)
+        fmt = re.sub(r'%[dxu]', lambda m: '%s' if isinstance(next(it), str) else m.group(0), fmt)
+    return fmt % tuple(args)
+
+
+def decode(lines, records, out, symbols=None):
+    last_seq = None
+    for line in lines:
+        m = LINE_RE.search(line)
+        if not m:
+            out.write(line)
+            continue
+        rid, stamp, seq = (int(g, 16) for g in m.groups()[:3])
+        raw = [signed32(int(g, 16)) for g in m.groups()[3:]]
+
+        if last_seq is not None and seq != (last_seq + 1) & 0xffff:
+            out.write('-- %d records missing --\n' % ((seq - last_seq - 1) & 0xffff))
+        last_seq = seq
+
+        if rid >= len(records):
+            out.write('%12.5f  <unknown record %d> %s\n' % (stamp * TICK_US / 1e6, rid, raw))
+            continue
+        name, argc, fmt = records[rid]
+        out.write('%12.5f  %s\n' % (stamp * TICK_US / 1e6, format_record(fmt, raw[:argc], symbols)))
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('input', nargs='?', help='captured UART output (default stdin)')
+    parser.add_argument('--records', default=os.path.join(here, '..', 'Tasks', 'Log_Records.h'),
+                        help='record table (default Tasks/Log_Records.h)')
+    parser.add_argument('--map', help='linker map to name task handles and other addresses')
+    args = parser.parse_args()
+
+    records = load_records(args.records)
+    symbols = load_symbols(args.map) if args.map else None
+    if args.input:
+        with open(args.input) as f:
+            decode(f, records, sys.stdout, symbols)
+    else:
+        decode(sys.stdin, records, sys.stdout, symbols)
+
+
+if __name__ == '__main__':
+    main()
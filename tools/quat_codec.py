@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""Pack and unpack attitude quaternions in the radio's smallest-three format.
+
+Matches Tasks/IMU/Quaternion.h bit for bit. The 8-byte payload is the
+big-endian packet counter in bytes 0..1 and three big-endian 16-bit words
+in bytes 2..7:
+
+    bits 15..1  one of the three smallest components, +-16383 = +-1/sqrt(2)
+    bit 0       word 0, 1: index of the dropped (largest) component
+                word 2: attitude valid
+
+    python3 tools/quat_codec.py 8a3c 1f02 7ffd        decode three words
+    python3 tools/quat_codec.py --payload 00 2a ...    decode a whole payload (8 bytes)
+    python3 tools/quat_codec.py --self-test            round-trip error check
+"""
+
+import argparse
+import math
+import random
+import sys
+
+Q14_ONE = 16384
+PACK_MAX = 16383
+PACK_SCALE = 92676
+UNPACK_SCALE = 46344
+# RFEASYLINKTXPAYLOAD_LENGTH in Tasks/Radio/RF_Globals.h
+PAYLOAD_LENGTH = 8
+
+
+def isqrt(x):
+    return math.isqrt(x) if x > 0 else 0
+
+
+def to_q14(q):
+    return [int(round(c * Q14_ONE)) for c in q]
+
+
+def shr(x, n):
+    """Arithmetic shift right, as on the target."""
+    return x >> n
+
+
+def pack(q, valid=True):
+    """Q14 quaternion (w, x, y, z) -> three 16-bit words."""
+    k = max(range(4), key=lambda i: (abs(q[i]), -i))
+    sign = -1 if q[k] < 0 else 1
+    words = []
+    for i in range(4):
+        if i == k:
+            continue
+        c = shr(sign * q[i] * PACK_SCALE + (1 << 15), 16)
+        c = max(-PACK_MAX, min(PACK_MAX, c))
+        words.append((c * 2) & 0xffff)
+    words[0] |= (k >> 1) & 1
+    words[1] |= k & 1
+    words[2] |= 1 if valid else 0
+    return words
+
+
+def unpack(words):
+    """Three 16-bit words -> (Q14 quaternion, valid)."""
+    k = ((words[0] & 1) << 1) | (words[1] & 1)
+    q = [0] * 4
+    rest = iter(words)
+    total = 0
+    for i in range(4):
+        if i == k:
+            continue
+        w = next(rest)
+        c = shr(w - 0x10000 if w & 0x8000 else w, 1)
+        q[i] = shr(c * UNPACK_SCALE + (1 << 15), 16)
+        total += q[i] * q[i]
+    q[k] = isqrt((1 << 28) - total)
+    return q, bool(words[2] & 1)
+
+
+def angle_between(a, b):
+    """Rotation angle between two float quaternions, radians."""
+    na = math.sqrt(sum(c * c for c in a))
+    nb = math.sqrt(sum(c * c for c in b))
+    dot = abs(sum(x * y for x, y in zip(a, b))) / (na * nb)
+    return 2.0 * math.acos(min(1.0, dot))
+
+
+def random_quaternion(rng):
+    q = [rng.gauss(0.0, 1.0) for _ in range(4)]
+    n = math.sqrt(sum(c * c for c in q))
+    return [c / n for c in q]
+
+
+def self_test(count, seed):
+    """Pack and unpack random attitudes. Returns True if all pass."""
+    rng = random.Random(seed)
+    worst_codec = 0.0
+    worst_total = 0.0
+    cases = [random_quaternion(rng) for _ in range(count)]
+    # Ties between the largest components and the identity are the edges
+    h = math.sqrt(0.5)
+    cases += [[1, 0, 0, 0], [0, 0, 0, -1], [h, h, 0, 0], [0.5, -0.5, 0.5, -0.5]]
+    for q in cases:
+        q14 = to_q14(q)
+        back, valid = unpack(pack(q14))
+        if not valid:
+            print('valid bit lost for', q)
+            return False
+        worst_codec = max(worst_codec, angle_between([c / Q14_ONE for c in q14], back))
+        worst_total = max(worst_total, angle_between(q, back))
+    # A 15-bit step is 4.3e-5 per component, a Q14 step 6.1e-5
+    limit = 4e-4
+    print('%d attitudes, worst codec error %.2e rad (%.4f deg), worst vs float %.2e rad'
+          % (len(cases), worst_codec, math.degrees(worst_codec), worst_total))
+    return worst_total < limit
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('words', nargs='*', help='three hex words, or payload bytes with --payload')
+    parser.add_argument('--payload', action='store_true', help='words are the raw payload bytes (hex)')
+    parser.add_argument('--self-test', action='store_true', help='run the round-trip check')
+    parser.add_argument('--count', type=int, default=100000)
+    parser.add_argument('--seed', type=int, default=1)
+    args = parser.parse_args()
+
+    if args.self_test:
+        sys.exit(0 if self_test(args.count, args.seed) else 1)
+
+    values = [int(w, 16) for w in args.words]
+    if args.payload:
+        if len(values) != PAYLOAD_LENGTH:
+            parser.error('a payload has %d bytes' % PAYLOAD_LENGTH)
+        print('packet %d' % ((values[0] << 8) | values[1]))
+        values = [(values[i] << 8) | values[i + 1] for i in (2, 4, 6)]
+    if len(values) != 3:
+        parser.error('need three words')
+    q, valid = unpack(values)
+    print('w %+.5f  x %+.5f  y %+.5f  z %+.5f  %s'
+          % (tuple(c / Q14_ONE for c in q) + ('valid' if valid else 'invalid',)))
+
+
+if __name__ == '__main__':
+    main()